@@ -53,8 +53,10 @@
 
 #include <ks.h>
 #include <gsks_internal.h>
+#include <ks_pool.h>
 #include <gsks_config.h>
 #include <gsks_kernel.h>
+#include <gsks_stats.h>
 
 
 #define min( i, j ) ( (i)<(j) ? (i): (j) )
@@ -78,6 +80,7 @@ inline void packA_kcxmc(
 {
   int    i, p;
   double *a_pntr[ DKS_PACK_MR ];
+  GSKS_STATS_TIC( tic );
 
   for ( i = 0; i < m; i ++ ) {
     a_pntr[ i ] = XA + ldXA * amap[ i ];
@@ -92,6 +95,9 @@ inline void packA_kcxmc(
       *packA ++ = *a_pntr[ i ] ++;
     }
   }
+
+  GSKS_STATS_PACK( sizeof(double) * DKS_PACK_MR * k, 0 );
+  GSKS_STATS_TOC( KS_PHASE_PACKA, tic );
 }
 
 
@@ -113,6 +119,7 @@ inline void packB_kcxnc(
   int    j, p; 
   //double *b_pntr[ DKS_NR ];
   double *b_pntr[ DKS_PACK_NR ];
+  GSKS_STATS_TIC( tic );
 
   for ( j = 0; j < n; j ++ ) {
     b_pntr[ j ] = XB + ldXB * bmap[ j ];
@@ -129,6 +136,9 @@ inline void packB_kcxnc(
       *packB ++ = *b_pntr[ j ] ++;
     }
   }
+
+  GSKS_STATS_PACK( 0, sizeof(double) * DKS_PACK_NR * k );
+  GSKS_STATS_TOC( KS_PHASE_PACKB, tic );
 }
 
 
@@ -143,6 +153,7 @@ inline void packw_rhsxnc(
 {
   int    j, p;
   double *w_pntr[ DKS_PACK_NR ];
+  GSKS_STATS_TIC( tic );
 
   for ( j = 0; j < n; j ++ ) {
     w_pntr[ j ] = w + ldw * wmap[ j ];
@@ -156,6 +167,8 @@ inline void packw_rhsxnc(
       *packw ++ = 0.0;
     }
   }
+
+  GSKS_STATS_TOC( KS_PHASE_GATHER, tic );
 }
 
 
@@ -170,6 +183,7 @@ inline void packu_rhsxmc(
 {
   int    i, p;
   double *u_pntr[ DKS_PACK_MR ];
+  GSKS_STATS_TIC( tic );
 
   for ( i = 0; i < m; i ++ ) {
     u_pntr[ i ] = u + ldu * umap[ i ];
@@ -183,6 +197,8 @@ inline void packu_rhsxmc(
       packu ++;
     }
   }
+
+  GSKS_STATS_TOC( KS_PHASE_GATHER, tic );
 }
 
 
@@ -197,6 +213,7 @@ inline void unpacku_rhsxmc(
 {
   int    i, p;
   double *u_pntr[ DKS_PACK_MR ];
+  GSKS_STATS_TIC( tic );
 
   for ( i = 0; i < m; i ++ ) {
     u_pntr[ i ] = u + ldu * umap[ i ];
@@ -210,6 +227,8 @@ inline void unpacku_rhsxmc(
       packu ++;
     }
   }
+
+  GSKS_STATS_TOC( KS_PHASE_UNPACKU, tic );
 }
 
 
@@ -247,6 +266,7 @@ void rank_k_macro_kernel(
 {
   int    i, j, ip, jp;
   aux_t  aux;
+  GSKS_STATS_TIC( tic );
 
   aux.pc     = pc;
   aux.b_next = packB;
@@ -256,6 +276,7 @@ void rank_k_macro_kernel(
       if ( i + DKS_MR >= m ) {
         aux.b_next += DKS_PACK_NR * k;
       }
+      GSKS_STATS_TILE( min( m - i, DKS_MR ) * min( n - j, DKS_NR ), DKS_MR * DKS_NR );
       ( *rankk ) (
           k,
           &packA[ ip * k ],
@@ -266,6 +287,8 @@ void rank_k_macro_kernel(
           );
     }
   }
+
+  GSKS_STATS_TOC( KS_PHASE_RANKK, tic );
 }
 
 
@@ -311,19 +334,67 @@ void dgsks_macro_kernel(
     int    pc
     )
 {
-  int    i, j, ip, jp;
+  int    i, j, ip, jp, mr, nr;
   aux_t  aux;
+  GSKS_STATS_TIC( tic );
 
   aux.pc     = pc;
   aux.b_next = packB;
 
   for ( j = 0, jp = 0; j < n; j += DKS_NR, jp += DKS_PACK_NR ) {
+    nr = min( n - j, DKS_NR );
     for ( i = 0, ip = 0; i < m; i += DKS_MR, ip += DKS_PACK_MR ) {
+      mr = min( m - i, DKS_MR );
       if ( i + DKS_MR >= m ) {
         aux.b_next += DKS_PACK_NR * k;
       }
 	  aux.hi = packAh + ip;
 	  aux.hj = packBh + jp;
+#ifdef DKS_FRINGE_MR
+      // Edge tiles skip the padded lanes with the fringe micro-kernel.
+      if ( mr <= DKS_FRINGE_MR || nr < DKS_NR ) {
+        // The fringe kernel works on DKS_FRINGE_MR row vectors.
+        GSKS_STATS_TILE( mr * nr, ( ( mr - 1 ) / DKS_FRINGE_MR + 1 ) * DKS_FRINGE_MR * nr );
+        ( *fringe )(
+            k,
+            mr,
+            nr,
+            KS_RHS,
+            packu  + ip * KS_RHS,
+            packA2 + ip,
+            packA  + ip * k,
+            packB2 + jp,
+            packB  + jp * k,
+            packw  + jp * KS_RHS,
+            packC  + j  * ldc + i * DKS_NR, // packed
+            kernel,
+            &aux
+            );
+        continue;
+      }
+#endif
+#ifdef DKS_LOWDIM_KMAX
+      // Unrolled direct distance kernels. pc == 0 means the whole k fits
+      // in this slice.
+      if ( pc == 0 && k <= DKS_LOWDIM_KMAX ) {
+        GSKS_STATS_TILE( mr * nr, DKS_MR * DKS_NR );
+        ( *lowdim[ k - 1 ] )(
+            k,
+            KS_RHS,
+            packu  + ip * KS_RHS,
+            packA2 + ip,
+            packA  + ip * k,
+            packB2 + jp,
+            packB  + jp * k,
+            packw  + jp * KS_RHS,
+            NULL,
+            kernel,
+            &aux
+            );
+        continue;
+      }
+#endif
+      GSKS_STATS_TILE( mr * nr, DKS_MR * DKS_NR );
       ( *micro[ kernel->type ] )(
           k,
           KS_RHS,
@@ -339,6 +410,347 @@ void dgsks_macro_kernel(
           );
     }
   }
+
+  GSKS_STATS_TOC( KS_PHASE_KERNEL, tic );
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  A thread group of dgsks_pool_body(), after thread_comm_s of the
+ *         MIC version: the threads of a group pack one shared copy of
+ *         each B panel together and synchronize with the signal / arrived
+ *         counters only, so groups never wait for each other.
+ * --------------------------------------------------------------------------
+ */
+struct thread_comm_s {
+  int    nthd;
+  int    first;                                    // tid of rank 0
+  int    node;                                     // NUMA node, or -1
+  int    signal;
+  int    arrived  __attribute__(( aligned( 64 ) ));
+  double *packB    __attribute__(( aligned( 64 ) ));
+  double *packB2;
+  double *packBh;
+  double *packw;
+} __attribute__(( aligned( 64 ) ));
+
+typedef struct thread_comm_s ks_comm_t;
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Lock-free barrier of the comm->nthd threads of a group. The last
+ *         thread to arrive resets the counter and flips the signal.
+ * --------------------------------------------------------------------------
+ */
+static void ks_comm_barrier(
+    ks_comm_t *comm
+    )
+{
+  int    my_signal, my_arrived, polls = 0;
+
+  if ( comm->nthd < 2 ) return;
+
+  my_signal  = __atomic_load_n( &comm->signal, __ATOMIC_ACQUIRE );
+  my_arrived = __atomic_add_fetch( &comm->arrived, 1, __ATOMIC_ACQ_REL );
+
+  if ( my_arrived == comm->nthd ) {
+    __atomic_store_n( &comm->arrived, 0, __ATOMIC_RELAXED );
+    __atomic_store_n( &comm->signal, !my_signal, __ATOMIC_RELEASE );
+  }
+  else {
+    while ( __atomic_load_n( &comm->signal, __ATOMIC_ACQUIRE ) == my_signal ) {
+      ks_pool_relax( &polls );
+    }
+  }
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Arguments of dgsks_pool_body().
+ * --------------------------------------------------------------------------
+ */
+struct dgsks_pool_arg_s {
+  ks_t   *kernel;
+  int    m;
+  int    n;
+  int    k;
+  int    pack_norm;
+  int    pack_bandwidth;
+  double *u;
+  int    *umap;
+  double *XA;
+  double *XA2;
+  int    *amap;
+  double *XB;
+  double *XB2;
+  int    *bmap;
+  double *w;
+  int    *wmap;
+  double *packA;
+  double *packA2;
+  double *packAh;
+  double *packu;
+  int    nc;             // columns of a packB panel
+  int    *tgroup;        // group of each thread
+  ks_comm_t *comm;       // one per group, with the packed B replicas
+};
+
+typedef struct dgsks_pool_arg_s dgsks_pool_arg_t;
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Packed B replicas of groups 1, 2, ... of dgsks_pool_body().
+ *         Only a pool run touches them and the pool runs one call at a
+ *         time, so they are kept across calls; the first thread of each
+ *         group grows its replica when a call needs more columns, and
+ *         replaces it when the group moved to another NUMA node, so the
+ *         pages are first touched on the node that reads them.
+ * --------------------------------------------------------------------------
+ */
+struct dgsks_rep_s {
+  int    nc;
+  int    node;
+  double *packB;
+  double *packB2;
+  double *packBh;
+  double *packw;
+};
+
+static struct dgsks_rep_s dgsks_rep[ KS_POOL_MAX_THREAD ];
+
+static void dgsks_rep_get(
+    ks_comm_t *comm,
+    int    gid,
+    int    nc
+    )
+{
+  struct dgsks_rep_s *rep = &dgsks_rep[ gid ];
+  int    j;
+
+  if ( rep->nc < nc || rep->node != comm->node ) {
+    ks_free_huge( rep->packB );
+    ks_free_aligned( rep->packB2 );
+    ks_free_aligned( rep->packBh );
+    ks_free_aligned( rep->packw );
+    rep->packB  = ks_malloc_huge( DKS_KC, ( nc + 1 ), sizeof(double), KS_BUF_PACKB );
+    rep->packB2 = ks_malloc_aligned(      1, ( nc + 1 ), sizeof(double) );
+    rep->packBh = ks_malloc_aligned(      1, ( nc + 1 ), sizeof(double) );
+    rep->packw  = ks_malloc_aligned( KS_RHS, ( nc + 1 ), sizeof(double) );
+    rep->nc     = nc;
+    rep->node   = comm->node;
+    if ( rep->node >= 0 ) {
+      ks_numa_bind( rep->packB, sizeof(double) * DKS_KC * ( nc + 1 ), rep->node );
+    }
+  }
+  for ( j = 0; j < nc + 1; j ++ ) rep->packB2[ j ] = 0.0;
+
+  comm->packB  = rep->packB;
+  comm->packB2 = rep->packB2;
+  comm->packBh = rep->packBh;
+  comm->packw  = rep->packw;
+}
+
+
+static void dgsks_rep_release(
+    int    tid,
+    int    nt,
+    void   *arg
+    )
+{
+  struct dgsks_rep_s *rep;
+  int    g;
+
+  (void)tid;
+  (void)nt;
+  (void)arg;
+
+  for ( g = 0; g < KS_POOL_MAX_THREAD; g ++ ) {
+    rep = &dgsks_rep[ g ];
+    ks_free_huge( rep->packB );
+    ks_free_aligned( rep->packB2 );
+    ks_free_aligned( rep->packBh );
+    ks_free_aligned( rep->packw );
+    rep->packB  = rep->packB2 = rep->packBh = rep->packw = NULL;
+    rep->nc     = 0;
+    rep->node   = 0;
+  }
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Release what dgsks() keeps between calls: the packB replicas
+ *         of the pooled loops and the idle huge page mappings
+ *         ( ks_hugepage_release ). The replicas are freed in a pool run
+ *         of one thread, so a dgsks() call in flight keeps its own; they
+ *         are left alone if the pool is busy.
+ * --------------------------------------------------------------------------
+ */
+void dgsks_release()
+{
+  ks_pool_run( 1, dgsks_rep_release, NULL );
+  ks_hugepage_release();
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  The k <= DKS_KC loops as one parallel region on the worker pool
+ *         ( ks_pool.h ). Consecutive threads form a group ( tgroup ) that
+ *         takes a contiguous range of ic blocks, in proportion to its
+ *         size, and packs its own copy of each B panel: rank r of the
+ *         group packs every gnt-th micro-panel, a group barrier separates
+ *         packB from its readers and the readers from the next packB.
+ *         With one group per last level cache ( and never more than one
+ *         NUMA node ), each copy is packed by the threads that read it
+ *         and stays in their cache and their memory. With nt = 1 it runs
+ *         on the caller alone.
+ * --------------------------------------------------------------------------
+ */
+static void dgsks_pool_body(
+    int    tid,
+    int    nt,
+    void   *arg
+    )
+{
+  dgsks_pool_arg_t *a = (dgsks_pool_arg_t*)arg;
+  ks_t   *kernel = a->kernel;
+  int    m = a->m, n = a->n, k = a->k;
+  int    i, j, ip, jp, ic, ib, jc, jb, pc, pb, ir, jr;
+  int    gid  = a->tgroup[ tid ];
+  ks_comm_t *comm = &a->comm[ gid ];
+  int    rank = tid - comm->first;
+  int    nblk = ( m - 1 ) / DKS_MC + 1;
+  int    blk_beg, blk_end, gnt;
+  double *packA  = a->packA  + tid * DKS_PACK_MC * DKS_KC;
+  double *packA2 = a->packA2 + tid * DKS_PACK_MC;
+  double *packAh = a->packAh ? a->packAh + tid * DKS_PACK_MC : NULL;
+  double *packu  = a->packu  + tid * DKS_PACK_MC * KS_RHS;
+
+  gnt     = comm->nthd;
+  blk_beg = (int)( ( (long)nblk * comm->first ) / nt );
+  blk_end = (int)( ( (long)nblk * ( comm->first + gnt ) ) / nt );
+
+  // Group 0 packs into the caller's buffers, the others into dgsks_rep.
+  if ( gid > 0 ) {
+    if ( rank == 0 ) dgsks_rep_get( comm, gid, a->nc );
+    ks_comm_barrier( comm );
+  }
+
+  for ( jc = 0; jc < n; jc += DKS_NC ) {              // 6-th loop
+    jb = min( n - jc, DKS_NC );
+    for ( pc = 0; pc < k; pc += DKS_KC ) {            // 5-th loop
+      pb = min( k - pc, DKS_KC );
+
+      // A group without ic blocks has nobody to pack for.
+      if ( blk_beg < blk_end ) {
+        for ( j  = rank * DKS_NR, jp = rank * DKS_PACK_NR; j < jb;
+              j += gnt * DKS_NR, jp += gnt * DKS_PACK_NR ) {
+
+          packw_rhsxnc(
+              min( jb - j, DKS_NR ),
+              KS_RHS,
+              a->w,
+              KS_RHS,
+              &a->wmap[ jc + j ],
+              &comm->packw[ jp * KS_RHS ]
+              );
+
+          for ( jr = 0; jr < min( jb - j, DKS_NR ); jr ++ ) {
+            if ( a->pack_norm ) {
+              comm->packB2[ jp + jr ] = a->XB2[ a->bmap[ jc + j + jr ] ];
+            }
+            if ( a->pack_bandwidth ) {
+              comm->packBh[ jp + jr ] = kernel->hj[ a->bmap[ jc + j + jr ] ];
+            }
+          }
+
+          packB_kcxnc(
+              min( jb - j, DKS_NR ),
+              pb,
+              a->XB,
+              k, // should be ldXB instead
+              &a->bmap[ jc + j ],
+              &comm->packB[ jp * k ]
+              );
+        }
+      }
+      ks_comm_barrier( comm );
+
+      for ( ic = ( blk_beg + rank ) * DKS_MC; ic < blk_end * DKS_MC && ic < m;
+            ic += gnt * DKS_MC ) {                    // 4-th loop
+        ib = min( m - ic, DKS_MC );
+
+        for ( i = 0, ip = 0; i < ib; i += DKS_MR, ip += DKS_PACK_MR ) {
+          packu_rhsxmc(
+              min( ib - i, DKS_MR ),
+              KS_RHS,
+              a->u,
+              KS_RHS,
+              &a->umap[ ic + i ],
+              &packu[ ip * KS_RHS ]
+              );
+
+          for ( ir = 0; ir < min( ib - i, DKS_MR ); ir ++ ) {
+            if ( a->pack_norm ) {
+              packA2[ ip + ir ] = a->XA2[ a->amap[ ic + i + ir ] ];
+            }
+            if ( a->pack_bandwidth ) {
+              packAh[ ip + ir ] = kernel->hi[ a->amap[ ic + i + ir ] ];
+            }
+          }
+          packA_kcxmc(
+              min( ib - i, DKS_MR ),
+              pb,
+              a->XA,
+              k,
+              &a->amap[ ic + i ],
+              &packA[ ip * pb ]
+              );
+        }
+
+        dgsks_macro_kernel(                           // 1~3 loops
+            kernel,
+            ib,
+            jb,
+            pb,
+            packu,
+            packA,
+            packA2,
+            packAh,
+            comm->packB,
+            comm->packB2,
+            comm->packBh,
+            comm->packw,
+            NULL,
+            0,
+            pc
+            );
+
+        for ( i = 0, ip = 0; i < ib; i += DKS_MR, ip += DKS_PACK_MR ) {
+          unpacku_rhsxmc(
+              min( ib - i, DKS_MR ),
+              KS_RHS,
+              a->u,
+              KS_RHS,
+              &a->umap[ ic + i ],
+              &packu[ ip * KS_RHS ]
+              );
+        }
+      }
+      ks_comm_barrier( comm );
+    }
+  }
 }
 
 
@@ -384,8 +796,8 @@ void dgsks(
   int    i, j, p, ip, jp;
   int    ic, ib, jc, jb, pc, pb;
   int    ir, jr;
-  int    pack_norm, pack_bandwidth, ks_ic_nt;
-  int    ldc, padn;
+  int    pack_norm, pack_bandwidth, ks_ic_nt, ks_packc, nnode;
+  int    ldc, padn, nc;
   double *packA, *packB, *packC, *packw, *packu;
   double *packA2 = NULL, *packB2 = NULL, *packAh = NULL, *packBh = NULL;
   char   *str;
@@ -396,24 +808,45 @@ void dgsks(
     return;
   }
 
-  // Sequential is the default situation.
-  ks_ic_nt = 1;
+  // Sequential is the default situation ( KS_IC_NT or ks_set_ic_nt() ).
+  ks_ic_nt = ks_get_ic_nt();
 
-  // Check the environment variable.
-  str = getenv( "KS_IC_NT" );
+  // KS_PACKC=1 selects the original m x nc packC variant for k > DKS_KC.
+  ks_packc = 0;
+  str = getenv( "KS_PACKC" );
   if ( str != NULL ) {
-    ks_ic_nt = (int)strtol( str, NULL, 10 );
+    ks_packc = (int)strtol( str, NULL, 10 );
+  }
+
+  // On multi-socket nodes the packB groups of the pooled loops never
+  // span two NUMA nodes, so every node packs and reads its own replica.
+  // KS_NUMA=0 lets the groups cross nodes.
+  nnode = 1;
+  if ( ks_ic_nt > 1 ) {
+    nnode = ks_numa_num_nodes();
+    str = getenv( "KS_NUMA" );
+    if ( str != NULL && !(int)strtol( str, NULL, 10 ) ) {
+      nnode = 1;
+    }
   }
 
-  packA  = ks_malloc_aligned( DKS_KC, ( DKS_PACK_MC + 1 ) * ks_ic_nt, sizeof(double) ); 
+  // For k > DKS_KC the default variant packs all kc slices of a narrower
+  // jc panel at once, so that the packed B footprint stays DKS_NC x DKS_KC.
+  nc = DKS_PACK_NC;
+  if ( k > DKS_KC && !ks_packc ) {
+    nc = ( ( DKS_NC * DKS_KC ) / k ) / DKS_NR * DKS_NR;
+    if ( nc < DKS_NR ) nc = DKS_NR;
+  }
+
+  packA  = ks_malloc_huge( DKS_KC, ( DKS_PACK_MC + 1 ) * ks_ic_nt, sizeof(double), KS_BUF_PACKA ); 
   packA2 = ks_malloc_aligned(      1, ( DKS_PACK_MC + 1 ) * ks_ic_nt, sizeof(double) ); 
   packu  = ks_malloc_aligned( KS_RHS, ( DKS_PACK_MC + 1 ) * ks_ic_nt, sizeof(double) ); 
-  packB  = ks_malloc_aligned( DKS_KC, ( DKS_PACK_NC + 1 )           , sizeof(double) ); 
-  packB2 = ks_malloc_aligned(      1, ( DKS_PACK_NC + 1 )           , sizeof(double) ); 
-  packw  = ks_malloc_aligned( KS_RHS, ( DKS_PACK_NC + 1 )           , sizeof(double) ); 
+  packB  = ks_malloc_huge( ( nc < DKS_PACK_NC ) ? k : DKS_KC, ( nc + 1 ), sizeof(double), KS_BUF_PACKB ); 
+  packB2 = ks_malloc_aligned(      1, ( nc + 1 )           , sizeof(double) ); 
+  packw  = ks_malloc_aligned( KS_RHS, ( nc + 1 )           , sizeof(double) ); 
 
   // Initilize packA2 and packB2 from getting nan.
-  for ( j = 0; j < DKS_PACK_NC + 1; j ++ ) packB2[ j ] = 0.0;
+  for ( j = 0; j < nc + 1; j ++ ) packB2[ j ] = 0.0;
   for ( i = 0; i < DKS_PACK_MC + 1; i ++ ) packA2[ i ] = 0.0;
 
 
@@ -430,7 +863,7 @@ void dgsks(
       pack_bandwidth = 1;
       pack_norm      = 1;
       packAh         = ks_malloc_aligned( 1, ( DKS_PACK_MC + 1 ) * ks_ic_nt, sizeof(double) ); 
-      packBh         = ks_malloc_aligned( 1, ( DKS_PACK_NC + 1 ), sizeof(double) ); 
+      packBh         = ks_malloc_aligned( 1, ( nc + 1 ), sizeof(double) ); 
       break;
     case KS_POLYNOMIAL:
       pack_bandwidth = 0;
@@ -468,14 +901,150 @@ void dgsks(
   }
 
 
-  if ( k > DKS_KC ) {
+  if ( k > DKS_KC && !ks_packc ) {
+
+    // Each thread accumulates its mc x nc block in a private packC, which
+    // stays in cache across the kc slices instead of going back to memory.
+    packC = ks_malloc_huge( DKS_PACK_MC * nc, ks_ic_nt, sizeof(double), KS_BUF_PACKC ); 
+
+    for ( jc = 0; jc < n; jc += nc ) {                // 6-th loop
+      jb = min( n - jc, nc );
+
+      // Pack every kc slice of the panel. Slice pc starts at packB + pc * nc,
+      // so each slice has the layout the macro-kernels expect.
+      #pragma omp parallel for num_threads( ks_ic_nt ) private( j, jr, jp, pc, pb )
+      for ( j = 0; j < jb; j += DKS_NR ) {
+        jp = j / DKS_NR * DKS_PACK_NR;
+
+        packw_rhsxnc(
+            min( jb - j, DKS_NR ),
+            KS_RHS,
+            w,
+            KS_RHS,
+            &wmap[ jc + j ],
+            &packw[ jp * KS_RHS ]
+            );
+
+        for ( jr = 0; jr < min( jb - j, DKS_NR ); jr ++ ) {
+          if ( pack_norm ) {
+            packB2[ jp + jr ] = XB2[ bmap[ jc + j + jr ] ];
+          }
+          if ( pack_bandwidth ) {
+            packBh[ jp + jr ] = kernel->hj[ bmap[ jc + j + jr ] ];
+          }
+        }
+
+        for ( pc = 0; pc < k; pc += DKS_KC ) {
+          pb = min( k - pc, DKS_KC );
+          packB_kcxnc(
+              min( jb - j, DKS_NR ),
+              pb,
+              &XB[ pc ],
+              k, // should be ldXB instead
+              &bmap[ jc + j ],
+              &packB[ pc * nc + jp * pb ]
+              );
+        }
+      }
+
+      #pragma omp parallel for num_threads( ks_ic_nt ) private( ic, ib, i, ir, ip, pc, pb )
+      for ( ic = 0; ic < m; ic += DKS_MC ) {          // 4-th loop
+
+        int     tid = omp_get_thread_num();
+
+        ib = min( m - ic, DKS_MC );
+
+        for ( i = 0, ip = 0; i < ib; i += DKS_MR, ip += DKS_PACK_MR ) {
+          packu_rhsxmc(
+              min( ib - i, DKS_MR ),
+              KS_RHS,
+              u,
+              KS_RHS,
+              &umap[ ic + i ],
+              &packu[ tid * DKS_PACK_MC * KS_RHS + ip * KS_RHS ]
+              );
+
+          for ( ir = 0; ir < min( ib - i, DKS_MR ); ir ++ ) {
+            if ( pack_norm ) {
+              packA2[ tid * DKS_PACK_MC + ip + ir ] = XA2[ amap[ ic + i + ir ] ];
+            }
+            if ( pack_bandwidth ) {
+              packAh[ tid * DKS_PACK_MC + ip + ir ] = kernel->hi[ amap[ ic + i + ir ] ];
+            }
+          }
+        }
+
+        // Threads reach the kc slices at different times, so each packA
+        // keeps a full DKS_KC stride even on the short last slice.
+        for ( pc = 0; pc < k; pc += DKS_KC ) {        // 5-th loop
+          pb = min( k - pc, DKS_KC );
+
+          for ( i = 0, ip = 0; i < ib; i += DKS_MR, ip += DKS_PACK_MR ) {
+            packA_kcxmc(
+                min( ib - i, DKS_MR ),
+                pb,
+                &XA[ pc ],
+                k,
+                &amap[ ic + i ],
+                &packA[ tid * DKS_PACK_MC * DKS_KC + ip * pb ]
+                );
+          }
+
+          if ( pc + DKS_KC < k ) {
+            rank_k_macro_kernel(
+                ib,
+                jb,
+                pb,
+                packA   + tid * DKS_PACK_MC * DKS_KC,
+                packB   + pc * nc,
+                packC   + tid * DKS_PACK_MC * nc,       // packed
+                ( ( ib - 1 ) / DKS_MR + 1 ) * DKS_MR, // packed ldc
+                pc
+                );
+          }
+          else {
+            dgsks_macro_kernel(                       // 1~3 loops
+                kernel,
+                ib,
+                jb,
+                pb,
+                packu  + tid * DKS_PACK_MC * KS_RHS,
+                packA  + tid * DKS_PACK_MC * DKS_KC,
+                packA2 + tid * DKS_PACK_MC,
+                packAh + tid * DKS_PACK_MC,
+                packB  + pc * nc,
+                packB2,
+                packBh,
+                packw,
+                packC  + tid * DKS_PACK_MC * nc,        // packed
+                ( ( ib - 1 ) / DKS_MR + 1 ) * DKS_MR, // packed ldc
+                pc
+                );
+          }
+        }
+
+        for ( i = 0, ip = 0; i < ib; i += DKS_MR, ip += DKS_PACK_MR ) {
+          unpacku_rhsxmc(
+              min( ib - i, DKS_MR ),
+              KS_RHS,
+              u,
+              KS_RHS,
+              &umap[ ic + i ],
+              &packu[ tid * DKS_PACK_MC * KS_RHS + ip * KS_RHS ]
+              );
+        }
+      }
+    }
+    ks_free_huge( packC );
+  }
+  else if ( k > DKS_KC ) {
     ldc  = ( ( m - 1 ) / DKS_PACK_MR + 1 ) * DKS_PACK_MR;
     padn = DKS_NC;
     if ( n < DKS_NC ) {
       padn = ( ( n - 1 ) / DKS_PACK_NR + 1 ) * DKS_PACK_NR;
     }
 
-    packC = ks_malloc_aligned( ldc, padn, sizeof(double) ); 
+    packC = ks_malloc_huge( ldc, padn, sizeof(double), KS_BUF_PACKC ); 
 
     for ( jc = 0; jc < n; jc += DKS_NC ) {            // 6-th loop
       jb = min( n - jc, DKS_NC );
@@ -483,7 +1052,8 @@ void dgsks(
         pb = min( k - pc, DKS_KC );
 
         #pragma omp parallel for num_threads( ks_ic_nt ) private( j, jr, jp )
-        for ( j = 0, jp = 0; j < jb; j += DKS_NR, jp += DKS_PACK_NR ) {
+        for ( j = 0; j < jb; j += DKS_NR ) {
+          jp = j / DKS_NR * DKS_PACK_NR;
           
           if ( pc + DKS_KC >= k ) {
             packw_rhsxnc(                            // packw
@@ -602,21 +1172,94 @@ void dgsks(
         }
       }
     }
-#ifdef GSKS_MIC_AVX512
-    hbw_free( packC );
-#else
-    free( packC );
-#endif
+    ks_free_huge( packC );
   }
   else {
+    dgsks_pool_arg_t arg;
+    ks_comm_t        *comm;
+    int              ran = 0, gmax, ngroup, t, *tgroup;
+
+    arg.kernel         = kernel;
+    arg.m              = m;
+    arg.n              = n;
+    arg.k              = k;
+    arg.pack_norm      = pack_norm;
+    arg.pack_bandwidth = pack_bandwidth;
+    arg.u              = u;
+    arg.umap           = umap;
+    arg.XA             = XA;
+    arg.XA2            = XA2;
+    arg.amap           = amap;
+    arg.XB             = XB;
+    arg.XB2            = XB2;
+    arg.bmap           = bmap;
+    arg.w              = w;
+    arg.wmap           = wmap;
+    arg.packA          = packA;
+    arg.packA2         = packA2;
+    arg.packAh         = packAh;
+    arg.packu          = packu;
+    arg.nc             = nc;
+
+    // Threads per packB copy: runs of consecutive threads whose cpus
+    // share a NUMA node and a last level cache ( the pool pins its
+    // workers in that order ), at most KS_IC_GROUP of them. Unpinned
+    // workers or unknown caches give one group. Group 0 uses packB
+    // itself, the others get replicas on their node inside the run
+    // ( dgsks_rep_get ).
+    gmax = ks_ic_nt;
+    str  = getenv( "KS_IC_GROUP" );
+    if ( str != NULL ) {
+      gmax = (int)strtol( str, NULL, 10 );
+    }
+    if ( gmax < 1 || gmax > ks_ic_nt ) gmax = ks_ic_nt;
+
+    comm   = (ks_comm_t*)ks_malloc_aligned( ks_ic_nt, 1, sizeof(ks_comm_t) );
+    tgroup = (int*)malloc( sizeof(int) * ks_ic_nt );
+    ngroup = 0;
+    for ( t = 0; t < ks_ic_nt; t ++ ) {
+      if ( t == 0 || t - comm[ ngroup - 1 ].first == gmax ||
+           ks_pool_llc_of( t ) != ks_pool_llc_of( t - 1 ) ||
+           ( nnode > 1 && ks_pool_node_of( t ) != ks_pool_node_of( t - 1 ) ) ) {
+        p = ngroup ++;
+        comm[ p ].nthd    = 0;
+        comm[ p ].first   = t;
+        comm[ p ].node    = ( nnode > 1 ) ? ks_pool_node_of( t ) : -1;
+        comm[ p ].signal  = 0;
+        comm[ p ].arrived = 0;
+        comm[ p ].packB   = ( p == 0 ) ? packB  : NULL;
+        comm[ p ].packB2  = ( p == 0 ) ? packB2 : NULL;
+        comm[ p ].packBh  = ( p == 0 ) ? packBh : NULL;
+        comm[ p ].packw   = ( p == 0 ) ? packw  : NULL;
+      }
+      comm[ ngroup - 1 ].nthd ++;
+      tgroup[ t ] = ngroup - 1;
+    }
+    arg.tgroup = tgroup;
+    arg.comm   = comm;
+
+    // One pool run per call instead of two OpenMP regions per ( jc, pc ).
+    // The OpenMP loops below remain for KS_POOL=0 and for calls made
+    // while the pool is busy ( e.g. concurrent list teams ).
+    if ( ks_ic_nt == 1 ) {
+      dgsks_pool_body( 0, 1, &arg );
+      ran = 1;
+    }
+    else {
+      ran = ks_pool_run( ks_ic_nt, dgsks_pool_body, &arg );
+    }
 
-    for ( jc = 0; jc < n; jc += DKS_NC ) {            // 6-th loop
+    free( tgroup );
+    ks_free_aligned( comm );
+
+    for ( jc = 0; !ran && jc < n; jc += DKS_NC ) {    // 6-th loop
       jb = min( n - jc, DKS_NC );
       for ( pc = 0; pc < k; pc += DKS_KC ) {          // 5-th loop
         pb = min( k - pc, DKS_KC );
 
         #pragma omp parallel for num_threads( ks_ic_nt ) private( j, jr, jp )
-        for ( j = 0, jp = 0; j < jb; j += DKS_NR, jp += DKS_PACK_NR ) {
+        for ( j = 0; j < jb; j += DKS_NR ) {
+          jp = j / DKS_NR * DKS_PACK_NR;
 
           packw_rhsxnc(
             min( jb - j, DKS_NR ),
@@ -723,16 +1366,14 @@ void dgsks(
   // -----------------------------------------------------------------
   // Free all packing buffers.
   // -----------------------------------------------------------------
+  ks_free_huge( packA );
+  ks_free_huge( packB );
 #ifdef GSKS_MIC_AVX512
-  hbw_free( packA );
-  hbw_free( packB );
   hbw_free( packu );
   hbw_free( packw );
   hbw_free( packA2 );
   hbw_free( packB2 );
 #else
-  free( packA );
-  free( packB );
   free( packu );
   free( packw );
   free( packA2 );
@@ -777,6 +1418,292 @@ void dgsks(
 
 
 
+/*
+ * --------------------------------------------------------------------------
+ * Incremental updates.
+ *
+ * A gsks_targets_t keeps the targets of repeated dgsks() calls packed the
+ * way the k <= DKS_KC macro-kernel reads them: packA, packA2 and packAh
+ * of all m targets, MR-panel after MR-panel. dgsks_delta() then only
+ * packs the changed sources and their weight changes, so an update
+ * costs O( m * n * k ) for n changed sources, without the O( m * k )
+ * target packing of every dgsks() call. The packed copy takes m * k
+ * doubles. For k > DKS_KC nothing is packed and dgsks_delta() is a
+ * dgsks() call.
+ * --------------------------------------------------------------------------
+ */
+struct targets_s {
+  int    m;
+  int    k;
+  int    *amap;               // copy of the target map
+  double *XA;
+  double *XA2;
+  ks_type type;
+  double *packA;              // NULL for k > DKS_KC
+  double *packA2;
+  double *packAh;
+};
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Which per-point values the micro-kernels of kernel->type read,
+ *         and the Laplace constants, as in dgsks().
+ * --------------------------------------------------------------------------
+ */
+static void dgsks_delta_setup(
+    ks_t   *kernel,
+    int    k,
+    int    *pack_norm,
+    int    *pack_bandwidth
+    )
+{
+  *pack_norm      = ( kernel->type != KS_POLYNOMIAL && kernel->type != KS_TANH );
+  *pack_bandwidth = ( kernel->type == KS_GAUSSIAN_VAR_BANDWIDTH );
+
+  if ( kernel->type == KS_LAPLACE ) {
+    kernel->powe = 0.5 * ( 2.0 - (double)k );
+    kernel->scal = tgamma( 0.5 * k + 1.0 ) / 
+      ( (double)k * (double)( k - 2 ) * pow( M_PI, 0.5 * k ) );
+  }
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Pack the m targets XA[ amap ] for dgsks_delta(). XA and XA2 are
+ *         not copied and must outlive the handle; for the variable
+ *         bandwidth kernel kernel->hi is packed now. Create a new handle
+ *         when the targets change.
+ * --------------------------------------------------------------------------
+ */
+gsks_targets_t *gsks_targets_create(
+    ks_t   *kernel,
+    int    m,
+    int    k,
+    double *XA,
+    double *XA2,
+    int    *amap
+    )
+{
+  gsks_targets_t *A;
+  int    i, ip, ir, mpad, pack_norm, pack_bandwidth;
+
+  A = (gsks_targets_t*)malloc( sizeof(gsks_targets_t) );
+  A->m      = m;
+  A->k      = k;
+  A->XA     = XA;
+  A->XA2    = XA2;
+  A->type   = kernel->type;
+  A->amap   = (int*)malloc( sizeof(int) * ( m + 1 ) );
+  A->packA  = NULL;
+  A->packA2 = NULL;
+  A->packAh = NULL;
+  for ( i = 0; i < m; i ++ ) A->amap[ i ] = amap[ i ];
+
+  if ( m == 0 || k > DKS_KC ) return A;
+
+  dgsks_delta_setup( kernel, k, &pack_norm, &pack_bandwidth );
+
+  mpad      = ( ( m - 1 ) / DKS_MR + 1 ) * DKS_PACK_MR;
+  A->packA  = ks_malloc_aligned( k, mpad, sizeof(double) );
+  A->packA2 = ks_malloc_aligned( 1, mpad, sizeof(double) );
+  for ( i = 0; i < mpad; i ++ ) A->packA2[ i ] = 0.0;
+  if ( pack_bandwidth ) {
+    A->packAh = ks_malloc_aligned( 1, mpad, sizeof(double) );
+    for ( i = 0; i < mpad; i ++ ) A->packAh[ i ] = 0.0;
+  }
+
+  #pragma omp parallel for private( ip, ir )
+  for ( i = 0; i < m; i += DKS_MR ) {
+    ip = ( i / DKS_MR ) * DKS_PACK_MR;
+    for ( ir = 0; ir < min( m - i, DKS_MR ); ir ++ ) {
+      if ( pack_norm ) {
+        A->packA2[ ip + ir ] = XA2[ amap[ i + ir ] ];
+      }
+      if ( pack_bandwidth ) {
+        A->packAh[ ip + ir ] = kernel->hi[ amap[ i + ir ] ];
+      }
+    }
+    packA_kcxmc(
+        min( m - i, DKS_MR ),
+        k,
+        XA,
+        k,
+        &amap[ i ],
+        &A->packA[ ip * k ]
+        );
+  }
+
+  return A;
+}
+
+
+
+void gsks_targets_free(
+    gsks_targets_t *A
+    )
+{
+  if ( !A ) return;
+  free( A->amap );
+  ks_free_aligned( A->packA );
+  ks_free_aligned( A->packA2 );
+  ks_free_aligned( A->packAh );
+  free( A );
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  u[ umap * KS_RHS + p ] += K( A, XB[ changed_bmap ] ) delta_w,
+ *         the change of u after the weights of the n sources changed_bmap
+ *         changed by delta_w[ j * KS_RHS + p ], j = 0 ~ n - 1. A NULL umap
+ *         uses the amap of A.
+ *
+ *         The narrow-n path: packB, packB2 and packw are sized to n, and
+ *         the ic loop reads the cached packed targets of A directly.
+ * --------------------------------------------------------------------------
+ */
+void dgsks_delta(
+    ks_t   *kernel,
+    gsks_targets_t *A,
+    double *u,
+    int    *umap,
+    int    n,
+    double *XB,
+    double *XB2,
+    int    *changed_bmap,
+    double *delta_w
+    )
+{
+  int    i, j, ip, jp, ic, ib, jc, jb, jr;
+  int    m = A->m, k = A->k, nc, ks_ic_nt, pack_norm, pack_bandwidth;
+  int    *iota;
+  double *packB, *packB2, *packBh = NULL, *packw, *packu;
+
+  if ( m == 0 || n == 0 ) return;
+
+  if ( kernel->type != A->type ) {
+    printf( "dgsks_delta(): the targets were packed for another kernel type.\n" );
+    exit( 1 );
+  }
+
+  if ( !umap ) umap = A->amap;
+  iota = (int*)malloc( sizeof(int) * n );
+  for ( j = 0; j < n; j ++ ) iota[ j ] = j;
+
+  if ( !A->packA ) {
+    dgsks( kernel, m, n, k, u, umap, A->XA, A->XA2, A->amap,
+        XB, XB2, changed_bmap, delta_w, iota );
+    free( iota );
+    return;
+  }
+
+  dgsks_delta_setup( kernel, k, &pack_norm, &pack_bandwidth );
+  ks_ic_nt = ks_get_ic_nt();
+
+  nc     = ( ( min( n, DKS_NC ) - 1 ) / DKS_NR + 1 ) * DKS_PACK_NR;
+  packB  = ks_malloc_aligned(      k, ( nc + 1 ), sizeof(double) );
+  packB2 = ks_malloc_aligned(      1, ( nc + 1 ), sizeof(double) );
+  packw  = ks_malloc_aligned( KS_RHS, ( nc + 1 ), sizeof(double) );
+  packu  = ks_malloc_aligned( KS_RHS, ( DKS_PACK_MC + 1 ) * ks_ic_nt, sizeof(double) );
+  for ( j = 0; j < nc + 1; j ++ ) packB2[ j ] = 0.0;
+  if ( pack_bandwidth ) {
+    packBh = ks_malloc_aligned( 1, ( nc + 1 ), sizeof(double) );
+  }
+
+  for ( jc = 0; jc < n; jc += DKS_NC ) {              // 6-th loop
+    jb = min( n - jc, DKS_NC );
+
+    for ( j = 0, jp = 0; j < jb; j += DKS_NR, jp += DKS_PACK_NR ) {
+      packw_rhsxnc(
+          min( jb - j, DKS_NR ),
+          KS_RHS,
+          delta_w,
+          KS_RHS,
+          &iota[ jc + j ],
+          &packw[ jp * KS_RHS ]
+          );
+
+      for ( jr = 0; jr < min( jb - j, DKS_NR ); jr ++ ) {
+        if ( pack_norm ) {
+          packB2[ jp + jr ] = XB2[ changed_bmap[ jc + j + jr ] ];
+        }
+        if ( pack_bandwidth ) {
+          packBh[ jp + jr ] = kernel->hj[ changed_bmap[ jc + j + jr ] ];
+        }
+      }
+
+      packB_kcxnc(
+          min( jb - j, DKS_NR ),
+          k,
+          XB,
+          k,
+          &changed_bmap[ jc + j ],
+          &packB[ jp * k ]
+          );
+    }
+
+    #pragma omp parallel for num_threads( ks_ic_nt ) private( ib, i, ip )
+    for ( ic = 0; ic < m; ic += DKS_MC ) {            // 4-th loop
+      int    tid = omp_get_thread_num();
+      int    ap  = ( ic / DKS_MR ) * DKS_PACK_MR;
+
+      ib = min( m - ic, DKS_MC );
+
+      for ( i = 0, ip = 0; i < ib; i += DKS_MR, ip += DKS_PACK_MR ) {
+        packu_rhsxmc(
+            min( ib - i, DKS_MR ),
+            KS_RHS,
+            u,
+            KS_RHS,
+            &umap[ ic + i ],
+            &packu[ tid * DKS_PACK_MC * KS_RHS + ip * KS_RHS ]
+            );
+      }
+
+      dgsks_macro_kernel(                             // 1~3 loops
+          kernel,
+          ib,
+          jb,
+          k,
+          packu  + tid * DKS_PACK_MC * KS_RHS,
+          A->packA  + ap * k,
+          A->packA2 + ap,
+          A->packAh ? A->packAh + ap : NULL,
+          packB,
+          packB2,
+          packBh,
+          packw,
+          NULL,
+          0,
+          0
+          );
+
+      for ( i = 0, ip = 0; i < ib; i += DKS_MR, ip += DKS_PACK_MR ) {
+        unpacku_rhsxmc(
+            min( ib - i, DKS_MR ),
+            KS_RHS,
+            u,
+            KS_RHS,
+            &umap[ ic + i ],
+            &packu[ tid * DKS_PACK_MC * KS_RHS + ip * KS_RHS ]
+            );
+      }
+    }
+  }
+
+  ks_free_aligned( packB );
+  ks_free_aligned( packB2 );
+  ks_free_aligned( packBh );
+  ks_free_aligned( packw );
+  ks_free_aligned( packu );
+  free( iota );
+}
+
 /*
  *
  */ 
@@ -71,50 +71,36 @@ void sgemm(char*, char*, int*, int*, int*, float*, float*,
 
 
 
-/* 
+/*
  * --------------------------------------------------------------------------
- * @brief  This reference function will call GEMM, VEXP, GEMV.
- *
- * @param  *kernel This structure is used to specified the type of the kernel.
- * @param  m       Number of target points
- * @param  n       Number of source points
- * @param  k       Data point dimension
- * @param  *u      Potential vector
- * @param  *umap   Potential vector index map
- * @param  *XA     Target coordinate table [ k * nxa ]
- * @param  *XA2    Target square 2-norm table
- * @param  *alpha  Target points index map
- * @param  *XB     Source coordinate table [ k * nxb ]
- * @param  *XB2    Source square 2-norm table
- * @param  *beta   Source points index map
- * @param  *w      Weight vector
- * @param  *omega  Weight vector index map
+ * @brief  The kernel matrix part of dgsks_ref(): Cs = K( XA[ alpha ],
+ *         XB[ beta ] ), m x n column major, through GEMM + VEXP. As
+ *         ( m * k ) and Bs ( n * k ) are workspace of the caller, so
+ *         repeated blocks need no allocation.
  * --------------------------------------------------------------------------
  */
-void dgsks_ref(
+void dgsks_ref_block(
     ks_t   *kernel,
     int    m,
     int    n,
     int    k,
-    double *u,
-    int    *umap,
     double *XA,
     double *XA2,
     int    *alpha,
     double *XB,
     double *XB2,
     int    *beta,
-    double *w,
-    int    *omega
+    double *As,
+    double *Bs,
+    double *Cs
     )
 {
-  int    i, j, p, nrhs = KS_RHS;
-  double *As, *Bs, *Cs, *us, *ws, *hs, *powe;
-  double rank_k_scale, fone = 1.0, fzero = 0.0;
-  double beg, tcollect, tgemm, tgemv, tkernel;
+  int    i, j, p;
+  double *powe;
+  double rank_k_scale, fzero = 0.0;
+  double beg, tgemm, tkernel;
 
 
-  beg = omp_get_wtime();
   // ------------------------------------------------------------------------
   // Setup kernel dependent parameters
   // ------------------------------------------------------------------------
@@ -174,50 +160,25 @@ void dgsks_ref(
   // ------------------------------------------------------------------------
 
 
-  // ------------------------------------------------------------------------
-  // Allocate temporary buffers for BLAS calls.
-  // ------------------------------------------------------------------------
-  As = (double*)malloc( sizeof(double) * m * k );
-  Bs = (double*)malloc( sizeof(double) * n * k );
-  Cs = (double*)malloc( sizeof(double) * m * n );
-  us = (double*)malloc( sizeof(double) * m * KS_RHS );
-  ws = (double*)malloc( sizeof(double) * n * KS_RHS );
-  // ------------------------------------------------------------------------
-
-
 
   // ------------------------------------------------------------------------
-  // Collect As from XA, us from u
+  // Collect As from XA, Bs from XB
   // ------------------------------------------------------------------------
   #pragma omp parallel for private( p )
   for ( i = 0; i < m; i ++ ) {
     for ( p = 0; p < k; p ++ ) {
       As[ i * k + p ] = XA[ alpha[ i ] * k + p ];
     }
-    for ( p = 0; p < KS_RHS; p ++ ) {
-      us[ p * m + i ] = u[ umap[ i ] * KS_RHS + p ];
-    }
   }
-  // ------------------------------------------------------------------------
-
-
-  // ------------------------------------------------------------------------
-  // Collect Bs from XB, ws from w
-  // ------------------------------------------------------------------------
   #pragma omp parallel for private( p )
   for ( j = 0; j < n; j ++ ) {
     for ( p = 0; p < k; p ++ ) {
       Bs[ j * k + p ] = XB[ beta[ j ] * k + p ];
     }
-    for ( p = 0; p < KS_RHS; p ++ ) {
-      ws[ p * n + j ] = w[ omega[ j ] * KS_RHS + p ];
-    }    
   }
   // ------------------------------------------------------------------------
-  tcollect = omp_get_wtime() - beg;
 
 
-  
   beg = omp_get_wtime();
   // ------------------------------------------------------------------------
   // C = -2.0 * A^t * B (GEMM)
@@ -426,6 +387,129 @@ void dgsks_ref(
   tkernel = omp_get_wtime() - beg;
 
 
+  // ------------------------------------------------------------------------
+  // Free kernel dependent buffers
+  // ------------------------------------------------------------------------
+  switch ( kernel->type ) {
+    case KS_GAUSSIAN:
+      break;
+    case KS_GAUSSIAN_VAR_BANDWIDTH:
+      break;
+    case KS_POLYNOMIAL:
+#ifdef GSKS_MIC_AVX512
+      hbw_free( powe );
+#else
+      free( powe );
+#endif
+      break;
+    case KS_LAPLACE:
+#ifdef GSKS_MIC_AVX512
+      hbw_free( powe );
+#else
+      free( powe );
+#endif
+      break;
+    case KS_TANH:
+      break;
+    case KS_QUARTIC:
+      break;
+    case KS_MULTIQUADRATIC:
+      break;
+    case KS_EPANECHNIKOV:
+      break;
+    default:
+      printf( "Error dgsks_ref(): illegal kernel type\n" );
+      exit( 1 );
+  }
+  // ------------------------------------------------------------------------
+
+  //printf( "%5.3lf, %5.3lf\n", tgemm, tkernel );
+}
+
+
+
+/* 
+ * --------------------------------------------------------------------------
+ * @brief  This reference function will call GEMM, VEXP, GEMV.
+ *
+ * @param  *kernel This structure is used to specified the type of the kernel.
+ * @param  m       Number of target points
+ * @param  n       Number of source points
+ * @param  k       Data point dimension
+ * @param  *u      Potential vector
+ * @param  *umap   Potential vector index map
+ * @param  *XA     Target coordinate table [ k * nxa ]
+ * @param  *XA2    Target square 2-norm table
+ * @param  *alpha  Target points index map
+ * @param  *XB     Source coordinate table [ k * nxb ]
+ * @param  *XB2    Source square 2-norm table
+ * @param  *beta   Source points index map
+ * @param  *w      Weight vector
+ * @param  *omega  Weight vector index map
+ * --------------------------------------------------------------------------
+ */
+void dgsks_ref(
+    ks_t   *kernel,
+    int    m,
+    int    n,
+    int    k,
+    double *u,
+    int    *umap,
+    double *XA,
+    double *XA2,
+    int    *alpha,
+    double *XB,
+    double *XB2,
+    int    *beta,
+    double *w,
+    int    *omega
+    )
+{
+  int    i, j, p, nrhs = KS_RHS;
+  double *As, *Bs, *Cs, *us, *ws;
+  double fone = 1.0;
+  double beg, tcollect, tgemv;
+
+
+  beg = omp_get_wtime();
+  // ------------------------------------------------------------------------
+  // Allocate temporary buffers for BLAS calls.
+  // ------------------------------------------------------------------------
+  As = (double*)malloc( sizeof(double) * m * k );
+  Bs = (double*)malloc( sizeof(double) * n * k );
+  Cs = (double*)malloc( sizeof(double) * m * n );
+  us = (double*)malloc( sizeof(double) * m * KS_RHS );
+  ws = (double*)malloc( sizeof(double) * n * KS_RHS );
+  // ------------------------------------------------------------------------
+
+
+
+  // ------------------------------------------------------------------------
+  // Collect us from u, ws from w
+  // ------------------------------------------------------------------------
+  #pragma omp parallel for private( p )
+  for ( i = 0; i < m; i ++ ) {
+    for ( p = 0; p < KS_RHS; p ++ ) {
+      us[ p * m + i ] = u[ umap[ i ] * KS_RHS + p ];
+    }
+  }
+  #pragma omp parallel for private( p )
+  for ( j = 0; j < n; j ++ ) {
+    for ( p = 0; p < KS_RHS; p ++ ) {
+      ws[ p * n + j ] = w[ omega[ j ] * KS_RHS + p ];
+    }    
+  }
+  // ------------------------------------------------------------------------
+  tcollect = omp_get_wtime() - beg;
+
+
+  // ------------------------------------------------------------------------
+  // Kernel matrix ( GEMM, VEXP )
+  // ------------------------------------------------------------------------
+  dgsks_ref_block( kernel, m, n, k, XA, XA2, alpha, XB, XB2, beta, As, Bs, Cs );
+  // ------------------------------------------------------------------------
+
+
   beg = omp_get_wtime();
   // ------------------------------------------------------------------------
   // Kernel Summation
@@ -493,45 +577,9 @@ void dgsks_ref(
   // ------------------------------------------------------------------------
   
 
-  // ------------------------------------------------------------------------
-  // Free kernel dependent buffers
-  // ------------------------------------------------------------------------
-  switch ( kernel->type ) {
-    case KS_GAUSSIAN:
-      break;
-    case KS_GAUSSIAN_VAR_BANDWIDTH:
-      break;
-    case KS_POLYNOMIAL:
-#ifdef GSKS_MIC_AVX512
-      hbw_free( powe );
-#else
-      free( powe );
-#endif
-      break;
-    case KS_LAPLACE:
-#ifdef GSKS_MIC_AVX512
-      hbw_free( powe );
-#else
-      free( powe );
-#endif
-      break;
-    case KS_TANH:
-      break;
-    case KS_QUARTIC:
-      break;
-    case KS_MULTIQUADRATIC:
-      break;
-    case KS_EPANECHNIKOV:
-      break;
-    default:
-      printf( "Error dgsks_ref(): illegal kernel type\n" );
-      exit( 1 );
-  }
-  // ------------------------------------------------------------------------
   tcollect += ( omp_get_wtime() - beg );
 
-  //printf( "%5.3lf, %5.3lf, %5.3lf, %5.3lf, %5.3lf\n", 
-  //    tcollect, tgemm, tkernel, tgemv, tcollect + tgemm + tkernel + tgemv );
+  //printf( "%5.3lf, %5.3lf\n", tcollect, tgemv );
 }
 
 void dgsks_ref_wrapper(
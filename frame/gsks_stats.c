@@ -0,0 +1,196 @@
+/*
+ * --------------------------------------------------------------------------
+ * GSKS (General Stride Kernel Summation)
+ * --------------------------------------------------------------------------
+ * Copyright (C) 2015, The University of Texas at Austin
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ * gsks_stats.c
+ *
+ * Chenhan D. Yu - Department of Computer Science, 
+ *                 The University of Texas at Austin
+ *
+ *
+ * Purpose: 
+ * Per-thread counters behind gsks_stats_get(). Every thread that records
+ * something claims a cache line aligned slot on first use, so dgsks
+ * running inside omp_dgsks_list ( nested teams ) never shares a slot.
+ * Without GSKS_USE_STATS nothing is recorded and the getters return
+ * zeros.
+ *
+ *
+ * Todo:
+ *
+ *
+ * Modification:
+ *
+ *
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ks.h>
+#include <gsks_stats.h>
+
+#define GSKS_STATS_MAX_SLOT 512
+
+struct gsks_stats_slot_s {
+  gsks_stats_t stats;
+  char         pad[ 64 ];
+} __attribute__( ( aligned( 64 ) ) );
+
+static struct gsks_stats_slot_s gsks_stats_slot[ GSKS_STATS_MAX_SLOT ];
+static int gsks_stats_nslot = 0;
+
+
+
+#ifdef GSKS_USE_STATS
+static __thread gsks_stats_t *gsks_stats_mine = NULL;
+
+static gsks_stats_t *gsks_stats_local()
+{
+  int    slot;
+
+  if ( !gsks_stats_mine ) {
+    #pragma omp atomic capture
+    slot = gsks_stats_nslot ++;
+    // Threads beyond the table share the last slot ( counts may race ).
+    if ( slot >= GSKS_STATS_MAX_SLOT ) slot = GSKS_STATS_MAX_SLOT - 1;
+    gsks_stats_mine = &gsks_stats_slot[ slot ].stats;
+  }
+
+  return gsks_stats_mine;
+}
+
+
+void gsks_stats_add(
+    ks_phase_t phase,
+    unsigned long long cycles
+    )
+{
+  gsks_stats_t *st = gsks_stats_local();
+
+  st->cycles[ phase ] += cycles;
+  st->calls[ phase ] ++;
+}
+
+
+void gsks_stats_pack(
+    unsigned long long bytes_packA,
+    unsigned long long bytes_packB
+    )
+{
+  gsks_stats_t *st = gsks_stats_local();
+
+  st->bytes_packA += bytes_packA;
+  st->bytes_packB += bytes_packB;
+}
+
+
+void gsks_stats_tile(
+    int    useful,
+    int    lanes
+    )
+{
+  gsks_stats_t *st = gsks_stats_local();
+
+  st->tiles ++;
+  st->lanes += lanes;
+  if ( useful < lanes ) {
+    st->fringe_tiles ++;
+    st->lanes_wasted += lanes - useful;
+  }
+}
+#endif
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Sum of all threads. cycles_max holds the busiest thread of each
+ *         phase, so cycles / nthread against cycles_max shows imbalance.
+ *         Call it outside parallel regions; running threads may still be
+ *         updating their slots.
+ * --------------------------------------------------------------------------
+ */
+void gsks_stats_get(
+    gsks_stats_t *stats
+    )
+{
+  int    i, p, nslot;
+
+  memset( stats, 0, sizeof(gsks_stats_t) );
+
+  nslot = gsks_stats_nslot;
+  if ( nslot > GSKS_STATS_MAX_SLOT ) nslot = GSKS_STATS_MAX_SLOT;
+
+  for ( i = 0; i < nslot; i ++ ) {
+    gsks_stats_t *st = &gsks_stats_slot[ i ].stats;
+    int active = 0;
+
+    for ( p = 0; p < KS_PHASE_NUM; p ++ ) {
+      stats->cycles[ p ] += st->cycles[ p ];
+      stats->calls[ p ]  += st->calls[ p ];
+      if ( st->cycles[ p ] > stats->cycles_max[ p ] ) {
+        stats->cycles_max[ p ] = st->cycles[ p ];
+      }
+      if ( st->calls[ p ] ) active = 1;
+    }
+    stats->bytes_packA  += st->bytes_packA;
+    stats->bytes_packB  += st->bytes_packB;
+    stats->tiles        += st->tiles;
+    stats->fringe_tiles += st->fringe_tiles;
+    stats->lanes        += st->lanes;
+    stats->lanes_wasted += st->lanes_wasted;
+    stats->nthread      += active;
+  }
+}
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Counters of one slot ( 0 ~ nthread - 1, in order of first use ).
+ * --------------------------------------------------------------------------
+ */
+void gsks_stats_get_thread(
+    int    tid,
+    gsks_stats_t *stats
+    )
+{
+  memset( stats, 0, sizeof(gsks_stats_t) );
+
+  if ( tid < 0 || tid >= gsks_stats_nslot || tid >= GSKS_STATS_MAX_SLOT ) return;
+
+  *stats = gsks_stats_slot[ tid ].stats;
+  stats->nthread = 1;
+}
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Zero all counters. Threads keep their slots.
+ * --------------------------------------------------------------------------
+ */
+void gsks_stats_reset()
+{
+  int    i;
+
+  for ( i = 0; i < GSKS_STATS_MAX_SLOT; i ++ ) {
+    memset( &gsks_stats_slot[ i ].stats, 0, sizeof(gsks_stats_t) );
+  }
+}
@@ -0,0 +1,360 @@
+/*
+ * --------------------------------------------------------------------------
+ * GSKS (General Stride Kernel Summation)
+ * --------------------------------------------------------------------------
+ * Copyright (C) 2015, The University of Texas at Austin
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ * ks_cost.c
+ *
+ * Chenhan D. Yu - Department of Computer Science,
+ *                 The University of Texas at Austin
+ *
+ *
+ * Purpose:
+ * Time model of one dgsks() call, used to schedule omp_dgsks_list:
+ *
+ *   t( m, n, k ) = c0 + cpack * ( m + n ) * k
+ *                + mp * np * ( cflop * k + cpair ),
+ *
+ * where mp and np are m and n rounded up to DKS_MR and DKS_NR ( the
+ * micro-kernel computes the padding too ). cpack covers the gathers and
+ * packing, cflop the rank-k update and cpair the kernel evaluation and
+ * the weighted sum. The defaults follow the flop counts of test_dgsks.c at
+ * a nominal rate. ks_cost_fit() measures the machine; bench_dgsks.x --fit
+ * writes the coefficients in the format read from KS_COST_FILE:
+ *
+ *   # kernel c0 cpack cflop cpair ( seconds )
+ *   Gaussian 2.1E-06 1.3E-10 8.0E-11 1.6E-09
+ *
+ *
+ * Todo:
+ *
+ *
+ * Modification:
+ *
+ *
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+#include <ks.h>
+#include <gsks_config.h>
+
+#define KS_COST_RATE 1E+10      // nominal flops per second of the defaults
+#define KS_COST_MIN  1E-9       // least predicted seconds of a nonempty task
+
+static const char *ks_cost_names[ KS_NUM_KERNEL ] = {
+  "Gaussian",
+  "Polynomial",
+  "Laplace",
+  "Var_bandwidth",
+  "Tanh",
+  "Quartic",
+  "Multiquadratic",
+  "Epanechnikov"
+};
+
+// Kernel evaluation and weighted sum flops per pair, as in test_dgsks.c.
+static const double ks_cost_pair_flops[ KS_NUM_KERNEL ] = {
+  37.0, 6.0, 60.0, 35.0, 89.0, 8.0, 6.0, 7.0
+};
+
+static int       ks_cost_ready = 0;
+static ks_cost_t ks_cost_table[ KS_NUM_KERNEL ];
+
+
+
+const char *ks_cost_name(
+    ks_type type
+    )
+{
+  if ( (int)type < 0 || (int)type >= KS_NUM_KERNEL ) return "unknown";
+  return ks_cost_names[ type ];
+}
+
+
+
+static void ks_cost_default()
+{
+  int    i;
+
+  for ( i = 0; i < KS_NUM_KERNEL; i ++ ) {
+    ks_cost_table[ i ].c0    = 2E-6;
+    ks_cost_table[ i ].cpack = 4.0 / KS_COST_RATE;
+    ks_cost_table[ i ].cflop = 2.0 / KS_COST_RATE;
+    ks_cost_table[ i ].cpair = ks_cost_pair_flops[ i ] / KS_COST_RATE;
+  }
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Read coefficients from file. Lines name unknown kernels and
+ *         lines starting with # are skipped. Returns the number of
+ *         kernels updated, or -1 if the file cannot be opened.
+ * --------------------------------------------------------------------------
+ */
+static int ks_cost_read(
+    const char *file
+    )
+{
+  FILE   *fp;
+  char   line[ 256 ], name[ 64 ];
+  int    i, nread = 0;
+  ks_cost_t cost;
+
+  fp = fopen( file, "r" );
+  if ( !fp ) return -1;
+
+  while ( fgets( line, sizeof(line), fp ) ) {
+    if ( line[ 0 ] == '#' ) continue;
+    if ( sscanf( line, "%63s %lf %lf %lf %lf", name,
+          &cost.c0, &cost.cpack, &cost.cflop, &cost.cpair ) != 5 ) continue;
+    for ( i = 0; i < KS_NUM_KERNEL; i ++ ) {
+      if ( !strcmp( name, ks_cost_names[ i ] ) ) {
+        ks_cost_table[ i ] = cost;
+        nread ++;
+      }
+    }
+  }
+  fclose( fp );
+
+  return nread;
+}
+
+
+
+static void ks_cost_init()
+{
+  #pragma omp critical ( ks_cost_init )
+  {
+    if ( !ks_cost_ready ) {
+      char *str = getenv( "KS_COST_FILE" );
+      ks_cost_default();
+      if ( str != NULL && ks_cost_read( str ) < 0 ) {
+        printf( "ks_cost: cannot open KS_COST_FILE %s, using the defaults\n", str );
+      }
+      ks_cost_ready = 1;
+    }
+  }
+}
+
+
+
+int ks_cost_load(
+    const char *file
+    )
+{
+  int    nread;
+
+  ks_cost_init();
+  #pragma omp critical ( ks_cost_init )
+  {
+    nread = ks_cost_read( file );
+  }
+
+  return nread;
+}
+
+
+
+void ks_cost_get(
+    ks_type   type,
+    ks_cost_t *cost
+    )
+{
+  ks_cost_init();
+  *cost = ks_cost_table[ type ];
+}
+
+
+
+void ks_cost_set(
+    ks_type   type,
+    ks_cost_t *cost
+    )
+{
+  ks_cost_init();
+  ks_cost_table[ type ] = *cost;
+}
+
+
+
+double ks_cost_predict(
+    ks_t   *kernel,
+    int    m,
+    int    n,
+    int    k
+    )
+{
+  ks_cost_t *c;
+  double    mp, np, t;
+
+  if ( m <= 0 || n <= 0 ) return 0.0;
+
+  ks_cost_init();
+  c  = &ks_cost_table[ kernel->type ];
+  mp = (double)( ( m + DKS_MR - 1 ) / DKS_MR * DKS_MR );
+  np = (double)( ( n + DKS_NR - 1 ) / DKS_NR * DKS_NR );
+  t  = c->c0 + c->cpack * ( m + n ) * k + mp * np * ( c->cflop * k + c->cpair );
+
+  // Fitted coefficients can be negative; a task with work never costs 0.
+  return ( t > KS_COST_MIN ) ? t : KS_COST_MIN;
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Solve the dim x dim system A x = b in place ( partial pivoting ).
+ *         Returns 0 if A is singular.
+ * --------------------------------------------------------------------------
+ */
+static int ks_cost_solve(
+    int    dim,
+    double A[ 4 ][ 4 ],
+    double b[ 4 ]
+    )
+{
+  int    i, j, p, piv;
+  double tmp;
+
+  for ( p = 0; p < dim; p ++ ) {
+    piv = p;
+    for ( i = p + 1; i < dim; i ++ ) {
+      if ( fabs( A[ i ][ p ] ) > fabs( A[ piv ][ p ] ) ) piv = i;
+    }
+    if ( A[ piv ][ p ] == 0.0 ) return 0;
+    for ( j = 0; j < dim; j ++ ) {
+      tmp = A[ p ][ j ]; A[ p ][ j ] = A[ piv ][ j ]; A[ piv ][ j ] = tmp;
+    }
+    tmp = b[ p ]; b[ p ] = b[ piv ]; b[ piv ] = tmp;
+    for ( i = p + 1; i < dim; i ++ ) {
+      tmp = A[ i ][ p ] / A[ p ][ p ];
+      for ( j = p; j < dim; j ++ ) A[ i ][ j ] -= tmp * A[ p ][ j ];
+      b[ i ] -= tmp * b[ p ];
+    }
+  }
+  for ( p = dim - 1; p >= 0; p -- ) {
+    for ( j = p + 1; j < dim; j ++ ) b[ p ] -= A[ p ][ j ] * b[ j ];
+    b[ p ] /= A[ p ][ p ];
+  }
+
+  return 1;
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Fit the coefficients of kernel->type by timing dgsks() on a grid
+ *         of m, n and the nk dimensions in klist ( best of 3 per shape ),
+ *         minimizing the relative error. With a single k the rank-k term
+ *         cannot be told apart from the kernel term and is folded into
+ *         cpair. Negative coefficients are clamped to zero. Variable
+ *         bandwidth kernels need kernel->hi and hj of length 1024.
+ * --------------------------------------------------------------------------
+ */
+void ks_cost_fit(
+    ks_t   *kernel,
+    int    nk,
+    int    *klist,
+    ks_cost_t *cost
+    )
+{
+  const int mlist[ 3 ] = { 40, 250, 1000 };
+  int    i, j, q, r, p, kmax = 0, dim = ( nk > 1 ) ? 4 : 3;
+  int    *map;
+  double *X, *X2, *u, *w, beg, t, best;
+  double A[ 4 ][ 4 ], b[ 4 ], x[ 4 ], mp, np;
+
+  for ( q = 0; q < nk; q ++ ) if ( klist[ q ] > kmax ) kmax = klist[ q ];
+
+  map = (int*)malloc( sizeof(int) * 1024 );
+  X   = (double*)malloc( sizeof(double) * 1024 * kmax );
+  X2  = (double*)malloc( sizeof(double) * 1024 );
+  u   = (double*)malloc( sizeof(double) * 1024 * KS_RHS );
+  w   = (double*)malloc( sizeof(double) * 1024 * KS_RHS );
+
+  for ( i = 0; i < 1024; i ++ ) {
+    map[ i ] = i;
+    for ( p = 0; p < kmax; p ++ ) X[ i * kmax + p ] = (double)rand() / RAND_MAX;
+    for ( p = 0; p < KS_RHS; p ++ ) {
+      u[ i * KS_RHS + p ] = 0.0;
+      w[ i * KS_RHS + p ] = 1.0;
+    }
+  }
+
+  memset( A, 0, sizeof(A) );
+  memset( b, 0, sizeof(b) );
+
+  for ( q = 0; q < nk; q ++ ) {
+    int k = klist[ q ];
+
+    // Reinterpret the table with leading dimension k.
+    for ( i = 0; i < 1024; i ++ ) {
+      X2[ i ] = 0.0;
+      for ( p = 0; p < k; p ++ ) X2[ i ] += X[ i * k + p ] * X[ i * k + p ];
+    }
+
+    for ( i = 0; i < 3; i ++ ) {
+      for ( j = 0; j < 3; j ++ ) {
+        best = 0.0;
+        for ( r = -1; r < 3; r ++ ) {
+          beg = omp_get_wtime();
+          dgsks( kernel, mlist[ i ], mlist[ j ], k,
+              u, map, X, X2, map, X, X2, map, w, map );
+          t = omp_get_wtime() - beg;
+          if ( r >= 0 && ( best == 0.0 || t < best ) ) best = t;
+        }
+
+        mp = (double)( ( mlist[ i ] + DKS_MR - 1 ) / DKS_MR * DKS_MR );
+        np = (double)( ( mlist[ j ] + DKS_NR - 1 ) / DKS_NR * DKS_NR );
+
+        // Rows scaled by 1 / t, so that small calls weigh as much as
+        // large ones.
+        x[ 0 ] = 1.0;
+        x[ 1 ] = (double)( mlist[ i ] + mlist[ j ] ) * k;
+        x[ 2 ] = mp * np;
+        x[ 3 ] = mp * np * k;
+        for ( r = 0; r < dim; r ++ ) {
+          for ( p = 0; p < dim; p ++ ) A[ r ][ p ] += x[ r ] * x[ p ] / ( best * best );
+          b[ r ] += x[ r ] / best;
+        }
+      }
+    }
+  }
+
+  ks_cost_get( kernel->type, cost );
+  if ( ks_cost_solve( dim, A, b ) ) {
+    cost->c0    = b[ 0 ] > 0.0 ? b[ 0 ] : 0.0;
+    cost->cpack = b[ 1 ] > 0.0 ? b[ 1 ] : 0.0;
+    cost->cpair = b[ 2 ] > 0.0 ? b[ 2 ] : 0.0;
+    cost->cflop = ( dim > 3 && b[ 3 ] > 0.0 ) ? b[ 3 ] : 0.0;
+  }
+
+  free( map );
+  free( X );
+  free( X2 );
+  free( u );
+  free( w );
+}
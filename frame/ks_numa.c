@@ -0,0 +1,285 @@
+/*
+ * --------------------------------------------------------------------------
+ * GSKS (General Stride Kernel Summation)
+ * --------------------------------------------------------------------------
+ * Copyright (C) 2015, The University of Texas at Austin
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ * ks_numa.c
+ *
+ * Chenhan D. Yu - Department of Computer Science, 
+ *                 The University of Texas at Austin
+ *
+ *
+ * Purpose: 
+ * NUMA topology used by dgsks to give every node its own copy of packB.
+ * The cpu to node map is read from libnuma when compiled with
+ * GSKS_USE_NUMA, otherwise from /sys/devices/system/node. Node ids are
+ * renumbered to 0 ~ ks_numa_num_nodes() - 1.
+ *
+ *
+ * Todo:
+ *
+ *
+ * Modification:
+ *
+ *
+ * */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <ks.h>
+
+#ifdef GSKS_USE_NUMA
+#include <numa.h>
+#endif
+
+#define KS_NUMA_MAX_CPU 4096
+#define KS_NUMA_MAX_ID  1024
+
+static int ks_numa_ready = 0;
+static int ks_numa_nnode = 1;
+static int ks_numa_osid[ KS_NUMA_MAX_NODE ];
+static int ks_numa_cpu2node[ KS_NUMA_MAX_CPU ];
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Parse a sysfs cpulist ( e.g. "0-15,32-47" ) and assign all listed
+ *         cpus to node.
+ * --------------------------------------------------------------------------
+ */
+static void ks_numa_parse_cpulist(
+    char   *str,
+    int    node
+    )
+{
+  char   *end;
+  int    beg, last, cpu;
+
+  while ( *str && *str != '\n' ) {
+    beg  = (int)strtol( str, &end, 10 );
+    if ( end == str ) break;
+    last = beg;
+    str  = end;
+    if ( *str == '-' ) {
+      last = (int)strtol( str + 1, &end, 10 );
+      str  = end;
+    }
+    for ( cpu = beg; cpu <= last && cpu < KS_NUMA_MAX_CPU; cpu ++ ) {
+      if ( cpu >= 0 ) ks_numa_cpu2node[ cpu ] = node;
+    }
+    if ( *str == ',' ) str ++;
+  }
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Build the cpu to node map once. Cpus that do not show up in any
+ *         node ( or a machine without NUMA information ) map to node 0.
+ * --------------------------------------------------------------------------
+ */
+static void ks_numa_init()
+{
+  int    id, cpu, nnode = 0;
+
+  for ( cpu = 0; cpu < KS_NUMA_MAX_CPU; cpu ++ ) ks_numa_cpu2node[ cpu ] = 0;
+
+#ifdef GSKS_USE_NUMA
+  if ( numa_available() >= 0 ) {
+    int ncpu = numa_num_configured_cpus();
+    int maxid = numa_max_node();
+    int node_of_id[ KS_NUMA_MAX_ID ];
+
+    for ( id = 0; id <= maxid && id < KS_NUMA_MAX_ID; id ++ ) {
+      node_of_id[ id ] = -1;
+      if ( numa_bitmask_isbitset( numa_all_nodes_ptr, id ) && nnode < KS_NUMA_MAX_NODE ) {
+        ks_numa_osid[ nnode ] = id;
+        node_of_id[ id ] = nnode ++;
+      }
+    }
+    for ( cpu = 0; cpu < ncpu && cpu < KS_NUMA_MAX_CPU; cpu ++ ) {
+      id = numa_node_of_cpu( cpu );
+      if ( id >= 0 && id < KS_NUMA_MAX_ID && node_of_id[ id ] >= 0 ) {
+        ks_numa_cpu2node[ cpu ] = node_of_id[ id ];
+      }
+    }
+  }
+#endif
+
+  if ( nnode == 0 ) {
+    char   path[ 64 ], buf[ 4096 ];
+    FILE   *fp;
+
+    for ( id = 0; id < KS_NUMA_MAX_ID && nnode < KS_NUMA_MAX_NODE; id ++ ) {
+      sprintf( path, "/sys/devices/system/node/node%d/cpulist", id );
+      fp = fopen( path, "r" );
+      if ( !fp ) continue;
+      if ( fgets( buf, sizeof(buf), fp ) && buf[ 0 ] != '\n' ) {
+        ks_numa_osid[ nnode ] = id;
+        ks_numa_parse_cpulist( buf, nnode ++ );
+      }
+      fclose( fp );
+    }
+  }
+
+  if ( nnode == 0 ) {
+    ks_numa_osid[ 0 ] = 0;
+    nnode = 1;
+  }
+
+  ks_numa_nnode = nnode;
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Number of NUMA nodes that own at least one cpu.
+ * --------------------------------------------------------------------------
+ */
+int ks_numa_num_nodes()
+{
+  if ( !__atomic_load_n( &ks_numa_ready, __ATOMIC_ACQUIRE ) ) {
+    #pragma omp critical ( ks_numa_init )
+    {
+      if ( !ks_numa_ready ) {
+        ks_numa_init();
+        __atomic_store_n( &ks_numa_ready, 1, __ATOMIC_RELEASE );
+      }
+    }
+  }
+
+  return ks_numa_nnode;
+}
+
+
+
+int ks_numa_node_of_cpu(
+    int    cpu
+    )
+{
+  ks_numa_num_nodes();
+
+  if ( cpu < 0 || cpu >= KS_NUMA_MAX_CPU ) return 0;
+
+  return ks_numa_cpu2node[ cpu ];
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Node of the cpu the calling thread runs on. This is only stable
+ *         if the threads are bound ( e.g. OMP_PROC_BIND=close ).
+ * --------------------------------------------------------------------------
+ */
+int ks_numa_local_node()
+{
+  return ks_numa_node_of_cpu( sched_getcpu() );
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Ask for the pages of [ ptr, ptr + bytes ) to be placed on node.
+ *         Only the pages that lie entirely inside the buffer are bound,
+ *         so a heap buffer never moves its neighbours; the partial pages
+ *         at both ends ( and everything without libnuma ) rely on first
+ *         touch, so the buffer must be written by threads of that node.
+ * --------------------------------------------------------------------------
+ */
+void ks_numa_bind(
+    void   *ptr,
+    size_t bytes,
+    int    node
+    )
+{
+#ifdef GSKS_USE_NUMA
+  size_t page = (size_t)sysconf( _SC_PAGESIZE );
+  size_t beg  = ( (size_t)ptr + page - 1 ) & ~( page - 1 );
+  size_t end  = ( (size_t)ptr + bytes ) & ~( page - 1 );
+
+  if ( numa_available() >= 0 && node >= 0 && node < ks_numa_num_nodes() && end > beg ) {
+    numa_tonode_memory( (void*)beg, end - beg, ks_numa_osid[ node ] );
+  }
+#else
+  (void)ptr;
+  (void)bytes;
+  (void)node;
+#endif
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Id of the last level cache of cpu: the lowest cpu in the
+ *         shared_cpu_list of its highest level cache, from
+ *         /sys/devices/system/cpu. Returns -1 if the cache topology is
+ *         not available.
+ * --------------------------------------------------------------------------
+ */
+int ks_numa_llc_of_cpu(
+    int    cpu
+    )
+{
+  char   path[ 96 ], buf[ 4096 ], *str, *end;
+  int    idx, level, maxlevel = 0, beg, first = -1;
+  FILE   *fp;
+
+  for ( idx = 0; idx < 16; idx ++ ) {
+    sprintf( path, "/sys/devices/system/cpu/cpu%d/cache/index%d/level", cpu, idx );
+    fp = fopen( path, "r" );
+    if ( !fp ) continue;
+    level = 0;
+    if ( fscanf( fp, "%d", &level ) != 1 ) level = 0;
+    fclose( fp );
+    if ( level <= maxlevel ) continue;
+
+    sprintf( path, "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list", cpu, idx );
+    fp = fopen( path, "r" );
+    if ( !fp ) continue;
+    if ( fgets( buf, sizeof(buf), fp ) ) {
+      maxlevel = level;
+      first    = -1;
+      for ( str = buf; *str && *str != '\n'; ) {
+        beg = (int)strtol( str, &end, 10 );
+        if ( end == str ) break;
+        str = end;
+        if ( first < 0 || beg < first ) first = beg;
+        if ( *str == '-' ) {
+          strtol( str + 1, &end, 10 );
+          str = end;
+        }
+        if ( *str == ',' ) str ++;
+      }
+    }
+    fclose( fp );
+  }
+
+  return first;
+}
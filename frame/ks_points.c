@@ -0,0 +1,236 @@
+/*
+ * --------------------------------------------------------------------------
+ * GSKS (General Stride Kernel Summation)
+ * --------------------------------------------------------------------------
+ * Copyright (C) 2015, The University of Texas at Austin
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ * ks_points.c
+ *
+ * Chenhan D. Yu - Department of Computer Science,
+ *                 The University of Texas at Austin
+ *
+ *
+ * Purpose:
+ * Dataset handle for repeated kernel summations over the same points.
+ * The handle keeps the square 2-norms X2 and, if bandwidths are given,
+ * the variable bandwidth factors -1 / ( 2 h^2 ) used as kernel->hi and
+ * kernel->hj. Both are computed per point on first use and reused by
+ * later calls, so a list call only pays for the points its lists touch,
+ * and an iterative solver pays once.
+ *
+ * Each point has a state: KS_POINT_NONE, KS_POINT_BUSY while a thread
+ * computes it, and KS_POINT_READY. The first thread to claim a point
+ * computes it; others wait for it, so concurrent calls on one handle
+ * are safe.
+ *
+ *
+ * Todo:
+ *
+ *
+ * Modification:
+ *
+ *
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <ks.h>
+
+#define KS_POINT_NONE  0
+#define KS_POINT_BUSY  1
+#define KS_POINT_READY 2
+
+
+
+gsks_points_t *gsks_points_create(
+    int    n,
+    int    k,
+    double *X,
+    int    copy
+    )
+{
+  gsks_points_t *pts;
+
+  pts = (gsks_points_t*)malloc( sizeof(gsks_points_t) );
+  pts->n     = n;
+  pts->k     = k;
+  pts->own   = copy;
+  pts->h     = NULL;
+  pts->hfac  = NULL;
+
+  if ( copy ) {
+    pts->X = ks_malloc_aligned( k, n, sizeof(double) );
+    memcpy( pts->X, X, sizeof(double) * n * k );
+  }
+  else {
+    pts->X = X;
+  }
+
+  pts->X2    = ks_malloc_aligned( 1, n, sizeof(double) );
+  pts->state = (unsigned char*)calloc( n, sizeof(unsigned char) );
+
+  return pts;
+}
+
+
+
+void gsks_points_free(
+    gsks_points_t *pts
+    )
+{
+  if ( !pts ) return;
+  if ( pts->own ) ks_free_aligned( pts->X );
+  ks_free_aligned( pts->X2 );
+  free( pts->h );
+  ks_free_aligned( pts->hfac );
+  free( pts->state );
+  free( pts );
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Copy n bandwidths. The factors are recomputed on demand. h may
+ *         be NULL to drop them.
+ * --------------------------------------------------------------------------
+ */
+void gsks_points_set_bandwidth(
+    gsks_points_t *pts,
+    double *h
+    )
+{
+  free( pts->h );
+  ks_free_aligned( pts->hfac );
+  pts->h    = NULL;
+  pts->hfac = NULL;
+
+  if ( h ) {
+    pts->h    = (double*)malloc( sizeof(double) * pts->n );
+    pts->hfac = ks_malloc_aligned( 1, pts->n, sizeof(double) );
+    memcpy( pts->h, h, sizeof(double) * pts->n );
+  }
+  memset( pts->state, KS_POINT_NONE, pts->n );
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Points beg ~ end - 1 have new coordinates or bandwidths ( written
+ *         through pts->X and pts->h ). Not safe against concurrent calls
+ *         on the same handle.
+ * --------------------------------------------------------------------------
+ */
+void gsks_points_modified(
+    gsks_points_t *pts,
+    int    beg,
+    int    end
+    )
+{
+  if ( beg < 0 ) beg = 0;
+  if ( end > pts->n ) end = pts->n;
+  if ( end > beg ) memset( pts->state + beg, KS_POINT_NONE, end - beg );
+}
+
+
+
+static inline void gsks_points_compute(
+    gsks_points_t *pts,
+    int    i
+    )
+{
+  unsigned char expect = KS_POINT_NONE;
+  int    p, k = pts->k;
+  double tmp = 0.0, *x = pts->X + (size_t)i * k;
+
+  if ( __atomic_load_n( &pts->state[ i ], __ATOMIC_ACQUIRE ) == KS_POINT_READY ) return;
+
+  if ( __atomic_compare_exchange_n( &pts->state[ i ], &expect, KS_POINT_BUSY, 0,
+        __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE ) ) {
+    for ( p = 0; p < k; p ++ ) tmp += x[ p ] * x[ p ];
+    pts->X2[ i ] = tmp;
+    if ( pts->hfac ) {
+      pts->hfac[ i ] = -1.0 / ( 2.0 * pts->h[ i ] * pts->h[ i ] );
+    }
+    __atomic_store_n( &pts->state[ i ], KS_POINT_READY, __ATOMIC_RELEASE );
+  }
+  else {
+    while ( __atomic_load_n( &pts->state[ i ], __ATOMIC_ACQUIRE ) != KS_POINT_READY ) {
+      sched_yield();
+    }
+  }
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Make the cached values of the nidx points in idx ready. Thread
+ *         safe; threads may pass overlapping index sets.
+ * --------------------------------------------------------------------------
+ */
+void gsks_points_require(
+    gsks_points_t *pts,
+    int    nidx,
+    const int *idx
+    )
+{
+  int    i;
+
+  for ( i = 0; i < nidx; i ++ ) gsks_points_compute( pts, idx[ i ] );
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Square 2-norms of all points, computed where missing.
+ * --------------------------------------------------------------------------
+ */
+double *gsks_points_norms(
+    gsks_points_t *pts
+    )
+{
+  int    i;
+
+  #pragma omp parallel for
+  for ( i = 0; i < pts->n; i ++ ) gsks_points_compute( pts, i );
+
+  return pts->X2;
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Bandwidth factors -1 / ( 2 h^2 ) of all points, or NULL if no
+ *         bandwidths were set.
+ * --------------------------------------------------------------------------
+ */
+double *gsks_points_bandwidth(
+    gsks_points_t *pts
+    )
+{
+  if ( !pts->hfac ) return NULL;
+  gsks_points_norms( pts );
+
+  return pts->hfac;
+}
@@ -0,0 +1,351 @@
+/*
+ * --------------------------------------------------------------------------
+ * GSKS (General Stride Kernel Summation)
+ * --------------------------------------------------------------------------
+ * Copyright (C) 2015, The University of Texas at Austin
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ * ks_pool.c
+ *
+ * Chenhan D. Yu - Department of Computer Science,
+ *                 The University of Texas at Austin
+ *
+ *
+ * Purpose:
+ * Persistent worker pool ( see ks_pool.h ). Every worker has a mailbox
+ * on its own cache line; ks_pool_run() fills the mailboxes of workers
+ * 1 ~ nt - 1 and bumps their generation, so workers outside the run are
+ * not disturbed. A worker polls its generation KS_POOL_SPIN times
+ * ( default 16384 ) before it sleeps on its condition variable. Waits
+ * inside a run ( ks_pool_relax() ) poll, then yield the core. Runs
+ * with more threads than cpus in the affinity mask poll only
+ * KS_POOL_SPIN_THROTTLED times, since the thread they wait for may not
+ * be running.
+ *
+ * KS_POOL_BIND=0 leaves the workers unpinned; otherwise worker t runs on
+ * the t-th cpu of the process affinity mask ( modulo its size ).
+ *
+ *
+ * Todo:
+ *
+ *
+ * Modification:
+ *
+ *
+ * */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <ks.h>
+#include <ks_pool.h>
+
+#define KS_POOL_SPIN_THROTTLED 64
+
+struct ks_pool_box_s {
+  long            gen;
+  ks_pool_fn      fn;
+  void            *arg;
+  int             nt;
+  int             sleeping;
+  pthread_mutex_t lock;
+  pthread_cond_t  wake;
+} __attribute__(( aligned( 64 ) ));
+
+typedef struct ks_pool_box_s ks_pool_box_t;
+
+static ks_pool_box_t ks_pool_box[ KS_POOL_MAX_THREAD ];
+static pthread_t     ks_pool_thread[ KS_POOL_MAX_THREAD ];
+
+static pthread_once_t ks_pool_once = PTHREAD_ONCE_INIT;
+static int  ks_pool_off = 0;
+static int  ks_pool_bind = 1;
+static int  ks_pool_spin = 16384;
+static int  ks_pool_poll = 16384;     // spin of the current run
+static int  ks_pool_ncpu = 0;
+static int  *ks_pool_cpu = NULL;
+static int  *ks_pool_node = NULL;     // NUMA node of ks_pool_cpu
+static int  *ks_pool_llc = NULL;      // last level cache of ks_pool_cpu
+static int  ks_pool_llc_known = 0;
+static int  ks_pool_nworker = 0;      // workers 1 ~ ks_pool_nworker exist
+
+static int  ks_pool_busy = 0;
+static int  ks_pool_ndone  __attribute__(( aligned( 64 ) )) = 0;
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  One poll of a wait loop: pause while polls < the spin of the
+ *         current run, yield the core after that.
+ * --------------------------------------------------------------------------
+ */
+void ks_pool_relax(
+    int    *polls
+    )
+{
+  if ( ++ ( *polls ) < ks_pool_poll ) {
+#if defined( __x86_64__ ) || defined( __i386__ )
+    __builtin_ia32_pause();
+#endif
+  }
+  else {
+    sched_yield();
+  }
+}
+
+
+
+/*
+ * Workers are pinned in the order of ks_pool_cpu: the cpus of the
+ * affinity mask sorted by NUMA node, then last level cache, so that
+ * consecutive workers share both whenever they can ( see ks_pool_node_of
+ * and ks_pool_llc_of ).
+ */
+static void ks_pool_init()
+{
+  char   *str;
+  int    c, i, cpu, node, llc;
+  cpu_set_t mask;
+
+  str = getenv( "KS_POOL" );
+  if ( str != NULL && !(int)strtol( str, NULL, 10 ) ) ks_pool_off = 1;
+  str = getenv( "KS_POOL_BIND" );
+  if ( str != NULL ) ks_pool_bind = (int)strtol( str, NULL, 10 );
+  str = getenv( "KS_POOL_SPIN" );
+  if ( str != NULL ) ks_pool_spin = (int)strtol( str, NULL, 10 );
+
+  ks_pool_cpu = (int*)malloc( sizeof(int) * CPU_SETSIZE );
+  CPU_ZERO( &mask );
+  if ( sched_getaffinity( 0, sizeof(mask), &mask ) == 0 ) {
+    for ( c = 0; c < CPU_SETSIZE; c ++ ) {
+      if ( CPU_ISSET( c, &mask ) ) ks_pool_cpu[ ks_pool_ncpu ++ ] = c;
+    }
+  }
+  if ( ks_pool_ncpu == 0 ) ks_pool_bind = 0;
+
+  if ( ks_pool_bind ) {
+    ks_pool_node = (int*)malloc( sizeof(int) * ks_pool_ncpu );
+    ks_pool_llc  = (int*)malloc( sizeof(int) * ks_pool_ncpu );
+    ks_pool_llc_known = 1;
+    for ( c = 0; c < ks_pool_ncpu; c ++ ) {
+      if ( ks_numa_llc_of_cpu( ks_pool_cpu[ c ] ) < 0 ) ks_pool_llc_known = 0;
+    }
+    for ( c = 0; c < ks_pool_ncpu; c ++ ) {
+      cpu  = ks_pool_cpu[ c ];
+      node = ks_numa_node_of_cpu( cpu );
+      llc  = ks_pool_llc_known ? ks_numa_llc_of_cpu( cpu ) : -1;
+      for ( i = c; i > 0; i -- ) {
+        if ( ks_pool_node[ i - 1 ] < node ) break;
+        if ( ks_pool_node[ i - 1 ] == node && ks_pool_llc[ i - 1 ] < llc ) break;
+        if ( ks_pool_node[ i - 1 ] == node && ks_pool_llc[ i - 1 ] == llc &&
+             ks_pool_cpu[ i - 1 ] < cpu ) break;
+        ks_pool_cpu[ i ]  = ks_pool_cpu[ i - 1 ];
+        ks_pool_node[ i ] = ks_pool_node[ i - 1 ];
+        ks_pool_llc[ i ]  = ks_pool_llc[ i - 1 ];
+      }
+      ks_pool_cpu[ i ]  = cpu;
+      ks_pool_node[ i ] = node;
+      ks_pool_llc[ i ]  = llc;
+    }
+  }
+}
+
+
+
+static void *ks_pool_worker(
+    void   *arg
+    )
+{
+  int           tid = (int)(long)arg;
+  ks_pool_box_t *box = &ks_pool_box[ tid ];
+  long          seen = 0, gen;
+
+  while ( 1 ) {
+    int    polls = 0;
+
+    while ( ( gen = __atomic_load_n( &box->gen, __ATOMIC_ACQUIRE ) ) == seen &&
+        polls < ks_pool_poll ) {
+      ks_pool_relax( &polls );
+    }
+    if ( gen == seen ) {
+      pthread_mutex_lock( &box->lock );
+      box->sleeping = 1;
+      while ( ( gen = __atomic_load_n( &box->gen, __ATOMIC_ACQUIRE ) ) == seen ) {
+        pthread_cond_wait( &box->wake, &box->lock );
+      }
+      box->sleeping = 0;
+      pthread_mutex_unlock( &box->lock );
+    }
+    seen = gen;
+
+    box->fn( tid, box->nt, box->arg );
+    __atomic_add_fetch( &ks_pool_ndone, 1, __ATOMIC_RELEASE );
+  }
+
+  return NULL;
+}
+
+
+
+static void ks_pool_spawn(
+    int    nt
+    )
+{
+  int    t;
+
+  for ( t = ks_pool_nworker + 1; t < nt; t ++ ) {
+    ks_pool_box_t *box = &ks_pool_box[ t ];
+
+    box->gen      = 0;
+    box->sleeping = 0;
+    pthread_mutex_init( &box->lock, NULL );
+    pthread_cond_init( &box->wake, NULL );
+
+    if ( pthread_create( &ks_pool_thread[ t ], NULL, ks_pool_worker, (void*)(long)t ) ) {
+      break;
+    }
+    pthread_detach( ks_pool_thread[ t ] );
+
+    if ( ks_pool_bind ) {
+      cpu_set_t mask;
+      CPU_ZERO( &mask );
+      CPU_SET( ks_pool_cpu[ t % ks_pool_ncpu ], &mask );
+      pthread_setaffinity_np( ks_pool_thread[ t ], sizeof(mask), &mask );
+    }
+    ks_pool_nworker = t;
+  }
+}
+
+
+
+int ks_pool_run(
+    int        nt,
+    ks_pool_fn fn,
+    void       *arg
+    )
+{
+  int    t, expect = 0, polls = 0;
+
+  if ( nt > KS_POOL_MAX_THREAD ) return 0;
+  if ( !__atomic_compare_exchange_n( &ks_pool_busy, &expect, 1, 0,
+        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED ) ) {
+    return 0;
+  }
+
+  pthread_once( &ks_pool_once, ks_pool_init );
+  if ( ks_pool_off ) {
+    __atomic_store_n( &ks_pool_busy, 0, __ATOMIC_RELEASE );
+    return 0;
+  }
+
+  // Callers size their work by nt; a short pool sends them to OpenMP.
+  ks_pool_spawn( nt );
+  if ( ks_pool_nworker < nt - 1 ) {
+    __atomic_store_n( &ks_pool_busy, 0, __ATOMIC_RELEASE );
+    return 0;
+  }
+  ks_pool_poll = ( ks_pool_ncpu > 0 && nt > ks_pool_ncpu ) ?
+    KS_POOL_SPIN_THROTTLED : ks_pool_spin;
+
+  ks_pool_ndone = 0;
+  for ( t = 1; t < nt; t ++ ) {
+    ks_pool_box_t *box = &ks_pool_box[ t ];
+
+    box->fn  = fn;
+    box->arg = arg;
+    box->nt  = nt;
+    pthread_mutex_lock( &box->lock );
+    __atomic_add_fetch( &box->gen, 1, __ATOMIC_RELEASE );
+    if ( box->sleeping ) pthread_cond_signal( &box->wake );
+    pthread_mutex_unlock( &box->lock );
+  }
+
+  fn( 0, nt, arg );
+
+  while ( __atomic_load_n( &ks_pool_ndone, __ATOMIC_ACQUIRE ) < nt - 1 ) {
+    ks_pool_relax( &polls );
+  }
+
+  __atomic_store_n( &ks_pool_busy, 0, __ATOMIC_RELEASE );
+
+  return 1;
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Last level cache ( ks_numa_llc_of_cpu ) of the cpu that pool
+ *         thread tid runs on, or -1 if the workers are not pinned or the
+ *         cache topology is unknown. The caller ( tid 0 ) is not pinned
+ *         and is counted on the first cpu.
+ * --------------------------------------------------------------------------
+ */
+int ks_pool_llc_of(
+    int    tid
+    )
+{
+  pthread_once( &ks_pool_once, ks_pool_init );
+  if ( !ks_pool_llc_known ) return -1;
+
+  return ks_pool_llc[ tid % ks_pool_ncpu ];
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  NUMA node ( ks_numa_node_of_cpu ) of the cpu that pool thread
+ *         tid runs on, or -1 if the workers are not pinned.
+ * --------------------------------------------------------------------------
+ */
+int ks_pool_node_of(
+    int    tid
+    )
+{
+  pthread_once( &ks_pool_once, ks_pool_init );
+  if ( !ks_pool_node ) return -1;
+
+  return ks_pool_node[ tid % ks_pool_ncpu ];
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Pin the calling thread to the cpu of pool thread tid, for
+ *         threads that live outside the pool ( e.g. gsks_queue_t
+ *         workers ). Does nothing with KS_POOL_BIND=0.
+ * --------------------------------------------------------------------------
+ */
+void ks_pool_pin(
+    int    tid
+    )
+{
+  cpu_set_t mask;
+
+  pthread_once( &ks_pool_once, ks_pool_init );
+  if ( !ks_pool_bind ) return;
+
+  CPU_ZERO( &mask );
+  CPU_SET( ks_pool_cpu[ tid % ks_pool_ncpu ], &mask );
+  pthread_setaffinity_np( pthread_self(), sizeof(mask), &mask );
+}
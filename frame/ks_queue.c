@@ -0,0 +1,374 @@
+/*
+ * --------------------------------------------------------------------------
+ * GSKS (General Stride Kernel Summation)
+ * --------------------------------------------------------------------------
+ * Copyright (C) 2015, The University of Texas at Austin
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ * ks_queue.c
+ *
+ * Chenhan D. Yu - Department of Computer Science,
+ *                 The University of Texas at Austin
+ *
+ *
+ * Purpose:
+ * Asynchronous kernel summation. A queue owns a pool of worker threads
+ * that live until gsks_queue_free(). The caller submits interaction tasks
+ * while it is still generating them ( e.g. during a tree traversal ):
+ *
+ *   gsks_submit()  buffers a task on the caller side,
+ *   gsks_flush()   hands the buffered tasks to the workers, no blocking,
+ *   gsks_wait()    flushes, then blocks until every task is summed.
+ *
+ * Submitted tasks are cut into pieces of at most KS_QUEUE_PIECE targets
+ * or sources, so a few large tasks still spread over the workers. Each
+ * piece is summed into a per-worker buffer of its targets and added to u
+ * atomically, as in omp_dgsks_list. Norms and bandwidth factors come from
+ * the gsks_points_t handles and are made ready by the workers.
+ *
+ * The workers are pinned like the ks_pool threads ( ks_pool_pin() ), so
+ * KS_POOL_BIND applies to them as well.
+ *
+ * The index maps of a task are not copied; they must stay valid until
+ * gsks_wait() returns.
+ *
+ *
+ * Todo:
+ *
+ *
+ * Modification:
+ *
+ *
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <omp.h>
+#include <ks.h>
+#include <ks_pool.h>
+
+#define KS_QUEUE_PIECE 1024     // longest side of a queued piece
+#define KS_QUEUE_BATCH 64       // pieces buffered by gsks_submit()
+
+struct queue_s {
+  ks_t          kernel;
+  gsks_points_t *A;
+  gsks_points_t *B;
+  double        *u;
+  double        *w;
+
+  pthread_mutex_t lock;
+  pthread_cond_t  ready;        // pieces queued, or shutting down
+  pthread_cond_t  done;         // pending dropped to zero
+  gsks_task_t     *ring;        // FIFO of pieces
+  long            cap;
+  long            head;
+  long            tail;
+  long            pending;      // queued or running pieces
+  int             quit;
+
+  gsks_task_t     batch[ KS_QUEUE_BATCH ];
+  int             nbatch;
+
+  int             nworker;
+  int             nstarted;
+  pthread_t       *worker;
+};
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Sum one piece into u.
+ * --------------------------------------------------------------------------
+ */
+static void ks_queue_run(
+    gsks_queue_t *q,
+    gsks_task_t  *piece,
+    double *u_piece,
+    int    *iota
+    )
+{
+  gsks_points_t *A = q->A, *B = q->B;
+  int    i, p;
+
+  gsks_points_require( A, piece->m, piece->amap );
+  gsks_points_require( B, piece->n, piece->bmap );
+
+  for ( i = 0; i < piece->m * KS_RHS; i ++ ) u_piece[ i ] = 0.0;
+
+  dgsks(
+      &q->kernel,
+      piece->m,
+      piece->n,
+      A->k,
+      u_piece,
+      iota,
+      A->X,
+      A->X2,
+      piece->amap,
+      B->X,
+      B->X2,
+      piece->bmap,
+      q->w,
+      piece->wmap
+      );
+
+  for ( i = 0; i < piece->m; i ++ ) {
+    for ( p = 0; p < KS_RHS; p ++ ) {
+      #pragma omp atomic
+      q->u[ piece->umap[ i ] * KS_RHS + p ] += u_piece[ i * KS_RHS + p ];
+    }
+  }
+}
+
+
+
+static void *ks_queue_worker(
+    void   *arg
+    )
+{
+  gsks_queue_t *q = (gsks_queue_t*)arg;
+  gsks_task_t  piece;
+  int    i, *iota;
+  double *u_piece;
+
+  iota    = (int*)malloc( sizeof(int) * KS_QUEUE_PIECE );
+  u_piece = (double*)malloc( sizeof(double) * KS_QUEUE_PIECE * KS_RHS );
+  for ( i = 0; i < KS_QUEUE_PIECE; i ++ ) iota[ i ] = i;
+
+  // Workers take the cpus of the ks_pool threads, in the same order.
+  ks_pool_pin( __atomic_fetch_add( &q->nstarted, 1, __ATOMIC_RELAXED ) );
+
+  // Pieces are small; dgsks() runs on this thread only.
+  ks_set_ic_nt( 1 );
+
+  while ( 1 ) {
+    pthread_mutex_lock( &q->lock );
+    while ( q->head == q->tail && !q->quit ) {
+      pthread_cond_wait( &q->ready, &q->lock );
+    }
+    if ( q->head == q->tail ) {
+      pthread_mutex_unlock( &q->lock );
+      break;
+    }
+    piece = q->ring[ q->head % q->cap ];
+    q->head ++;
+    pthread_mutex_unlock( &q->lock );
+
+    ks_queue_run( q, &piece, u_piece, iota );
+
+    pthread_mutex_lock( &q->lock );
+    if ( -- q->pending == 0 ) pthread_cond_broadcast( &q->done );
+    pthread_mutex_unlock( &q->lock );
+  }
+
+  free( iota );
+  free( u_piece );
+
+  return NULL;
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Create a queue summing into u[ umap * KS_RHS + p ] with targets
+ *         from A and sources and weights from B and w. nworker <= 0 uses
+ *         omp_get_max_threads() workers. kernel is copied.
+ * --------------------------------------------------------------------------
+ */
+gsks_queue_t *gsks_queue_create(
+    ks_t   *kernel,
+    gsks_points_t *A,
+    gsks_points_t *B,
+    double *u,
+    double *w,
+    int    nworker
+    )
+{
+  gsks_queue_t *q;
+  int    i;
+
+  if ( A->k != B->k ) {
+    printf( "gsks_queue_create(): A and B must have the same dimension.\n" );
+    exit( 1 );
+  }
+
+  q = (gsks_queue_t*)malloc( sizeof(gsks_queue_t) );
+  q->kernel  = *kernel;
+  q->A       = A;
+  q->B       = B;
+  q->u       = u;
+  q->w       = w;
+  q->cap     = 1024;
+  q->ring    = (gsks_task_t*)malloc( sizeof(gsks_task_t) * q->cap );
+  q->head    = 0;
+  q->tail    = 0;
+  q->pending = 0;
+  q->quit    = 0;
+  q->nbatch  = 0;
+
+  if ( q->kernel.type == KS_GAUSSIAN_VAR_BANDWIDTH && A->hfac && B->hfac ) {
+    q->kernel.hi = A->hfac;
+    q->kernel.hj = B->hfac;
+  }
+
+  pthread_mutex_init( &q->lock, NULL );
+  pthread_cond_init( &q->ready, NULL );
+  pthread_cond_init( &q->done, NULL );
+
+  if ( nworker <= 0 ) nworker = omp_get_max_threads();
+  q->nworker  = nworker;
+  q->nstarted = 0;
+  q->worker   = (pthread_t*)malloc( sizeof(pthread_t) * nworker );
+  for ( i = 0; i < nworker; i ++ ) {
+    if ( pthread_create( &q->worker[ i ], NULL, ks_queue_worker, q ) ) {
+      printf( "gsks_queue_create(): cannot start worker %d\n", i );
+      exit( 1 );
+    }
+  }
+
+  return q;
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Move the buffered pieces to the ring and wake the workers.
+ * --------------------------------------------------------------------------
+ */
+void gsks_flush(
+    gsks_queue_t *q
+    )
+{
+  int    i;
+
+  if ( q->nbatch == 0 ) return;
+
+  pthread_mutex_lock( &q->lock );
+  if ( q->tail - q->head + q->nbatch > q->cap ) {
+    long        cap  = q->cap;
+    gsks_task_t *ring;
+
+    while ( q->tail - q->head + q->nbatch > cap ) cap *= 2;
+    ring = (gsks_task_t*)malloc( sizeof(gsks_task_t) * cap );
+    for ( i = 0; i < q->tail - q->head; i ++ ) {
+      ring[ i ] = q->ring[ ( q->head + i ) % q->cap ];
+    }
+    free( q->ring );
+    q->ring  = ring;
+    q->tail -= q->head;
+    q->head  = 0;
+    q->cap   = cap;
+  }
+  for ( i = 0; i < q->nbatch; i ++ ) {
+    q->ring[ q->tail % q->cap ] = q->batch[ i ];
+    q->tail ++;
+  }
+  q->pending += q->nbatch;
+  q->nbatch   = 0;
+  pthread_cond_broadcast( &q->ready );
+  pthread_mutex_unlock( &q->lock );
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Submit task ( the struct is copied, the maps are not ). NULL
+ *         umap or wmap use amap or bmap. Pieces
+ *         are handed to the workers every KS_QUEUE_BATCH pieces; call
+ *         gsks_flush() to start the rest early. Only one thread may
+ *         submit to a queue.
+ * --------------------------------------------------------------------------
+ */
+void gsks_submit(
+    gsks_queue_t *q,
+    gsks_task_t  *task
+    )
+{
+  int    i, j, *umap, *wmap;
+
+  if ( task->m <= 0 || task->n <= 0 ) return;
+
+  umap = task->umap ? task->umap : task->amap;
+  wmap = task->wmap ? task->wmap : task->bmap;
+
+  for ( i = 0; i < task->m; i += KS_QUEUE_PIECE ) {
+    for ( j = 0; j < task->n; j += KS_QUEUE_PIECE ) {
+      gsks_task_t *piece = &q->batch[ q->nbatch ];
+
+      piece->m    = ( task->m - i < KS_QUEUE_PIECE ) ? task->m - i : KS_QUEUE_PIECE;
+      piece->n    = ( task->n - j < KS_QUEUE_PIECE ) ? task->n - j : KS_QUEUE_PIECE;
+      piece->umap = umap + i;
+      piece->amap = task->amap + i;
+      piece->bmap = task->bmap + j;
+      piece->wmap = wmap + j;
+
+      if ( ++ q->nbatch == KS_QUEUE_BATCH ) gsks_flush( q );
+    }
+  }
+}
+
+
+
+void gsks_wait(
+    gsks_queue_t *q
+    )
+{
+  gsks_flush( q );
+
+  pthread_mutex_lock( &q->lock );
+  while ( q->pending > 0 ) pthread_cond_wait( &q->done, &q->lock );
+  pthread_mutex_unlock( &q->lock );
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Wait for the submitted tasks, then stop the workers.
+ * --------------------------------------------------------------------------
+ */
+void gsks_queue_free(
+    gsks_queue_t *q
+    )
+{
+  int    i;
+
+  if ( !q ) return;
+
+  gsks_wait( q );
+
+  pthread_mutex_lock( &q->lock );
+  q->quit = 1;
+  pthread_cond_broadcast( &q->ready );
+  pthread_mutex_unlock( &q->lock );
+
+  for ( i = 0; i < q->nworker; i ++ ) pthread_join( q->worker[ i ], NULL );
+
+  pthread_mutex_destroy( &q->lock );
+  pthread_cond_destroy( &q->ready );
+  pthread_cond_destroy( &q->done );
+  free( q->worker );
+  free( q->ring );
+  free( q );
+}
@@ -0,0 +1,428 @@
+/*
+ * --------------------------------------------------------------------------
+ * GSKS (General Stride Kernel Summation)
+ * --------------------------------------------------------------------------
+ * Copyright (C) 2015, The University of Texas at Austin
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ * ks_skel.c
+ *
+ * Chenhan D. Yu - Department of Computer Science,
+ *                 The University of Texas at Austin
+ *
+ *
+ * Purpose:
+ * Nested interpolative decomposition of the source tree, as in ASKIT and
+ * GOFMM. The candidates of a leaf are its points, those of an inner node
+ * the skeletons of its two children. For every node we sample rows
+ * outside it, half from its sibling ( the closest points ) and half
+ * uniformly, evaluate the whole K( rows, candidates ) block at once
+ * ( dgsks_ref_block() into per-thread buffers ), and factorize it with
+ * column pivoted QR:
+ *
+ *   K( rows, cand ) P = Q [ R11 R12 ],  skeleton = the first s pivots,
+ *
+ * s being the first pivot below tol | R( 0, 0 ) | or max_rank. Then
+ *
+ *   K( far, cand ) ~= K( far, skeleton ) proj,  proj = [ I, R11^-1 R12 ] P^T,
+ *
+ * and proj is nested: the weights of a node fold into skeleton weights
+ * proj w, level by level ( gsks_skel_weights() ). The root has no
+ * outside rows and keeps all its candidates.
+ *
+ * Skeletons do not make the treecode O( N s ): every target leaf still
+ * meets O( log N ) far nodes on its walk, so the far field costs
+ * O( N log N s ) for skeletons of size s, next to the near blocks.
+ *
+ *
+ * Todo:
+ *
+ *
+ * Modification:
+ *
+ *
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+#include <ks.h>
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Householder QR with column pivoting of the m x n column major A,
+ *         stopped at the first pivot below tol | R( 0, 0 ) | or after
+ *         max_rank steps. Returns the rank s; jpvt is the column order and
+ *         the first s rows of A hold [ R11 R12 ].
+ * --------------------------------------------------------------------------
+ */
+static int ks_skel_qp3(
+    int    m,
+    int    n,
+    double *A,
+    int    *jpvt,
+    double tol,
+    int    max_rank
+    )
+{
+  int    i, j, r, nr, rank = 0;
+  double nrm0 = 0.0;
+
+  nr = m < n ? m : n;
+  if ( nr > max_rank ) nr = max_rank;
+  for ( j = 0; j < n; j ++ ) jpvt[ j ] = j;
+
+  for ( r = 0; r < nr; r ++ ) {
+    double best = -1.0, alpha, beta, tau, *a;
+    int    p = r;
+
+    // Largest remaining column.
+    for ( j = r; j < n; j ++ ) {
+      double sum = 0.0;
+      for ( i = r; i < m; i ++ ) sum += A[ (size_t)j * m + i ] * A[ (size_t)j * m + i ];
+      if ( sum > best ) {
+        best = sum;
+        p    = j;
+      }
+    }
+    best = sqrt( best );
+    if ( r == 0 ) nrm0 = best;
+    if ( best == 0.0 || best <= tol * nrm0 ) break;
+
+    if ( p != r ) {
+      for ( i = 0; i < m; i ++ ) {
+        double tmp = A[ (size_t)r * m + i ];
+        A[ (size_t)r * m + i ] = A[ (size_t)p * m + i ];
+        A[ (size_t)p * m + i ] = tmp;
+      }
+      j = jpvt[ r ]; jpvt[ r ] = jpvt[ p ]; jpvt[ p ] = j;
+    }
+
+    // Reflector I - tau v v^T with v( r ) = 1, stored below the diagonal.
+    a     = A + (size_t)r * m;
+    alpha = a[ r ];
+    beta  = alpha >= 0.0 ? -best : best;
+    tau   = ( beta - alpha ) / beta;
+    for ( i = r + 1; i < m; i ++ ) a[ i ] /= ( alpha - beta );
+    a[ r ] = beta;
+
+    for ( j = r + 1; j < n; j ++ ) {
+      double *c = A + (size_t)j * m, dot = c[ r ];
+      for ( i = r + 1; i < m; i ++ ) dot += a[ i ] * c[ i ];
+      dot *= tau;
+      c[ r ] -= dot;
+      for ( i = r + 1; i < m; i ++ ) c[ i ] -= dot * a[ i ];
+    }
+    rank ++;
+  }
+
+  return rank;
+}
+
+
+
+/*
+ * Buffers of one thread, sized for the most rows ( 2 max_rank + 16 ) and
+ * candidates ( a leaf, or two child skeletons ) of any node.
+ */
+typedef struct {
+  int    *rows;
+  int    *jpvt;
+  double *As;                   // packed rows, nsamp x k
+  double *Bs;                   // packed candidates, ncand x k
+  double *A;                    // K( rows, candidates ), nsamp x ncand
+} ks_skel_work_t;
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Skeletonize one node from its candidates. Returns the rank and
+ *         allocates *skel ( rank ) and *proj ( rank x ncand ).
+ * --------------------------------------------------------------------------
+ */
+static int ks_skel_node(
+    ks_t   *kernel,
+    gsks_tree_t *S,
+    double *X2,
+    int    node,
+    int    ncand,
+    int    *cand,
+    double tol,
+    int    max_rank,
+    ks_skel_work_t *work,
+    int    **skel,
+    double **proj
+    )
+{
+  int    i, j, s, nsamp, nsib, n_out;
+  int    beg = S->beg[ node ], end = S->end[ node ];
+  int    *rows = work->rows, *jpvt = work->jpvt;
+  unsigned int seed = node + 1;
+  double *A = work->A;
+
+  n_out = S->n - ( end - beg );
+
+  // The root has no rows to compress against.
+  if ( n_out == 0 || ncand == 0 ) {
+    *skel = (int*)malloc( sizeof(int) * ( ncand + 1 ) );
+    *proj = (double*)calloc( (size_t)ncand * ncand + 1, sizeof(double) );
+    for ( j = 0; j < ncand; j ++ ) {
+      ( *skel )[ j ] = cand[ j ];
+      ( *proj )[ (size_t)j * ncand + j ] = 1.0;
+    }
+    return ncand;
+  }
+
+  nsamp = 2 * max_rank + 16;
+  if ( nsamp > n_out ) nsamp = n_out;
+
+  // Half of the rows from the sibling, the rest from anywhere outside.
+  nsib = 0;
+  if ( node > 0 ) {
+    int    sib = ( node % 2 ) ? node + 1 : node - 1;
+    int    size = S->end[ sib ] - S->beg[ sib ];
+    nsib = size < nsamp / 2 ? size : nsamp / 2;
+    for ( i = 0; i < nsib; i ++ ) rows[ i ] = S->beg[ sib ] + rand_r( &seed ) % size;
+  }
+  for ( i = nsib; i < nsamp; i ++ ) {
+    int    r = rand_r( &seed ) % n_out;
+    rows[ i ] = r < beg ? r : r + ( end - beg );
+  }
+
+  // The whole nsamp x ncand block in one call.
+  dgsks_ref_block( kernel, nsamp, ncand, S->k, S->X, X2, rows,
+      S->X, X2, cand, work->As, work->Bs, A );
+
+  s = ks_skel_qp3( nsamp, ncand, A, jpvt, tol, max_rank );
+
+  *skel = (int*)malloc( sizeof(int) * ( s + 1 ) );
+  *proj = (double*)calloc( (size_t)s * ncand + 1, sizeof(double) );
+  for ( j = 0; j < s; j ++ ) {
+    ( *skel )[ j ] = cand[ jpvt[ j ] ];
+    ( *proj )[ (size_t)jpvt[ j ] * s + j ] = 1.0;
+  }
+
+  // The other columns: R11^-1 R12 by back substitution.
+  for ( j = s; j < ncand; j ++ ) {
+    double *x = *proj + (size_t)jpvt[ j ] * s;
+    for ( i = s - 1; i >= 0; i -- ) {
+      double sum = A[ (size_t)j * nsamp + i ];
+      int    l;
+      for ( l = i + 1; l < s; l ++ ) sum -= A[ (size_t)l * nsamp + i ] * x[ l ];
+      x[ i ] = sum / A[ (size_t)i * nsamp + i ];
+    }
+  }
+
+  return s;
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Skeletonize every node of S, leaves first. tol is relative to
+ *         the largest sampled column of each node; max_rank caps the
+ *         skeleton size.
+ * --------------------------------------------------------------------------
+ */
+gsks_skel_t *gsks_skel_create(
+    ks_t   *kernel,
+    gsks_tree_t *S,
+    double tol,
+    int    max_rank
+    )
+{
+  gsks_skel_t *sk;
+  double *X2, **proj;
+  int    **skel, *nskel, *ncand;
+  int    i, lvl, nsamp_max, ncand_max, nwork;
+  ks_skel_work_t *work;
+
+  if ( max_rank < 1 ) max_rank = 1;
+
+  sk = (gsks_skel_t*)malloc( sizeof(gsks_skel_t) );
+  sk->S        = S;
+  sk->tol      = tol;
+  sk->max_rank = max_rank;
+  sk->sptr     = (int*)malloc( sizeof(int) * ( S->nnode + 1 ) );
+  sk->pptr     = (long*)malloc( sizeof(long) * ( S->nnode + 1 ) );
+
+  X2    = ks_malloc_aligned( 1, S->n + 1, sizeof(double) );
+  skel  = (int**)malloc( sizeof(int*) * S->nnode );
+  proj  = (double**)malloc( sizeof(double*) * S->nnode );
+  nskel = (int*)malloc( sizeof(int) * S->nnode );
+  ncand = (int*)malloc( sizeof(int) * S->nnode );
+
+  #pragma omp parallel for
+  for ( i = 0; i < S->n; i ++ ) {
+    double tmp = 0.0;
+    int    p;
+    for ( p = 0; p < S->k; p ++ ) tmp += S->X[ (size_t)i * S->k + p ] * S->X[ (size_t)i * S->k + p ];
+    X2[ i ] = tmp;
+  }
+
+  // One set of buffers per thread, allocated once for all the levels.
+  nsamp_max = 2 * max_rank + 16;
+  ncand_max = 2 * max_rank;
+  for ( i = S->nleaf - 1; i < S->nnode; i ++ ) {
+    if ( S->end[ i ] - S->beg[ i ] > ncand_max ) ncand_max = S->end[ i ] - S->beg[ i ];
+  }
+  nwork = omp_get_max_threads();
+  work  = (ks_skel_work_t*)malloc( sizeof(ks_skel_work_t) * nwork );
+  for ( i = 0; i < nwork; i ++ ) {
+    work[ i ].rows = (int*)malloc( sizeof(int) * nsamp_max );
+    work[ i ].jpvt = (int*)malloc( sizeof(int) * ncand_max );
+    work[ i ].As   = (double*)malloc( sizeof(double) * (size_t)nsamp_max * S->k );
+    work[ i ].Bs   = (double*)malloc( sizeof(double) * (size_t)ncand_max * S->k );
+    work[ i ].A    = (double*)malloc( sizeof(double) * (size_t)nsamp_max * ncand_max );
+  }
+
+  for ( lvl = S->depth; lvl >= 0; lvl -- ) {
+    #pragma omp parallel num_threads( nwork )
+    {
+      ks_skel_work_t *mine = work + omp_get_thread_num();
+
+      ks_set_ic_nt( 1 );
+
+      #pragma omp for schedule( dynamic )
+      for ( i = ( 1 << lvl ) - 1; i < ( 2 << lvl ) - 1; i ++ ) {
+        int    j, *cand;
+
+        if ( lvl == S->depth ) {
+          ncand[ i ] = S->end[ i ] - S->beg[ i ];
+          cand = (int*)malloc( sizeof(int) * ( ncand[ i ] + 1 ) );
+          for ( j = 0; j < ncand[ i ]; j ++ ) cand[ j ] = S->beg[ i ] + j;
+        }
+        else {
+          int    l = 2 * i + 1, r = 2 * i + 2;
+          ncand[ i ] = nskel[ l ] + nskel[ r ];
+          cand = (int*)malloc( sizeof(int) * ( ncand[ i ] + 1 ) );
+          memcpy( cand, skel[ l ], sizeof(int) * nskel[ l ] );
+          memcpy( cand + nskel[ l ], skel[ r ], sizeof(int) * nskel[ r ] );
+        }
+
+        nskel[ i ] = ks_skel_node( kernel, S, X2, i, ncand[ i ], cand,
+            tol, max_rank, mine, &skel[ i ], &proj[ i ] );
+        free( cand );
+      }
+
+      ks_set_ic_nt( 0 );
+    }
+  }
+
+  // Flatten in node order, so the skeletons of two siblings are adjacent.
+  sk->sptr[ 0 ] = 0;
+  sk->pptr[ 0 ] = 0;
+  for ( i = 0; i < S->nnode; i ++ ) {
+    sk->sptr[ i + 1 ] = sk->sptr[ i ] + nskel[ i ];
+    sk->pptr[ i + 1 ] = sk->pptr[ i ] + (long)nskel[ i ] * ncand[ i ];
+  }
+  sk->sidx = (int*)malloc( sizeof(int) * ( sk->sptr[ S->nnode ] + 1 ) );
+  // pptr is long: the interpolation matrices can exceed INT_MAX entries,
+  // which ks_malloc_aligned() cannot size.
+  sk->proj = (double*)malloc( sizeof(double) * ( (size_t)sk->pptr[ S->nnode ] + 1 ) );
+
+  #pragma omp parallel for
+  for ( i = 0; i < S->nnode; i ++ ) {
+    memcpy( sk->sidx + sk->sptr[ i ], skel[ i ], sizeof(int) * nskel[ i ] );
+    memcpy( sk->proj + sk->pptr[ i ], proj[ i ], sizeof(double) * (size_t)nskel[ i ] * ncand[ i ] );
+    free( skel[ i ] );
+    free( proj[ i ] );
+  }
+
+  for ( i = 0; i < nwork; i ++ ) {
+    free( work[ i ].rows );
+    free( work[ i ].jpvt );
+    free( work[ i ].As );
+    free( work[ i ].Bs );
+    free( work[ i ].A );
+  }
+  free( work );
+  ks_free_aligned( X2 );
+  free( skel );
+  free( proj );
+  free( nskel );
+  free( ncand );
+
+  return sk;
+}
+
+
+
+void gsks_skel_free(
+    gsks_skel_t *sk
+    )
+{
+  if ( !sk ) return;
+  free( sk->sptr );
+  free( sk->pptr );
+  free( sk->sidx );
+  free( sk->proj );
+  free( sk );
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Skeleton weights of every node: wskel( node ) = proj( node )
+ *         times the weights of its candidates ( w of a leaf, or the
+ *         skeleton weights of the children ). w is in tree order, wskel
+ *         holds sptr[ nnode ] x KS_RHS.
+ * --------------------------------------------------------------------------
+ */
+void gsks_skel_weights(
+    gsks_skel_t *sk,
+    double *w,
+    double *wskel
+    )
+{
+  gsks_tree_t *S = sk->S;
+  int    i, lvl;
+
+  for ( lvl = S->depth; lvl >= 0; lvl -- ) {
+    #pragma omp parallel for schedule( dynamic )
+    for ( i = ( 1 << lvl ) - 1; i < ( 2 << lvl ) - 1; i ++ ) {
+      int    a, c, p, s = sk->sptr[ i + 1 ] - sk->sptr[ i ], nc;
+      double *wc, *ws = wskel + (size_t)sk->sptr[ i ] * KS_RHS;
+      double *P = sk->proj + sk->pptr[ i ];
+
+      if ( lvl == S->depth ) {
+        nc = S->end[ i ] - S->beg[ i ];
+        wc = w + (size_t)S->beg[ i ] * KS_RHS;
+      }
+      else {
+        nc = sk->sptr[ 2 * i + 3 ] - sk->sptr[ 2 * i + 1 ];
+        wc = wskel + (size_t)sk->sptr[ 2 * i + 1 ] * KS_RHS;
+      }
+
+      for ( a = 0; a < s * KS_RHS; a ++ ) ws[ a ] = 0.0;
+      for ( c = 0; c < nc; c ++ ) {
+        for ( a = 0; a < s; a ++ ) {
+          for ( p = 0; p < KS_RHS; p ++ ) {
+            ws[ a * KS_RHS + p ] += P[ (size_t)c * s + a ] * wc[ c * KS_RHS + p ];
+          }
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,696 @@
+/*
+ * --------------------------------------------------------------------------
+ * GSKS (General Stride Kernel Summation)
+ * --------------------------------------------------------------------------
+ * Copyright (C) 2015, The University of Texas at Austin
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ * ks_solver.cpp
+ *
+ * Chenhan D. Yu - Department of Computer Science,
+ *                 The University of Texas at Austin
+ *
+ *
+ * Purpose:
+ * Matrix-free solver of ( K + lambda I ) alpha = y, as in kernel ridge
+ * regression and Gaussian processes. K is given by symmetric interaction
+ * lists on a dataset handle: u[ aidx ] += K( X[ aidx ], X[ bidx ] ) w[ bidx ]
+ * per list, summed by omp_dgsks_list(). The solver owns copies of the
+ * lists and every work vector, so an iteration only runs the matvec and
+ * a few vector updates. The lists are coalesced and scheduled once, in
+ * gsks_solver_create() ( omp_dgsks_list_plan() ), with the norms made
+ * ready; a matvec only reruns that schedule on the buffers, which live
+ * across iterations and solves.
+ *
+ * Several right hand sides run their own CG or MINRES recurrences in
+ * lockstep; one matvec call sums KS_RHS of them, and converged ones drop
+ * out. The preconditioner is none, the diagonal of K + lambda I, block
+ * Jacobi on caller given index ranges ( e.g. tree leaves ) with the
+ * blocks Cholesky factorized, or a caller's function.
+ *
+ *
+ * Todo:
+ *
+ *
+ * Modification:
+ *
+ *
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+#include <vector>
+#include <algorithm>
+
+extern "C" {
+#include <ks.h>
+}
+#include <omp_dgsks_list.hpp>
+
+#define KS_SOLVER_DIAG_BLOCK 8
+
+
+struct solver_s {
+  ks_t   kernel;
+  gsks_points_t *X;
+  double lambda;
+  int    n;
+  int    n_list;
+  std::vector<int> aptr, aidx, bptr, bidx;
+  ks_list_plan_t *plan;           // the lists, coalesced and scheduled
+
+  ks_precond_t precond;
+  gsks_precond_fn fn;
+  void   *arg;
+  std::vector<int>    blk;        // block b is blk[ b ] ~ blk[ b + 1 ] - 1
+  std::vector<long>   lptr;       // Cholesky factor of block b at L + lptr[ b ]
+  std::vector<double> L;
+  std::vector<double> diag;       // inverse diagonal
+
+  // Work vectors, n x nrhs each, kept across solves.
+  std::vector<double> work;
+  std::vector<double> ubuf, wbuf; // n x KS_RHS matvec buffers
+};
+
+
+static inline double ks_dot( int n, const double *x, const double *y )
+{
+  double sum = 0.0;
+
+  #pragma omp parallel for reduction( + : sum )
+  for ( int i = 0; i < n; i ++ ) sum += x[ i ] * y[ i ];
+
+  return sum;
+}
+
+
+// y = a x + b y
+static inline void ks_axpby( int n, double a, const double *x, double b, double *y )
+{
+  #pragma omp parallel for
+  for ( int i = 0; i < n; i ++ ) y[ i ] = a * x[ i ] + b * y[ i ];
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Create a solver of ( K + lambda I ) alpha = y over the n points
+ *         of X. The CSR lists ( see omp_dgsks_list() ) must describe a
+ *         symmetric K; they are copied, X must outlive the solver.
+ *         The matvec schedule is built here, for the current number of
+ *         threads.
+ * --------------------------------------------------------------------------
+ */
+gsks_solver_t *gsks_solver_create(
+    ks_t   *kernel,
+    gsks_points_t *X,
+    int    n_list,
+    const int *aptr,
+    const int *aidx,
+    const int *bptr,
+    const int *bidx,
+    double lambda
+    )
+{
+  gsks_solver_t *sol = new gsks_solver_t;
+
+  sol->kernel   = *kernel;
+  sol->X        = X;
+  sol->lambda   = lambda;
+  sol->n        = X->n;
+  sol->n_list   = n_list;
+  sol->aptr.assign( aptr, aptr + n_list + 1 );
+  sol->aidx.assign( aidx, aidx + aptr[ n_list ] );
+  sol->bptr.assign( bptr, bptr + n_list + 1 );
+  sol->bidx.assign( bidx, bidx + bptr[ n_list ] );
+  sol->precond  = KS_PRECOND_NONE;
+  sol->fn       = NULL;
+  sol->arg      = NULL;
+  sol->ubuf.assign( (size_t)sol->n * KS_RHS, 0.0 );
+  sol->wbuf.assign( (size_t)sol->n * KS_RHS, 0.0 );
+  sol->plan     = omp_dgsks_list_plan(
+      &sol->kernel, n_list,
+      NULL,     NULL,
+      sol->X,   sol->aptr.data(), sol->aidx.data(),
+      sol->X,   sol->bptr.data(), sol->bidx.data(),
+      NULL,     NULL
+      );
+
+  return sol;
+}
+
+
+
+void gsks_solver_free(
+    gsks_solver_t *sol
+    )
+{
+  omp_dgsks_list_plan_free( sol->plan );
+  delete sol;
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  u( :, j ) = ( K + lambda I ) x( :, j ) for the columns j with
+ *         active[ j ] ( all if active is NULL ), KS_RHS columns per
+ *         omp_dgsks_list() call.
+ * --------------------------------------------------------------------------
+ */
+static void ks_solver_matvec(
+    gsks_solver_t *sol,
+    int    nrhs,
+    const int *active,
+    const double *x,
+    int    ldx,
+    double *u,
+    int    ldu
+    )
+{
+  int    n = sol->n;
+  std::vector<int> cols;
+
+  for ( int j = 0; j < nrhs; j ++ ) {
+    if ( !active || active[ j ] ) cols.push_back( j );
+  }
+
+  for ( size_t c = 0; c < cols.size(); c += KS_RHS ) {
+    int    nb = std::min( (int)( cols.size() - c ), KS_RHS );
+    double *ub = sol->ubuf.data(), *wb = sol->wbuf.data();
+
+    #pragma omp parallel for
+    for ( int i = 0; i < n; i ++ ) {
+      for ( int p = 0; p < KS_RHS; p ++ ) {
+        wb[ i * KS_RHS + p ] = p < nb ? x[ (size_t)cols[ c + p ] * ldx + i ] : 0.0;
+        ub[ i * KS_RHS + p ] = 0.0;
+      }
+    }
+
+    omp_dgsks_list_execute( sol->plan, ub, wb );
+
+    #pragma omp parallel for
+    for ( int i = 0; i < n; i ++ ) {
+      for ( int p = 0; p < nb; p ++ ) {
+        int    j = cols[ c + p ];
+        u[ (size_t)j * ldu + i ] = ub[ i * KS_RHS + p ] + sol->lambda * x[ (size_t)j * ldx + i ];
+      }
+    }
+  }
+}
+
+
+
+void gsks_solver_matvec(
+    gsks_solver_t *sol,
+    int    nrhs,
+    const double *x,
+    int    ldx,
+    double *u,
+    int    ldu
+    )
+{
+  ks_solver_matvec( sol, nrhs, NULL, x, ldx, u, ldu );
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  The block beg ~ end - 1 of K + lambda I, column major, one
+ *         column per dgsks_delta() call on the packed block.
+ * --------------------------------------------------------------------------
+ */
+static void ks_solver_block(
+    gsks_solver_t *sol,
+    ks_t   *ker,
+    double *X2,
+    int    beg,
+    int    end,
+    double *Kb
+    )
+{
+  int    nb = end - beg;
+  double one = 1.0;
+  std::vector<int> idx( nb ), umap( nb );
+  gsks_targets_t *targets;
+
+  for ( int i = 0; i < nb; i ++ ) {
+    idx[ i ]  = beg + i;
+    umap[ i ] = i;
+  }
+  memset( Kb, 0, sizeof(double) * nb * nb );
+
+  targets = gsks_targets_create( ker, nb, sol->X->k, sol->X->X, X2, idx.data() );
+  for ( int j = 0; j < nb; j ++ ) {
+    dgsks_delta( ker, targets, Kb + j * nb, umap.data(), 1,
+        sol->X->X, X2, &idx[ j ], &one );
+    Kb[ j * nb + j ] += sol->lambda;
+  }
+  gsks_targets_free( targets );
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Select a built-in preconditioner. KS_PRECOND_BLOCK_JACOBI needs
+ *         the nblock ranges block_ptr[ b ] ~ block_ptr[ b + 1 ] - 1, which
+ *         must tile 0 ~ n - 1; every block of K + lambda I must be
+ *         positive definite. The blocks are computed and factorized here.
+ * --------------------------------------------------------------------------
+ */
+void gsks_solver_set_precond(
+    gsks_solver_t *sol,
+    ks_precond_t precond,
+    int    nblock,
+    const int *block_ptr
+    )
+{
+  int    n = sol->n, failed = 0;
+  double *X2 = gsks_points_norms( sol->X );
+  ks_t   ker = sol->kernel;
+
+  // Variable bandwidths from the handle, as omp_dgsks_list() does.
+  if ( ker.type == KS_GAUSSIAN_VAR_BANDWIDTH && sol->X->hfac ) {
+    ker.hi = ker.hj = gsks_points_bandwidth( sol->X );
+  }
+
+  sol->precond = precond;
+  sol->blk.clear();
+  sol->lptr.clear();
+  sol->L.clear();
+  sol->diag.clear();
+
+  if ( precond == KS_PRECOND_DIAG ) {
+    sol->diag.resize( n );
+
+    #pragma omp parallel
+    {
+      std::vector<double> Kb( KS_SOLVER_DIAG_BLOCK * KS_SOLVER_DIAG_BLOCK );
+
+      ks_set_ic_nt( 1 );
+
+      #pragma omp for schedule( dynamic ) reduction( + : failed )
+      for ( int beg = 0; beg < n; beg += KS_SOLVER_DIAG_BLOCK ) {
+        int    nb = std::min( n - beg, KS_SOLVER_DIAG_BLOCK );
+        ks_solver_block( sol, &ker, X2, beg, beg + nb, Kb.data() );
+        for ( int i = 0; i < nb; i ++ ) {
+          if ( Kb[ i * nb + i ] <= 0.0 ) failed ++;
+          sol->diag[ beg + i ] = 1.0 / Kb[ i * nb + i ];
+        }
+      }
+
+      ks_set_ic_nt( 0 );
+    }
+  }
+  else if ( precond == KS_PRECOND_BLOCK_JACOBI ) {
+    if ( nblock < 1 || !block_ptr || block_ptr[ 0 ] != 0 || block_ptr[ nblock ] != n ) {
+      printf( "gsks_solver_set_precond(): the blocks must tile 0 ~ n - 1.\n" );
+      exit( 1 );
+    }
+    sol->blk.assign( block_ptr, block_ptr + nblock + 1 );
+    sol->lptr.assign( nblock + 1, 0 );
+    for ( int b = 0; b < nblock; b ++ ) {
+      long   nb = block_ptr[ b + 1 ] - block_ptr[ b ];
+      sol->lptr[ b + 1 ] = sol->lptr[ b ] + nb * nb;
+    }
+    sol->L.resize( sol->lptr[ nblock ] );
+
+    #pragma omp parallel
+    {
+      ks_set_ic_nt( 1 );
+
+      #pragma omp for schedule( dynamic ) reduction( + : failed )
+      for ( int b = 0; b < nblock; b ++ ) {
+        int    nb = block_ptr[ b + 1 ] - block_ptr[ b ];
+        double *A = sol->L.data() + sol->lptr[ b ];
+
+        ks_solver_block( sol, &ker, X2, block_ptr[ b ], block_ptr[ b + 1 ], A );
+
+        // In place Cholesky, lower triangle.
+        for ( int j = 0; j < nb; j ++ ) {
+          double d = A[ j * nb + j ];
+          for ( int p = 0; p < j; p ++ ) d -= A[ p * nb + j ] * A[ p * nb + j ];
+          if ( d <= 0.0 ) {
+            failed ++;
+            break;
+          }
+          d = sqrt( d );
+          A[ j * nb + j ] = d;
+          for ( int i = j + 1; i < nb; i ++ ) {
+            double sum = A[ j * nb + i ];
+            for ( int p = 0; p < j; p ++ ) sum -= A[ p * nb + i ] * A[ p * nb + j ];
+            A[ j * nb + i ] = sum / d;
+          }
+        }
+      }
+
+      ks_set_ic_nt( 0 );
+    }
+  }
+  else if ( precond != KS_PRECOND_NONE ) {
+    printf( "gsks_solver_set_precond(): use gsks_solver_set_precond_fn() for KS_PRECOND_USER.\n" );
+    exit( 1 );
+  }
+
+  if ( failed ) {
+    printf( "gsks_solver_set_precond(): K + lambda I is not positive definite on %d blocks.\n", failed );
+    exit( 1 );
+  }
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Use fn( n, nrhs, r, ldr, z, ldz, arg ), which must set z to
+ *         M^-1 r for a symmetric positive definite M, as the
+ *         preconditioner.
+ * --------------------------------------------------------------------------
+ */
+void gsks_solver_set_precond_fn(
+    gsks_solver_t *sol,
+    gsks_precond_fn fn,
+    void   *arg
+    )
+{
+  sol->precond = KS_PRECOND_USER;
+  sol->fn      = fn;
+  sol->arg     = arg;
+}
+
+
+
+// z( :, j ) = M^-1 r( :, j ) for the active columns, ld = n.
+static void ks_solver_precond(
+    gsks_solver_t *sol,
+    int    nrhs,
+    const int *active,
+    const double *r,
+    double *z
+    )
+{
+  int    n = sol->n;
+
+  if ( sol->precond == KS_PRECOND_USER ) {
+    sol->fn( n, nrhs, r, n, z, n, sol->arg );
+    return;
+  }
+
+  for ( int j = 0; j < nrhs; j ++ ) {
+    const double *rj = r + (size_t)j * n;
+    double *zj = z + (size_t)j * n;
+
+    if ( !active[ j ] ) continue;
+
+    if ( sol->precond == KS_PRECOND_DIAG ) {
+      #pragma omp parallel for
+      for ( int i = 0; i < n; i ++ ) zj[ i ] = sol->diag[ i ] * rj[ i ];
+    }
+    else if ( sol->precond == KS_PRECOND_BLOCK_JACOBI ) {
+      #pragma omp parallel for schedule( dynamic )
+      for ( int b = 0; b < (int)sol->blk.size() - 1; b ++ ) {
+        int    beg = sol->blk[ b ], nb = sol->blk[ b + 1 ] - beg;
+        const double *A = sol->L.data() + sol->lptr[ b ];
+        double *x = zj + beg;
+
+        for ( int i = 0; i < nb; i ++ ) {
+          double sum = rj[ beg + i ];
+          for ( int p = 0; p < i; p ++ ) sum -= A[ p * nb + i ] * x[ p ];
+          x[ i ] = sum / A[ i * nb + i ];
+        }
+        for ( int i = nb - 1; i >= 0; i -- ) {
+          double sum = x[ i ];
+          for ( int p = i + 1; p < nb; p ++ ) sum -= A[ i * nb + p ] * x[ p ];
+          x[ i ] = sum / A[ i * nb + i ];
+        }
+      }
+    }
+    else {
+      memcpy( zj, rj, sizeof(double) * n );
+    }
+  }
+}
+
+
+
+static double *ks_solver_work(
+    gsks_solver_t *sol,
+    int    nrhs,
+    int    nvec
+    )
+{
+  size_t size = (size_t)sol->n * nrhs * nvec;
+
+  if ( sol->work.size() < size ) sol->work.resize( size );
+
+  return sol->work.data();
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Preconditioned CG; the residuals are the true 2-norms relative
+ *         to | y( :, j ) |.
+ * --------------------------------------------------------------------------
+ */
+static int ks_solver_cg(
+    gsks_solver_t *sol,
+    int    nrhs,
+    const double *y,
+    int    ldy,
+    double *x,
+    int    ldx,
+    double tol,
+    int    maxit,
+    double *relres
+    )
+{
+  int    n = sol->n, it;
+  double *r  = ks_solver_work( sol, nrhs, 4 );
+  double *z  = r + (size_t)n * nrhs;
+  double *p  = z + (size_t)n * nrhs;
+  double *Ap = p + (size_t)n * nrhs;
+  std::vector<int>    active( nrhs, 1 );
+  std::vector<double> rz( nrhs ), ynrm( nrhs );
+
+  for ( int j = 0; j < nrhs; j ++ ) {
+    memcpy( r + (size_t)j * n, y + (size_t)j * ldy, sizeof(double) * n );
+    memset( x + (size_t)j * ldx, 0, sizeof(double) * n );
+    ynrm[ j ]   = sqrt( ks_dot( n, r + (size_t)j * n, r + (size_t)j * n ) );
+    relres[ j ] = ynrm[ j ] > 0.0 ? 1.0 : 0.0;
+    if ( relres[ j ] <= tol ) active[ j ] = 0;
+  }
+  ks_solver_precond( sol, nrhs, active.data(), r, z );
+  for ( int j = 0; j < nrhs; j ++ ) {
+    if ( !active[ j ] ) continue;
+    memcpy( p + (size_t)j * n, z + (size_t)j * n, sizeof(double) * n );
+    rz[ j ] = ks_dot( n, r + (size_t)j * n, z + (size_t)j * n );
+  }
+
+  for ( it = 0; it < maxit; it ++ ) {
+    int    nactive = 0;
+
+    for ( int j = 0; j < nrhs; j ++ ) nactive += active[ j ];
+    if ( !nactive ) break;
+
+    ks_solver_matvec( sol, nrhs, active.data(), p, n, Ap, n );
+
+    for ( int j = 0; j < nrhs; j ++ ) {
+      double *rj = r + (size_t)j * n, *pj = p + (size_t)j * n;
+      double a;
+
+      if ( !active[ j ] ) continue;
+      a = rz[ j ] / ks_dot( n, pj, Ap + (size_t)j * n );
+      ks_axpby( n, a, pj, 1.0, x + (size_t)j * ldx );
+      ks_axpby( n, -a, Ap + (size_t)j * n, 1.0, rj );
+      relres[ j ] = sqrt( ks_dot( n, rj, rj ) ) / ynrm[ j ];
+      if ( relres[ j ] <= tol ) active[ j ] = 0;
+    }
+
+    ks_solver_precond( sol, nrhs, active.data(), r, z );
+
+    for ( int j = 0; j < nrhs; j ++ ) {
+      double rz_new;
+
+      if ( !active[ j ] ) continue;
+      rz_new  = ks_dot( n, r + (size_t)j * n, z + (size_t)j * n );
+      ks_axpby( n, 1.0, z + (size_t)j * n, rz_new / rz[ j ], p + (size_t)j * n );
+      rz[ j ] = rz_new;
+    }
+  }
+
+  return it;
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Preconditioned MINRES ( Paige and Saunders ), for K that are
+ *         only symmetric. The residuals are the M^-1 norm estimates of
+ *         the recurrence relative to that of y( :, j ).
+ * --------------------------------------------------------------------------
+ */
+static int ks_solver_minres(
+    gsks_solver_t *sol,
+    int    nrhs,
+    const double *y,
+    int    ldy,
+    double *x,
+    int    ldx,
+    double tol,
+    int    maxit,
+    double *relres
+    )
+{
+  int    n = sol->n, it;
+  size_t nn = (size_t)n * nrhs;
+  double *r1 = ks_solver_work( sol, nrhs, 7 );
+  double *r2 = r1 + nn, *v = r2 + nn, *yv = v + nn;
+  double *w  = yv + nn, *w1 = w + nn, *w2 = w1 + nn;
+  std::vector<int>    active( nrhs, 1 );
+  std::vector<double> beta1( nrhs ), beta( nrhs ), oldb( nrhs, 0.0 ), alfa( nrhs );
+  std::vector<double> dbar( nrhs, 0.0 ), epsln( nrhs, 0.0 ), phibar( nrhs );
+  std::vector<double> cs( nrhs, -1.0 ), sn( nrhs, 0.0 );
+
+  memset( w, 0, sizeof(double) * nn );
+  memset( w2, 0, sizeof(double) * nn );
+  for ( int j = 0; j < nrhs; j ++ ) {
+    memcpy( r1 + (size_t)j * n, y + (size_t)j * ldy, sizeof(double) * n );
+    memset( x + (size_t)j * ldx, 0, sizeof(double) * n );
+  }
+  memcpy( r2, r1, sizeof(double) * nn );
+  ks_solver_precond( sol, nrhs, active.data(), r1, yv );
+  for ( int j = 0; j < nrhs; j ++ ) {
+    beta1[ j ]  = sqrt( ks_dot( n, r1 + (size_t)j * n, yv + (size_t)j * n ) );
+    beta[ j ]   = beta1[ j ];
+    phibar[ j ] = beta1[ j ];
+    relres[ j ] = beta1[ j ] > 0.0 ? 1.0 : 0.0;
+    if ( relres[ j ] <= tol ) active[ j ] = 0;
+  }
+
+  for ( it = 0; it < maxit; it ++ ) {
+    int    nactive = 0;
+
+    for ( int j = 0; j < nrhs; j ++ ) nactive += active[ j ];
+    if ( !nactive ) break;
+
+    // Lanczos step: v = y / beta, y = A v - ( beta / oldb ) r1 - ( alfa / beta ) r2.
+    for ( int j = 0; j < nrhs; j ++ ) {
+      if ( !active[ j ] ) continue;
+      ks_axpby( n, 1.0 / beta[ j ], yv + (size_t)j * n, 0.0, v + (size_t)j * n );
+    }
+
+    ks_solver_matvec( sol, nrhs, active.data(), v, n, yv, n );
+
+    for ( int j = 0; j < nrhs; j ++ ) {
+      double *yj = yv + (size_t)j * n;
+
+      if ( !active[ j ] ) continue;
+      if ( it > 0 ) ks_axpby( n, -beta[ j ] / oldb[ j ], r1 + (size_t)j * n, 1.0, yj );
+      alfa[ j ] = ks_dot( n, v + (size_t)j * n, yj );
+      ks_axpby( n, -alfa[ j ] / beta[ j ], r2 + (size_t)j * n, 1.0, yj );
+      memcpy( r1 + (size_t)j * n, r2 + (size_t)j * n, sizeof(double) * n );
+      memcpy( r2 + (size_t)j * n, yj, sizeof(double) * n );
+    }
+
+    ks_solver_precond( sol, nrhs, active.data(), r2, yv );
+
+    // Givens rotation of the tridiagonal, then the update of x.
+    for ( int j = 0; j < nrhs; j ++ ) {
+      double oldeps, delta, gbar, gamma, phi;
+      double *vj = v + (size_t)j * n, *wj = w + (size_t)j * n;
+      double *w1j = w1 + (size_t)j * n, *w2j = w2 + (size_t)j * n;
+      double *xj = x + (size_t)j * ldx;
+
+      if ( !active[ j ] ) continue;
+
+      oldb[ j ]  = beta[ j ];
+      beta[ j ]  = sqrt( ks_dot( n, r2 + (size_t)j * n, yv + (size_t)j * n ) );
+      oldeps     = epsln[ j ];
+      delta      = cs[ j ] * dbar[ j ] + sn[ j ] * alfa[ j ];
+      gbar       = sn[ j ] * dbar[ j ] - cs[ j ] * alfa[ j ];
+      epsln[ j ] = sn[ j ] * beta[ j ];
+      dbar[ j ]  = -cs[ j ] * beta[ j ];
+      gamma      = sqrt( gbar * gbar + beta[ j ] * beta[ j ] );
+      if ( gamma == 0.0 ) gamma = 1E-300;
+      cs[ j ]    = gbar / gamma;
+      sn[ j ]    = beta[ j ] / gamma;
+      phi        = cs[ j ] * phibar[ j ];
+      phibar[ j ] = sn[ j ] * phibar[ j ];
+
+      #pragma omp parallel for
+      for ( int i = 0; i < n; i ++ ) {
+        w1j[ i ] = w2j[ i ];
+        w2j[ i ] = wj[ i ];
+        wj[ i ]  = ( vj[ i ] - oldeps * w1j[ i ] - delta * w2j[ i ] ) / gamma;
+        xj[ i ] += phi * wj[ i ];
+      }
+
+      relres[ j ] = phibar[ j ] / beta1[ j ];
+      if ( relres[ j ] <= tol || beta[ j ] == 0.0 ) active[ j ] = 0;
+    }
+  }
+
+  return it;
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Solve ( K + lambda I ) alpha( :, j ) = y( :, j ), j < nrhs,
+ *         from a zero guess, until the relative residual is below tol or
+ *         after maxit iterations. relres ( may be NULL ) gets the final
+ *         relative residual of every right hand side. Returns the number
+ *         of iterations of the slowest one.
+ * --------------------------------------------------------------------------
+ */
+int gsks_solver_solve(
+    gsks_solver_t *sol,
+    ks_solver_method_t method,
+    int    nrhs,
+    const double *y,
+    int    ldy,
+    double *alpha,
+    int    ldalpha,
+    double tol,
+    int    maxit,
+    double *relres
+    )
+{
+  std::vector<double> res( nrhs );
+  int    it;
+
+  if ( method == KS_SOLVER_MINRES ) {
+    it = ks_solver_minres( sol, nrhs, y, ldy, alpha, ldalpha, tol, maxit, res.data() );
+  }
+  else {
+    it = ks_solver_cg( sol, nrhs, y, ldy, alpha, ldalpha, tol, maxit, res.data() );
+  }
+
+  if ( relres ) memcpy( relres, res.data(), sizeof(double) * nrhs );
+
+  return it;
+}
@@ -0,0 +1,460 @@
+/*
+ * --------------------------------------------------------------------------
+ * GSKS (General Stride Kernel Summation)
+ * --------------------------------------------------------------------------
+ * Copyright (C) 2015, The University of Texas at Austin
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ * ks_tree.c
+ *
+ * Chenhan D. Yu - Department of Computer Science,
+ *                 The University of Texas at Austin
+ *
+ *
+ * Purpose:
+ * Space partitioning tree that produces the interaction lists of
+ * omp_dgsks_list(). A node is split at the median of the coordinate with
+ * the largest spread, so the tree is balanced and stored in heap order:
+ * the children of node i are 2 i + 1 and 2 i + 2, and the leaves are the
+ * last 2^depth nodes, left to right. Each node also keeps the ball
+ * ( center, radius ) around its points, which is what the list criteria
+ * test; it is a kd-tree for the split and a ball tree for the bounds.
+ *
+ * The points are reordered in place so that every node owns a contiguous
+ * range of rows; the lists then index neighbouring rows and dgsks() packs
+ * them from a few pages. perm[] maps the new rows to the original ones.
+ *
+ *
+ * Todo:
+ *
+ *
+ * Modification:
+ *
+ *
+ * */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <ks.h>
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Reorder perm[ beg ~ end - 1 ] so that the point at mid has the
+ *         median coordinate d, with smaller or equal ones before it.
+ * --------------------------------------------------------------------------
+ */
+static void ks_tree_select(
+    double *X,
+    int    k,
+    int    d,
+    int    *perm,
+    int    beg,
+    int    end,
+    int    mid
+    )
+{
+  int    lo = beg, hi = end - 1;
+
+  while ( lo < hi ) {
+    int    i = lo, j = hi, tmp;
+    double a = X[ (size_t)perm[ lo ] * k + d ];
+    double b = X[ (size_t)perm[ ( lo + hi ) / 2 ] * k + d ];
+    double c = X[ (size_t)perm[ hi ] * k + d ];
+    double pivot;
+
+    // Median of three
+    if ( ( a <= b && b <= c ) || ( c <= b && b <= a ) ) pivot = b;
+    else if ( ( b <= a && a <= c ) || ( c <= a && a <= b ) ) pivot = a;
+    else pivot = c;
+
+    while ( i <= j ) {
+      while ( X[ (size_t)perm[ i ] * k + d ] < pivot ) i ++;
+      while ( X[ (size_t)perm[ j ] * k + d ] > pivot ) j --;
+      if ( i <= j ) {
+        tmp = perm[ i ]; perm[ i ] = perm[ j ]; perm[ j ] = tmp;
+        i ++;
+        j --;
+      }
+    }
+    if ( mid <= j ) hi = j;
+    else if ( mid >= i ) lo = i;
+    else break;
+  }
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Split node i: median of its widest coordinate.
+ * --------------------------------------------------------------------------
+ */
+static void ks_tree_split(
+    gsks_tree_t *T,
+    int    i
+    )
+{
+  int    k = T->k, beg = T->beg[ i ], end = T->end[ i ], mid, d, j;
+  int    dmax = 0;
+  double spread = -1.0;
+
+  mid = beg + ( end - beg ) / 2;
+  T->beg[ 2 * i + 1 ] = beg;
+  T->end[ 2 * i + 1 ] = mid;
+  T->beg[ 2 * i + 2 ] = mid;
+  T->end[ 2 * i + 2 ] = end;
+  if ( end - beg < 2 ) return;
+
+  for ( d = 0; d < k; d ++ ) {
+    double lo = HUGE_VAL, hi = -HUGE_VAL;
+    for ( j = beg; j < end; j ++ ) {
+      double x = T->X[ (size_t)T->perm[ j ] * k + d ];
+      if ( x < lo ) lo = x;
+      if ( x > hi ) hi = x;
+    }
+    if ( hi - lo > spread ) {
+      spread = hi - lo;
+      dmax   = d;
+    }
+  }
+
+  ks_tree_select( T->X, k, dmax, T->perm, beg, end, mid );
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Build the tree over the n points X ( n x k, row major ) with at
+ *         most leaf_size points per leaf, and reorder X in place to the
+ *         tree order. The tree keeps X; it must outlive the tree.
+ * --------------------------------------------------------------------------
+ */
+gsks_tree_t *gsks_tree_create(
+    int    n,
+    int    k,
+    double *X,
+    int    leaf_size
+    )
+{
+  gsks_tree_t *T;
+  double *copy;
+  int    i, l;
+
+  if ( leaf_size < 1 ) leaf_size = 1;
+
+  T = (gsks_tree_t*)malloc( sizeof(gsks_tree_t) );
+  T->n         = n;
+  T->k         = k;
+  T->X         = X;
+  T->leaf_size = leaf_size;
+  T->depth     = 0;
+  while ( ( (long)n + ( 1L << T->depth ) - 1 ) >> T->depth > leaf_size ) T->depth ++;
+  T->nleaf     = 1 << T->depth;
+  T->nnode     = 2 * T->nleaf - 1;
+  T->perm      = (int*)malloc( sizeof(int) * ( n + 1 ) );
+  T->beg       = (int*)malloc( sizeof(int) * T->nnode );
+  T->end       = (int*)malloc( sizeof(int) * T->nnode );
+  T->center    = ks_malloc_aligned( k, T->nnode, sizeof(double) );
+  T->radius    = ks_malloc_aligned( 1, T->nnode, sizeof(double) );
+
+  #pragma omp parallel for
+  for ( i = 0; i < n; i ++ ) T->perm[ i ] = i;
+  T->beg[ 0 ] = 0;
+  T->end[ 0 ] = n;
+
+  // Level by level; the nodes of a level own disjoint ranges of perm[].
+  for ( l = 0; l < T->depth; l ++ ) {
+    int    first = ( 1 << l ) - 1;
+
+    #pragma omp parallel for schedule( dynamic )
+    for ( i = first; i < 2 * first + 1; i ++ ) ks_tree_split( T, i );
+  }
+
+  // Move the points to the tree order.
+  copy = (double*)malloc( sizeof(double) * (size_t)n * k );
+  memcpy( copy, X, sizeof(double) * (size_t)n * k );
+  #pragma omp parallel for
+  for ( i = 0; i < n; i ++ ) {
+    memcpy( X + (size_t)i * k, copy + (size_t)T->perm[ i ] * k, sizeof(double) * k );
+  }
+  free( copy );
+
+  // Balls: the centroid and the farthest point from it. Empty nodes get
+  // a negative radius.
+  #pragma omp parallel for schedule( dynamic )
+  for ( i = 0; i < T->nnode; i ++ ) {
+    double *c = T->center + (size_t)i * k, r2 = 0.0;
+    int    j, p, cnt = T->end[ i ] - T->beg[ i ];
+
+    for ( p = 0; p < k; p ++ ) c[ p ] = 0.0;
+    for ( j = T->beg[ i ]; j < T->end[ i ]; j ++ ) {
+      for ( p = 0; p < k; p ++ ) c[ p ] += X[ (size_t)j * k + p ];
+    }
+    for ( p = 0; p < k; p ++ ) c[ p ] = cnt ? c[ p ] / cnt : 0.0;
+    for ( j = T->beg[ i ]; j < T->end[ i ]; j ++ ) {
+      double d2 = 0.0;
+      for ( p = 0; p < k; p ++ ) {
+        double t = X[ (size_t)j * k + p ] - c[ p ];
+        d2 += t * t;
+      }
+      if ( d2 > r2 ) r2 = d2;
+    }
+    T->radius[ i ] = cnt ? sqrt( r2 ) : -1.0;
+  }
+
+  return T;
+}
+
+
+
+void gsks_tree_free(
+    gsks_tree_t *T
+    )
+{
+  if ( !T ) return;
+  free( T->perm );
+  free( T->beg );
+  free( T->end );
+  ks_free_aligned( T->center );
+  ks_free_aligned( T->radius );
+  free( T );
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Rows of v ( n x ld ) from the original order to the tree order,
+ *         in place ( e.g. the weights of the sources ).
+ * --------------------------------------------------------------------------
+ */
+void gsks_tree_permute(
+    gsks_tree_t *T,
+    int    ld,
+    double *v
+    )
+{
+  double *copy = (double*)malloc( sizeof(double) * (size_t)T->n * ld );
+  int    i;
+
+  memcpy( copy, v, sizeof(double) * (size_t)T->n * ld );
+  #pragma omp parallel for
+  for ( i = 0; i < T->n; i ++ ) {
+    memcpy( v + (size_t)i * ld, copy + (size_t)T->perm[ i ] * ld, sizeof(double) * ld );
+  }
+  free( copy );
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Rows of v from the tree order back to the original order.
+ * --------------------------------------------------------------------------
+ */
+void gsks_tree_unpermute(
+    gsks_tree_t *T,
+    int    ld,
+    double *v
+    )
+{
+  double *copy = (double*)malloc( sizeof(double) * (size_t)T->n * ld );
+  int    i;
+
+  memcpy( copy, v, sizeof(double) * (size_t)T->n * ld );
+  #pragma omp parallel for
+  for ( i = 0; i < T->n; i ++ ) {
+    memcpy( v + (size_t)T->perm[ i ] * ld, copy + (size_t)i * ld, sizeof(double) * ld );
+  }
+  free( copy );
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Smallest distance between the balls of node i of T and node j
+ *         of S ( 0 if they overlap ).
+ * --------------------------------------------------------------------------
+ */
+double gsks_tree_gap(
+    gsks_tree_t *T,
+    int    i,
+    gsks_tree_t *S,
+    int    j
+    )
+{
+  double *ci = T->center + (size_t)i * T->k;
+  double *cj = S->center + (size_t)j * S->k;
+  double d2 = 0.0, gap;
+  int    p;
+
+  for ( p = 0; p < T->k; p ++ ) d2 += ( ci[ p ] - cj[ p ] ) * ( ci[ p ] - cj[ p ] );
+  gap = sqrt( d2 ) - T->radius[ i ] - S->radius[ j ];
+
+  return gap > 0.0 ? gap : 0.0;
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Near-field lists: one list per pair of leaves ( t of T, s of S )
+ *         whose balls are at most cutoff apart, so every target and
+ *         source closer than cutoff share a list. List i interacts the
+ *         points of leaf pair[ 2 i ] with those of leaf pair[ 2 i + 1 ]
+ *         ( leaf numbers, 0 ~ nleaf - 1 ), in tree order. The lists are
+ *         sorted by target leaf, then source leaf. S may be T.
+ *
+ *         The result is in the CSR form of omp_dgsks_list(), with NULL
+ *         uptr / uidx and wptr / widx when u and w are in tree order:
+ *
+ *         omp_dgsks_list( kernel, k, L->n_list, u, NULL, NULL,
+ *             XA, XA2, L->aptr, L->aidx, XB, XB2, L->bptr, L->bidx,
+ *             w, NULL, NULL );
+ *
+ *         The CSR offsets are int; a cutoff whose lists hold more than
+ *         INT_MAX targets or sources in total ( or INT_MAX / 2 lists )
+ *         is an error.
+ * --------------------------------------------------------------------------
+ */
+gsks_lists_t *gsks_tree_near_lists(
+    gsks_tree_t *T,
+    gsks_tree_t *S,
+    double cutoff
+    )
+{
+  gsks_lists_t *L;
+  int    **near, *nnear, t, i, j, n_list;
+  long   na = 0, nb = 0, nl = 0;
+
+  if ( T->k != S->k ) {
+    printf( "gsks_tree_near_lists(): T and S must have the same dimension.\n" );
+    exit( 1 );
+  }
+
+  near  = (int**)malloc( sizeof(int*) * T->nleaf );
+  nnear = (int*)malloc( sizeof(int) * T->nleaf );
+
+  // Each target leaf walks S from the root and prunes distant balls.
+  #pragma omp parallel for schedule( dynamic )
+  for ( t = 0; t < T->nleaf; t ++ ) {
+    int    node = T->nleaf - 1 + t, cap = 16, top = 0;
+    int    stack[ 64 ];
+
+    near[ t ]  = (int*)malloc( sizeof(int) * cap );
+    nnear[ t ] = 0;
+    if ( T->radius[ node ] < 0.0 ) continue;
+
+    stack[ top ++ ] = 0;
+    while ( top > 0 ) {
+      int    s = stack[ -- top ];
+
+      if ( S->radius[ s ] < 0.0 ) continue;
+      if ( gsks_tree_gap( T, node, S, s ) > cutoff ) continue;
+      if ( s >= S->nleaf - 1 ) {
+        if ( nnear[ t ] == cap ) {
+          cap *= 2;
+          near[ t ] = (int*)realloc( near[ t ], sizeof(int) * cap );
+        }
+        near[ t ][ nnear[ t ] ++ ] = s - ( S->nleaf - 1 );
+      }
+      else {
+        // Right child first, so leaves come out left to right.
+        stack[ top ++ ] = 2 * s + 2;
+        stack[ top ++ ] = 2 * s + 1;
+      }
+    }
+  }
+
+  for ( t = 0; t < T->nleaf; t ++ ) {
+    int    node = T->nleaf - 1 + t;
+    nl += nnear[ t ];
+    for ( i = 0; i < nnear[ t ]; i ++ ) {
+      int    s = S->nleaf - 1 + near[ t ][ i ];
+      na += T->end[ node ] - T->beg[ node ];
+      nb += S->end[ s ] - S->beg[ s ];
+    }
+  }
+
+  if ( nl >= INT_MAX / 2 || na >= INT_MAX || nb >= INT_MAX ) {
+    printf( "gsks_tree_near_lists(): %ld lists of %ld targets and %ld sources overflow int offsets, lower the cutoff.\n", nl, na, nb );
+    exit( 1 );
+  }
+  n_list = (int)nl;
+
+  L = (gsks_lists_t*)malloc( sizeof(gsks_lists_t) );
+  L->n_list = n_list;
+  L->pair   = (int*)malloc( sizeof(int) * 2 * ( n_list + 1 ) );
+  L->aptr   = (int*)malloc( sizeof(int) * ( n_list + 1 ) );
+  L->bptr   = (int*)malloc( sizeof(int) * ( n_list + 1 ) );
+  L->aidx   = (int*)malloc( sizeof(int) * ( na + 1 ) );
+  L->bidx   = (int*)malloc( sizeof(int) * ( nb + 1 ) );
+
+  L->aptr[ 0 ] = 0;
+  L->bptr[ 0 ] = 0;
+  for ( t = 0, i = 0; t < T->nleaf; t ++ ) {
+    int    node = T->nleaf - 1 + t;
+    for ( j = 0; j < nnear[ t ]; j ++, i ++ ) {
+      int    s = S->nleaf - 1 + near[ t ][ j ];
+      L->pair[ 2 * i     ] = t;
+      L->pair[ 2 * i + 1 ] = near[ t ][ j ];
+      L->aptr[ i + 1 ] = L->aptr[ i ] + T->end[ node ] - T->beg[ node ];
+      L->bptr[ i + 1 ] = L->bptr[ i ] + S->end[ s ] - S->beg[ s ];
+    }
+  }
+
+  #pragma omp parallel for schedule( dynamic )
+  for ( i = 0; i < n_list; i ++ ) {
+    int    node = T->nleaf - 1 + L->pair[ 2 * i ];
+    int    s    = S->nleaf - 1 + L->pair[ 2 * i + 1 ];
+    int    p;
+    for ( p = 0; p < L->aptr[ i + 1 ] - L->aptr[ i ]; p ++ ) {
+      L->aidx[ L->aptr[ i ] + p ] = T->beg[ node ] + p;
+    }
+    for ( p = 0; p < L->bptr[ i + 1 ] - L->bptr[ i ]; p ++ ) {
+      L->bidx[ L->bptr[ i ] + p ] = S->beg[ s ] + p;
+    }
+  }
+
+  for ( t = 0; t < T->nleaf; t ++ ) free( near[ t ] );
+  free( near );
+  free( nnear );
+
+  return L;
+}
+
+
+
+void gsks_lists_free(
+    gsks_lists_t *L
+    )
+{
+  if ( !L ) return;
+  free( L->pair );
+  free( L->aptr );
+  free( L->aidx );
+  free( L->bptr );
+  free( L->bidx );
+  free( L );
+}
@@ -0,0 +1,415 @@
+/*
+ * --------------------------------------------------------------------------
+ * GSKS (General Stride Kernel Summation)
+ * --------------------------------------------------------------------------
+ * Copyright (C) 2015, The University of Texas at Austin
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ * ks_treecode.cpp
+ *
+ * Chenhan D. Yu - Department of Computer Science,
+ *                 The University of Texas at Austin
+ *
+ *
+ * Purpose:
+ * Barnes-Hut style treecode on the trees of ks_tree.c. Every target leaf
+ * t walks the source tree; a source node s is far from t if
+ *
+ *   radius( t ) + radius( s ) <= theta * | center( t ) - center( s ) |,
+ *
+ * and then interacts with the representatives of s instead of its points.
+ * Otherwise s is opened, down to the leaves, which are summed directly.
+ * The representatives of s are the centroids of its descendants rep_level
+ * levels below ( or its leaves ), each carrying the summed weights of its
+ * points; rep_level = 0 is the classic monopole. Smaller theta and larger
+ * rep_level are more accurate; theta is the main accuracy knob, and for a
+ * fixed theta the work is O( N log N ).
+ *
+ * Near and far interactions are two list sets for omp_dgsks_list(): the
+ * near field on the points, the far field on the node centroids with the
+ * aggregated weights, so both run on the dgsks() micro-kernels.
+ *
+ * With gsks_treecode_set_skel() the representatives of a far node are
+ * its skeleton points ( ks_skel.c ) instead, and the weights are the
+ * skeleton weights; the classification is unchanged, so the far field
+ * still costs O( N log N s ) for skeletons of size s, not O( N s ).
+ *
+ *
+ * Todo:
+ *
+ *
+ * Modification:
+ *
+ *
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <math.h>
+#include <omp.h>
+#include <vector>
+#include <algorithm>
+
+extern "C" {
+#include <ks.h>
+}
+#include <omp_dgsks_list.hpp>
+
+
+struct treecode_s {
+  gsks_tree_t *T;
+  gsks_tree_t *S;
+  double theta;
+  int    rep_level;
+
+  double *XT2;              // square norms of the points and centroids
+  double *XS2;
+  double *CS2;
+  double *wr;               // aggregated weights, nnode x KS_RHS
+
+  // One near list on the points of S and one far list on the nodes of S
+  // per target leaf; far list l holds the representatives of the source
+  // nodes fnode[ fnptr[ l ] ] ~ fnode[ fnptr[ l + 1 ] - 1 ].
+  std::vector<int> nptr, naidx, nbptr, nbidx;
+  std::vector<int> fptr, faidx, fbptr, fbidx;
+  std::vector<int> fnptr, fnode;
+
+  // Far lists on the skeletons: points sbidx, weights swidx of wskel.
+  gsks_skel_t *skel;
+  double *wskel;
+  std::vector<int> sptr, saidx, sbptr, sbidx, swidx;
+};
+
+
+static double *ks_treecode_norms( int n, int k, double *X )
+{
+  double *X2 = ks_malloc_aligned( 1, n + 1, sizeof(double) );
+
+  #pragma omp parallel for
+  for ( int i = 0; i < n; i ++ ) {
+    double tmp = 0.0;
+    for ( int p = 0; p < k; p ++ ) tmp += X[ (size_t)i * k + p ] * X[ (size_t)i * k + p ];
+    X2[ i ] = tmp;
+  }
+
+  return X2;
+}
+
+
+static inline int ks_tree_level( int node )
+{
+  int    l = 0;
+  while ( ( 2 << l ) - 1 <= node ) l ++;
+  return l;
+}
+
+
+static inline void ks_list_push_range(
+    std::vector<int> &idx,
+    int    beg,
+    int    end
+    )
+{
+  for ( int i = beg; i < end; i ++ ) idx.push_back( i );
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Classify the node pairs and build the near and far lists. The
+ *         trees must outlive the treecode; S may be T.
+ * --------------------------------------------------------------------------
+ */
+gsks_treecode_t *gsks_treecode_create(
+    gsks_tree_t *T,
+    gsks_tree_t *S,
+    double theta,
+    int    rep_level
+    )
+{
+  gsks_treecode_t *tc;
+  int    nleaf = T->nleaf;
+
+  if ( T->k != S->k ) {
+    printf( "gsks_treecode_create(): T and S must have the same dimension.\n" );
+    exit( 1 );
+  }
+
+  tc = new gsks_treecode_t;
+  tc->T         = T;
+  tc->S         = S;
+  tc->theta     = theta;
+  tc->rep_level = rep_level < 0 ? 0 : rep_level;
+  tc->XT2       = ks_treecode_norms( T->n, T->k, T->X );
+  tc->XS2       = ks_treecode_norms( S->n, S->k, S->X );
+  tc->CS2       = ks_treecode_norms( S->nnode, S->k, S->center );
+  tc->wr        = ks_malloc_aligned( KS_RHS, S->nnode, sizeof(double) );
+  tc->skel      = NULL;
+  tc->wskel     = NULL;
+
+  std::vector< std::vector<int> > near( nleaf ), far( nleaf );
+
+  #pragma omp parallel for schedule( dynamic )
+  for ( int t = 0; t < nleaf; t ++ ) {
+    int    node = nleaf - 1 + t, top = 0;
+    int    stack[ 64 ];
+    double *ct = T->center + (size_t)node * T->k;
+
+    if ( T->radius[ node ] < 0.0 ) continue;
+
+    stack[ top ++ ] = 0;
+    while ( top > 0 ) {
+      int    s = stack[ -- top ], size = S->end[ s ] - S->beg[ s ];
+      int    nrep = 1 << std::min( tc->rep_level, S->depth - ks_tree_level( s ) );
+      double *cs = S->center + (size_t)s * S->k, d2 = 0.0;
+
+      if ( S->radius[ s ] < 0.0 ) continue;
+      for ( int p = 0; p < T->k; p ++ ) d2 += ( ct[ p ] - cs[ p ] ) * ( ct[ p ] - cs[ p ] );
+
+      // Far, unless the representatives are not fewer than the points.
+      if ( T->radius[ node ] + S->radius[ s ] <= theta * sqrt( d2 ) && nrep < size ) {
+        far[ t ].push_back( s );
+      }
+      else if ( s >= S->nleaf - 1 ) {
+        near[ t ].push_back( s );
+      }
+      else {
+        stack[ top ++ ] = 2 * s + 2;
+        stack[ top ++ ] = 2 * s + 1;
+      }
+    }
+  }
+
+  // One list per target leaf; the int offsets must hold all of them.
+  long   nl = 0, na = 0, nb = 0;
+
+  for ( int t = 0; t < nleaf; t ++ ) {
+    int    node = nleaf - 1 + t;
+
+    if ( !near[ t ].empty() ) na += T->end[ node ] - T->beg[ node ];
+    if ( !far[ t ].empty() )  na += T->end[ node ] - T->beg[ node ];
+    nl += !near[ t ].empty() + !far[ t ].empty();
+    for ( size_t j = 0; j < near[ t ].size(); j ++ ) {
+      nb += S->end[ near[ t ][ j ] ] - S->beg[ near[ t ][ j ] ];
+    }
+    for ( size_t j = 0; j < far[ t ].size(); j ++ ) {
+      nb += 1 << std::min( tc->rep_level, S->depth - ks_tree_level( far[ t ][ j ] ) );
+    }
+  }
+
+  if ( nl >= INT_MAX / 2 || na >= INT_MAX || nb >= INT_MAX ) {
+    printf( "gsks_treecode_create(): %ld lists of %ld targets and %ld sources overflow int offsets, raise theta.\n", nl, na, nb );
+    exit( 1 );
+  }
+
+  tc->nptr.assign( 1, 0 );
+  tc->nbptr.assign( 1, 0 );
+  tc->fptr.assign( 1, 0 );
+  tc->fbptr.assign( 1, 0 );
+  tc->fnptr.assign( 1, 0 );
+  for ( int t = 0; t < nleaf; t ++ ) {
+    int    node = nleaf - 1 + t;
+
+    if ( !near[ t ].empty() ) {
+      ks_list_push_range( tc->naidx, T->beg[ node ], T->end[ node ] );
+      for ( size_t j = 0; j < near[ t ].size(); j ++ ) {
+        int    s = near[ t ][ j ];
+        ks_list_push_range( tc->nbidx, S->beg[ s ], S->end[ s ] );
+      }
+      tc->nptr.push_back( tc->naidx.size() );
+      tc->nbptr.push_back( tc->nbidx.size() );
+    }
+
+    // The descendants of s d levels down are a contiguous range of nodes.
+    if ( !far[ t ].empty() ) {
+      ks_list_push_range( tc->faidx, T->beg[ node ], T->end[ node ] );
+      for ( size_t j = 0; j < far[ t ].size(); j ++ ) {
+        int    s = far[ t ][ j ];
+        int    d = std::min( tc->rep_level, S->depth - ks_tree_level( s ) );
+        tc->fnode.push_back( s );
+        ks_list_push_range( tc->fbidx,
+            ( s + 1 ) * ( 1 << d ) - 1, ( s + 2 ) * ( 1 << d ) - 1 );
+      }
+      tc->fptr.push_back( tc->faidx.size() );
+      tc->fbptr.push_back( tc->fbidx.size() );
+      tc->fnptr.push_back( tc->fnode.size() );
+    }
+  }
+
+  return tc;
+}
+
+
+
+void gsks_treecode_free(
+    gsks_treecode_t *tc
+    )
+{
+  if ( !tc ) return;
+  ks_free_aligned( tc->XT2 );
+  ks_free_aligned( tc->XS2 );
+  ks_free_aligned( tc->CS2 );
+  ks_free_aligned( tc->wr );
+  ks_free_aligned( tc->wskel );
+  delete tc;
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Near and far list counts of the treecode, at most one of
+ *         each per target leaf.
+ * --------------------------------------------------------------------------
+ */
+void gsks_treecode_stat(
+    gsks_treecode_t *tc,
+    int    *n_near,
+    int    *n_far
+    )
+{
+  *n_near = tc->nptr.size() - 1;
+  *n_far  = tc->fptr.size() - 1;
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Use the skeletons sk of S as the far field representatives.
+ *         Far nodes with an empty skeleton ( a numerically zero block )
+ *         add nothing; a leaf whose far nodes all have one is dropped.
+ * --------------------------------------------------------------------------
+ */
+void gsks_treecode_set_skel(
+    gsks_treecode_t *tc,
+    gsks_skel_t *sk
+    )
+{
+  int    n_far = tc->fptr.size() - 1;
+
+  if ( sk->S != tc->S ) {
+    printf( "gsks_treecode_set_skel(): sk must skeletonize the source tree.\n" );
+    exit( 1 );
+  }
+
+  ks_free_aligned( tc->wskel );
+  tc->skel  = sk;
+  tc->wskel = ks_malloc_aligned( KS_RHS, sk->sptr[ tc->S->nnode ] + 1, sizeof(double) );
+  tc->sptr.assign( 1, 0 );
+  tc->sbptr.assign( 1, 0 );
+  tc->saidx.clear();
+  tc->sbidx.clear();
+  tc->swidx.clear();
+
+  for ( int l = 0; l < n_far; l ++ ) {
+    size_t nskel = tc->sbidx.size();
+
+    for ( int j = tc->fnptr[ l ]; j < tc->fnptr[ l + 1 ]; j ++ ) {
+      int    s = tc->fnode[ j ];
+      tc->sbidx.insert( tc->sbidx.end(), sk->sidx + sk->sptr[ s ], sk->sidx + sk->sptr[ s + 1 ] );
+      ks_list_push_range( tc->swidx, sk->sptr[ s ], sk->sptr[ s + 1 ] );
+    }
+    if ( tc->sbidx.size() == nskel ) continue;
+    tc->saidx.insert( tc->saidx.end(),
+        tc->faidx.begin() + tc->fptr[ l ], tc->faidx.begin() + tc->fptr[ l + 1 ] );
+    tc->sptr.push_back( tc->saidx.size() );
+    tc->sbptr.push_back( tc->sbidx.size() );
+  }
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  u += K( T, S ) w, approximately. u and w are in the tree orders
+ *         of T and S ( gsks_tree_permute() ). The variable bandwidth
+ *         kernel has no bandwidth for the centroids and needs skeletons.
+ * --------------------------------------------------------------------------
+ */
+void gsks_treecode_eval(
+    ks_t   *kernel,
+    gsks_treecode_t *tc,
+    double *u,
+    double *w
+    )
+{
+  gsks_tree_t *T = tc->T, *S = tc->S;
+  int    n_near = tc->nptr.size() - 1, n_far = tc->fptr.size() - 1;
+  int    n_skel = tc->sptr.size() - 1;
+
+  if ( kernel->type == KS_GAUSSIAN_VAR_BANDWIDTH && !tc->skel ) {
+    printf( "gsks_treecode_eval(): variable bandwidth needs skeletons.\n" );
+    exit( 1 );
+  }
+
+  if ( n_near > 0 ) {
+    omp_dgsks_list(
+        kernel, T->k, n_near,
+        u,                  NULL, NULL,
+        T->X, tc->XT2,      tc->nptr.data(),  tc->naidx.data(),
+        S->X, tc->XS2,      tc->nbptr.data(), tc->nbidx.data(),
+        w,                  NULL, NULL
+        );
+  }
+
+  if ( tc->skel ) {
+    gsks_skel_weights( tc->skel, w, tc->wskel );
+    if ( n_skel > 0 ) {
+      omp_dgsks_list(
+          kernel, T->k, n_skel,
+          u,                  NULL, NULL,
+          T->X, tc->XT2,      tc->sptr.data(),  tc->saidx.data(),
+          S->X, tc->XS2,      tc->sbptr.data(), tc->sbidx.data(),
+          tc->wskel,          tc->sbptr.data(), tc->swidx.data()
+          );
+    }
+    return;
+  }
+
+  // Upward pass: weights of the leaves, then of their ancestors.
+  #pragma omp parallel for
+  for ( int l = 0; l < S->nleaf; l ++ ) {
+    int    node = S->nleaf - 1 + l;
+    for ( int p = 0; p < KS_RHS; p ++ ) {
+      double sum = 0.0;
+      for ( int i = S->beg[ node ]; i < S->end[ node ]; i ++ ) sum += w[ i * KS_RHS + p ];
+      tc->wr[ node * KS_RHS + p ] = sum;
+    }
+  }
+  for ( int lvl = S->depth - 1; lvl >= 0; lvl -- ) {
+    #pragma omp parallel for
+    for ( int node = ( 1 << lvl ) - 1; node < ( 2 << lvl ) - 1; node ++ ) {
+      for ( int p = 0; p < KS_RHS; p ++ ) {
+        tc->wr[ node * KS_RHS + p ] = tc->wr[ ( 2 * node + 1 ) * KS_RHS + p ] +
+                                      tc->wr[ ( 2 * node + 2 ) * KS_RHS + p ];
+      }
+    }
+  }
+
+  if ( n_far > 0 ) {
+    omp_dgsks_list(
+        kernel, T->k, n_far,
+        u,                  NULL, NULL,
+        T->X, tc->XT2,      tc->fptr.data(),  tc->faidx.data(),
+        S->center, tc->CS2, tc->fbptr.data(), tc->fbidx.data(),
+        tc->wr,             NULL, NULL
+        );
+  }
+}
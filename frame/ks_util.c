@@ -23,6 +23,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <omp.h>
 #include <ks.h>
 #include <gsks_config.h>
@@ -53,3 +54,439 @@ double *ks_malloc_aligned(
 
   return ptr;
 }
+
+
+
+/*
+ * Release a ks_malloc_aligned() buffer ( hbw_free() on MIC ). NULL is
+ * ignored.
+ */
+void ks_free_aligned(
+    void   *ptr
+    )
+{
+  if ( !ptr ) return;
+#ifdef GSKS_MIC_AVX512
+  hbw_free( ptr );
+#else
+  free( ptr );
+#endif
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * Huge page backed buffers.
+ *
+ * A multi-MB packB spans hundreds of 4KB pages, and the micro-kernel
+ * stream through it misses the TLB. ks_malloc_huge() maps buffers of at
+ * least half a huge page with 2MB aligned anonymous memory, depending on
+ * KS_HUGEPAGE:
+ *
+ *   0   regular ks_malloc_aligned() pages,
+ *   1   transparent huge pages ( madvise( MADV_HUGEPAGE ) ), default,
+ *   2   explicit hugetlbfs pages ( MAP_HUGETLB ), falling back to 1.
+ *
+ * Every path falls back to ks_malloc_aligned(). Buffers must be released
+ * with ks_free_huge(), which keeps the mapping for the next request of
+ * the same thread, kind and NUMA node, so repeated dgsks() calls do not
+ * mmap, fault and munmap their buffers every time. Each thread remembers the slot it
+ * used last for every kind, so a repeated request and its release take
+ * no lock. A mapping is replaced when a larger one is needed, unmapped
+ * when its thread exits, and reclaimed when the table runs out of slots;
+ * ks_hugepage_release() unmaps every idle mapping at once. The counters
+ * record what each buffer kind got; with transparent huge pages the
+ * kernel may still use small pages if no 2MB frame is free.
+ * --------------------------------------------------------------------------
+ */
+#if !defined( GSKS_MIC_AVX512 ) && defined( __linux__ )
+#include <sys/mman.h>
+#define KS_HUGE_MMAP
+#endif
+
+#define KS_HUGE_MAX_MAP 256
+
+static ks_hugepage_stat_t ks_huge_stat;
+
+#ifdef KS_HUGE_MMAP
+#include <pthread.h>
+
+// Slot states; a slot is only changed by the thread that moved it out
+// of KS_HUGE_IDLE, and ptr / len / owner only under ks_huge_table.
+#define KS_HUGE_IDLE 0
+#define KS_HUGE_BUSY 1          // handed out, not yet freed
+#define KS_HUGE_DROP 2          // being unmapped
+
+typedef struct {
+  void   *ptr;
+  size_t len;
+  void   *owner;                // &ks_huge_owner of the thread
+  int    kind;
+  int    node;                  // NUMA node of the first touch
+  int    got;                   // 1 thp, 2 hugetlbfs
+  int    state;
+} ks_huge_map_t;
+
+static ks_huge_map_t  ks_huge_map[ KS_HUGE_MAX_MAP ];
+static __thread char  ks_huge_owner;
+static __thread int   ks_huge_last[ KS_BUF_NUM ];   // slot + 1, 0 if none
+static pthread_key_t  ks_huge_key;
+static pthread_once_t ks_huge_once = PTHREAD_ONCE_INIT;
+
+
+static int ks_huge_claim(
+    int    i,
+    int    from,
+    int    to
+    )
+{
+  return __atomic_compare_exchange_n( &ks_huge_map[ i ].state, &from, to, 0,
+      __ATOMIC_ACQUIRE, __ATOMIC_RELAXED );
+}
+
+
+/*
+ * Unmap the idle mappings of owner, or of every thread if owner is NULL.
+ */
+static void ks_huge_drop_idle(
+    void   *owner
+    )
+{
+  int    i;
+
+  #pragma omp critical ( ks_huge_table )
+  {
+    for ( i = 0; i < KS_HUGE_MAX_MAP; i ++ ) {
+      if ( ks_huge_map[ i ].ptr && ( !owner || ks_huge_map[ i ].owner == owner ) &&
+           ks_huge_claim( i, KS_HUGE_IDLE, KS_HUGE_DROP ) ) {
+        munmap( ks_huge_map[ i ].ptr, ks_huge_map[ i ].len );
+        ks_huge_map[ i ].ptr = NULL;
+        __atomic_store_n( &ks_huge_map[ i ].state, KS_HUGE_IDLE, __ATOMIC_RELEASE );
+      }
+    }
+  }
+}
+
+
+static void ks_huge_exit(
+    void   *arg
+    )
+{
+  ks_huge_drop_idle( arg );
+}
+
+
+static void ks_huge_key_init()
+{
+  pthread_key_create( &ks_huge_key, ks_huge_exit );
+}
+
+
+/*
+ * Hand out the smallest idle mapping of this thread, kind and NUMA node
+ * that holds len bytes; the slot used last is tried first, without the
+ * lock. A thread that moved to another node does not get pages placed
+ * on the old one. If no mapping fits, the idle ones of this thread and
+ * kind are unmapped before the caller maps a new buffer.
+ */
+static void *ks_huge_take(
+    size_t len,
+    int    kind,
+    int    node,
+    int    *got
+    )
+{
+  int    i, best = -1;
+  void   *ret = NULL;
+
+  i = ks_huge_last[ kind ] - 1;
+  if ( i >= 0 && ks_huge_claim( i, KS_HUGE_IDLE, KS_HUGE_BUSY ) ) {
+    if ( ks_huge_map[ i ].ptr && ks_huge_map[ i ].owner == &ks_huge_owner &&
+         ks_huge_map[ i ].kind == kind && ks_huge_map[ i ].node == node &&
+         ks_huge_map[ i ].len >= len ) {
+      *got = ks_huge_map[ i ].got;
+      return ks_huge_map[ i ].ptr;
+    }
+    __atomic_store_n( &ks_huge_map[ i ].state, KS_HUGE_IDLE, __ATOMIC_RELEASE );
+  }
+
+  #pragma omp critical ( ks_huge_table )
+  {
+    for ( i = 0; i < KS_HUGE_MAX_MAP; i ++ ) {
+      if ( ks_huge_map[ i ].ptr && ks_huge_map[ i ].owner == &ks_huge_owner &&
+           ks_huge_map[ i ].kind == kind && ks_huge_map[ i ].node == node &&
+           ks_huge_map[ i ].len >= len &&
+           __atomic_load_n( &ks_huge_map[ i ].state, __ATOMIC_RELAXED ) == KS_HUGE_IDLE ) {
+        if ( best < 0 || ks_huge_map[ i ].len < ks_huge_map[ best ].len ) best = i;
+      }
+    }
+    if ( best >= 0 && ks_huge_claim( best, KS_HUGE_IDLE, KS_HUGE_BUSY ) ) {
+      ret  = ks_huge_map[ best ].ptr;
+      *got = ks_huge_map[ best ].got;
+      ks_huge_last[ kind ] = best + 1;
+    }
+    else if ( best < 0 ) {
+      for ( i = 0; i < KS_HUGE_MAX_MAP; i ++ ) {
+        if ( ks_huge_map[ i ].ptr && ks_huge_map[ i ].owner == &ks_huge_owner &&
+             ks_huge_map[ i ].kind == kind &&
+             ks_huge_claim( i, KS_HUGE_IDLE, KS_HUGE_DROP ) ) {
+          munmap( ks_huge_map[ i ].ptr, ks_huge_map[ i ].len );
+          ks_huge_map[ i ].ptr = NULL;
+          __atomic_store_n( &ks_huge_map[ i ].state, KS_HUGE_IDLE, __ATOMIC_RELEASE );
+        }
+      }
+    }
+  }
+
+  return ret;
+}
+
+
+/*
+ * Remember a new mapping so that ks_free_huge() can find it. An idle
+ * mapping of any thread is reclaimed if the table is full; returns 0 if
+ * every slot is in use.
+ */
+static int ks_huge_register(
+    void   *ptr,
+    size_t len,
+    int    kind,
+    int    node,
+    int    got
+    )
+{
+  int    i, slot = -1;
+
+  pthread_once( &ks_huge_once, ks_huge_key_init );
+  pthread_setspecific( ks_huge_key, &ks_huge_owner );
+
+  #pragma omp critical ( ks_huge_table )
+  {
+    for ( i = 0; i < KS_HUGE_MAX_MAP && slot < 0; i ++ ) {
+      if ( !ks_huge_map[ i ].ptr && ks_huge_claim( i, KS_HUGE_IDLE, KS_HUGE_BUSY ) ) {
+        slot = i;
+      }
+    }
+    for ( i = 0; i < KS_HUGE_MAX_MAP && slot < 0; i ++ ) {
+      if ( ks_huge_claim( i, KS_HUGE_IDLE, KS_HUGE_BUSY ) ) {
+        if ( ks_huge_map[ i ].ptr ) munmap( ks_huge_map[ i ].ptr, ks_huge_map[ i ].len );
+        slot = i;
+      }
+    }
+    if ( slot >= 0 ) {
+      ks_huge_map[ slot ].ptr   = ptr;
+      ks_huge_map[ slot ].len   = len;
+      ks_huge_map[ slot ].owner = &ks_huge_owner;
+      ks_huge_map[ slot ].kind  = kind;
+      ks_huge_map[ slot ].node  = node;
+      ks_huge_map[ slot ].got   = got;
+      ks_huge_last[ kind ] = slot + 1;
+    }
+  }
+
+  return ( slot >= 0 );
+}
+
+
+/*
+ * 2MB aligned anonymous mapping of len bytes ( a multiple of 2MB ). The
+ * unaligned head and tail of an over-sized mapping are given back.
+ */
+static void *ks_huge_mmap_thp(
+    size_t len
+    )
+{
+  char   *ptr, *aligned;
+  size_t head, tail;
+
+  ptr = mmap( NULL, len + KS_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+  if ( ptr == MAP_FAILED ) return NULL;
+
+  aligned = (char*)( ( (size_t)ptr + KS_HUGE_PAGE_SIZE - 1 ) & ~( (size_t)KS_HUGE_PAGE_SIZE - 1 ) );
+  head    = aligned - ptr;
+  tail    = KS_HUGE_PAGE_SIZE - head;
+  if ( head ) munmap( ptr, head );
+  if ( tail ) munmap( aligned + len, tail );
+
+#ifdef MADV_HUGEPAGE
+  if ( madvise( aligned, len, MADV_HUGEPAGE ) ) {
+    munmap( aligned, len );
+    return NULL;
+  }
+  return aligned;
+#else
+  munmap( aligned, len );
+  return NULL;
+#endif
+}
+#endif
+
+
+double *ks_malloc_huge(
+    int    m,
+    int    n,
+    int    size,
+    ks_buf_t kind
+    )
+{
+  size_t bytes = (size_t)size * m * n;
+  void   *ptr = NULL;
+  int    mode = 1, got = 0;
+  char   *str;
+
+  str = getenv( "KS_HUGEPAGE" );
+  if ( str != NULL ) {
+    mode = (int)strtol( str, NULL, 10 );
+  }
+
+  if ( kind < 0 || kind >= KS_BUF_NUM ) kind = KS_BUF_OTHER;
+
+#ifdef KS_HUGE_MMAP
+  if ( mode && bytes >= KS_HUGE_PAGE_SIZE / 2 ) {
+    size_t len  = ( ( bytes - 1 ) / KS_HUGE_PAGE_SIZE + 1 ) * KS_HUGE_PAGE_SIZE;
+    int    node = ks_numa_local_node();
+
+    ptr = ks_huge_take( len, kind, node, &got );
+
+#ifdef MAP_HUGETLB
+    if ( !ptr && mode == 2 ) {
+      ptr = mmap( NULL, len, PROT_READ | PROT_WRITE,
+          MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+      if ( ptr == MAP_FAILED ) ptr = NULL;
+      if ( ptr ) got = 2;
+    }
+#endif
+    if ( !ptr ) {
+      ptr = ks_huge_mmap_thp( len );
+      if ( ptr ) got = 1;
+    }
+    if ( ptr && got && !ks_huge_register( ptr, len, kind, node, got ) ) {
+      munmap( ptr, len );
+      ptr = NULL;
+      got = 0;
+    }
+  }
+#endif
+
+  if ( !ptr ) {
+    ptr = ks_malloc_aligned( m, n, size );
+  }
+
+  __atomic_add_fetch( &ks_huge_stat.nbuf[ kind ], 1, __ATOMIC_RELAXED );
+  if ( got == 2 ) __atomic_add_fetch( &ks_huge_stat.nhugetlb[ kind ], 1, __ATOMIC_RELAXED );
+  if ( got == 1 ) __atomic_add_fetch( &ks_huge_stat.nthp[ kind ], 1, __ATOMIC_RELAXED );
+  if ( got == 0 ) __atomic_add_fetch( &ks_huge_stat.nsmall[ kind ], 1, __ATOMIC_RELAXED );
+  if ( got ) __atomic_add_fetch( &ks_huge_stat.bytes_huge, bytes, __ATOMIC_RELAXED );
+
+  return (double*)ptr;
+}
+
+
+void ks_free_huge(
+    void   *ptr
+    )
+{
+  if ( !ptr ) return;
+
+#ifdef KS_HUGE_MMAP
+  {
+    int    i, found = 0;
+
+    // A busy mapping keeps its slot, so a match is this buffer.
+    for ( i = 0; i < KS_BUF_NUM; i ++ ) {
+      int    slot = ks_huge_last[ i ] - 1;
+      if ( slot >= 0 && __atomic_load_n( &ks_huge_map[ slot ].ptr, __ATOMIC_RELAXED ) == ptr ) {
+        __atomic_store_n( &ks_huge_map[ slot ].state, KS_HUGE_IDLE, __ATOMIC_RELEASE );
+        return;
+      }
+    }
+
+    #pragma omp critical ( ks_huge_table )
+    {
+      for ( i = 0; i < KS_HUGE_MAX_MAP; i ++ ) {
+        if ( ks_huge_map[ i ].ptr == ptr ) {
+          __atomic_store_n( &ks_huge_map[ i ].state, KS_HUGE_IDLE, __ATOMIC_RELEASE );
+          found = 1;
+          break;
+        }
+      }
+    }
+    if ( found ) return;
+  }
+#endif
+
+#ifdef GSKS_MIC_AVX512
+  hbw_free( ptr );
+#else
+  free( ptr );
+#endif
+}
+
+
+void ks_hugepage_stat(
+    ks_hugepage_stat_t *stat
+    )
+{
+  #pragma omp critical ( ks_huge_stat )
+  {
+    *stat = ks_huge_stat;
+  }
+}
+
+
+void ks_hugepage_stat_reset()
+{
+  #pragma omp critical ( ks_huge_stat )
+  {
+    memset( &ks_huge_stat, 0, sizeof(ks_hugepage_stat_t) );
+  }
+}
+
+
+
+/*
+ * Unmap every idle mapping that ks_free_huge() kept, of all threads.
+ * Buffers still in use are left alone.
+ */
+void ks_hugepage_release()
+{
+#ifdef KS_HUGE_MMAP
+  ks_huge_drop_idle( NULL );
+#endif
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * Threads of the ic loop in dgsks(). KS_IC_NT sets it for the process
+ * ( default 1 ); ks_set_ic_nt() overrides it for the dgsks() calls of the
+ * calling thread only, so that a scheduler can give each task its own
+ * team. ks_set_ic_nt( 0 ) drops the override.
+ * --------------------------------------------------------------------------
+ */
+static __thread int ks_ic_nt_local = 0;
+
+void ks_set_ic_nt(
+    int    nt
+    )
+{
+  ks_ic_nt_local = ( nt > 0 ) ? nt : 0;
+}
+
+int ks_get_ic_nt()
+{
+  char   *str;
+  int    nt = 1;
+
+  if ( ks_ic_nt_local > 0 ) return ks_ic_nt_local;
+
+  str = getenv( "KS_IC_NT" );
+  if ( str != NULL ) {
+    nt = (int)strtol( str, NULL, 10 );
+  }
+
+  return nt;
+}
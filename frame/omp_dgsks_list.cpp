@@ -40,17 +40,245 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <omp.h>
+#include <sched.h>
 #include <vector>
+#include <algorithm>
+#include <unordered_map>
 #include <iostream>
-#include <deque>
 
 extern "C" {
 #include <ks.h>
+#include <ks_deque.h>
+#include <gsks_config.h>
+#include <gsks_stats.h>
 }
 #include <omp_dgsks_list.hpp> 
 
 
+// Tasks smaller than this many targets or sources are not split.
+#define KS_LIST_GRAIN 256
+
+
+/*
+ * A task is the interaction of targets [ abeg, aend ) of alist[ id ] with
+ * sources [ bbeg, bend ) of blist[ id ].
+ */
+typedef struct {
+  int    id;
+  int    abeg;
+  int    aend;
+  int    bbeg;
+  int    bend;
+} ks_task_t;
+
+
+/*
+ * Split the longer side of task in half. task keeps the front half and the
+ * back half is returned, or NULL if the task is too small to split.
+ */
+static ks_task_t *ks_task_split( ks_task_t *task )
+{
+  int       na = task->aend - task->abeg;
+  int       nb = task->bend - task->bbeg;
+  ks_task_t *half;
+
+  if ( na < 2 * KS_LIST_GRAIN && nb < 2 * KS_LIST_GRAIN ) return NULL;
+
+  half  = (ks_task_t*)malloc( sizeof(ks_task_t) );
+  *half = *task;
+  if ( na >= nb ) {
+    half->abeg = task->aend = task->abeg + na / 2;
+  }
+  else {
+    half->bbeg = task->bend = task->bbeg + nb / 2;
+  }
+
+  return half;
+}
+
+
+// Most targets of a piece, which bounds the per-thread piece buffers.
+#define KS_LIST_PIECE ( 4 * KS_LIST_GRAIN )
+
+
+/*
+ * Cut a piece off the front of task. A piece has at most KS_LIST_PIECE
+ * targets: KS_LIST_PIECE of them with all sources, or, once fewer are
+ * left, all of them with at most KS_LIST_PIECE sources. Returns 0 once
+ * task is empty.
+ */
+static int ks_task_take( ks_task_t *task, ks_task_t *piece )
+{
+  int    na = task->aend - task->abeg;
+  int    nb = task->bend - task->bbeg;
+
+  if ( na <= 0 || nb <= 0 ) return 0;
+
+  *piece = *task;
+  if ( na > KS_LIST_PIECE ) {
+    piece->aend = task->abeg = task->abeg + KS_LIST_PIECE;
+  }
+  else {
+    piece->bend = task->bbeg = task->bbeg + std::min( nb, KS_LIST_PIECE );
+  }
+
+  return 1;
+}
+
+
+// Orders task indices by decreasing predicted cost.
+struct ks_cost_greater {
+  const std::vector<double> &cost;
+  ks_cost_greater( const std::vector<double> &c ) : cost( c ) {}
+  bool operator()( int a, int b ) const { return cost[ a ] > cost[ b ]; }
+};
+
+
+// True for tasks with a thread team.
+struct ks_on_team {
+  const std::vector<int> &team;
+  ks_on_team( const std::vector<int> &t ) : team( t ) {}
+  bool operator()( int i ) const { return team[ i ] > 1; }
+};
+
+
+/*
+ * Thread teams for the largest tasks. order[] is sorted by decreasing
+ * cost. A task is a team candidate if it costs more than KS_LIST_TEAM
+ * ( default 1.0, 0 turns teams off ) times the mean load of a thread;
+ * there are fewer of those than threads. The candidates share the nthd
+ * threads in proportion to their cost, each capped by the DKS_MC blocks
+ * of its ic loop. Candidates left with one thread go back to the work
+ * stealing phase, where splitting takes care of them. Returns the number
+ * of team tasks, which lead order[], and sets team[].
+ */
+template<typename LIST>
+static int ks_list_teams(
+    int    nthd,
+    std::vector<int> &order,
+    const std::vector<double> &cost,
+    const LIST &alist,
+    std::vector<int> &team
+    )
+{
+  int    n_list = order.size(), ncand = 0, nteam = 0, used = 0;
+  double ratio = 1.0, total = 0.0, cand = 0.0;
+  char   *str = getenv( "KS_LIST_TEAM" );
+
+  if ( str != NULL ) ratio = strtod( str, NULL );
+  if ( nthd < 2 || ratio <= 0.0 ) return 0;
+
+  for ( int i = 0; i < n_list; i++ ) total += cost[ i ];
+  while ( ncand < n_list && cost[ order[ ncand ] ] > ratio * total / nthd ) {
+    cand += cost[ order[ ncand ] ];
+    ncand ++;
+  }
+  if ( ncand == 0 ) return 0;
+
+  // Proportional share rounded down, then the spare threads one by one to
+  // the task with the most cost per thread that can still use one.
+  for ( int t = 0; t < ncand; t++ ) {
+    int i   = order[ t ];
+    int cap = ( alist.size( i ) + DKS_MC - 1 ) / DKS_MC;
+    team[ i ] = std::max( 1, std::min( cap, (int)( nthd * cost[ i ] / cand ) ) );
+    used += team[ i ];
+  }
+  while ( used < nthd ) {
+    int    best = -1;
+    for ( int t = 0; t < ncand; t++ ) {
+      int i = order[ t ];
+      if ( team[ i ] >= ( alist.size( i ) + DKS_MC - 1 ) / DKS_MC ) continue;
+      if ( best < 0 || cost[ i ] / team[ i ] > cost[ best ] / team[ best ] ) best = i;
+    }
+    if ( best < 0 ) break;
+    team[ best ] ++;
+    used ++;
+  }
+
+  // Keep the team tasks in front of order[], by decreasing cost.
+  std::stable_partition( order.begin(), order.begin() + ncand,
+      ks_on_team( team ) );
+  for ( int t = 0; t < ncand; t++ ) if ( team[ order[ t ] ] > 1 ) nteam ++;
+
+  return nteam;
+}
+
+
+static ks_list_report_t ks_list_last_report;
+
+
+static double ks_imbalance( int n, const double *load, int stride )
+{
+  double max = 0.0, sum = 0.0;
+
+  for ( int i = 0; i < n; i++ ) {
+    if ( load[ i * stride ] > max ) max = load[ i * stride ];
+    sum += load[ i * stride ];
+  }
+
+  return sum > 0.0 ? max * n / sum : 1.0;
+}
+
+
+/*
+ * Record the predicted and measured balance of the last omp_dgsks_list()
+ * call, and print it if KS_LIST_REPORT is set.
+ */
+static void ks_list_report_fill(
+    int    nthd,
+    int    ntask,
+    int    nmerged,
+    int    nteam,
+    std::vector<double> &seed,
+    std::vector<double> &busy_pred,
+    std::vector<double> &busy,
+    std::vector< std::vector<ks_task_t*> > &splits,
+    double wall
+    )
+{
+  ks_list_report_t *rep = &ks_list_last_report;
+  char   *str;
+
+  rep->nthread        = nthd;
+  rep->ntask          = ntask;
+  rep->nmerged        = nmerged;
+  rep->nteam          = nteam;
+  rep->nsplit         = 0;
+  rep->predicted      = 0.0;
+  rep->actual         = 0.0;
+  for ( int i = 0; i < nthd; i++ ) {
+    rep->nsplit    += splits[ i ].size();
+    rep->predicted += busy_pred[ i * 8 ];
+    rep->actual    += busy[ i * 8 ];
+  }
+  rep->imbalance_seed = ks_imbalance( nthd, seed.data(), 1 );
+  rep->imbalance_pred = ks_imbalance( nthd, busy_pred.data(), 8 );
+  rep->imbalance      = ks_imbalance( nthd, busy.data(), 8 );
+  rep->wall           = wall;
+
+  str = getenv( "KS_LIST_REPORT" );
+  if ( str != NULL && (int)strtol( str, NULL, 10 ) ) {
+    printf( "omp_dgsks_list: %d tasks ( %d merged, %d on teams, %d splits ), %d threads, "
+        "predicted %.3E s / imbalance %.2f ( seed %.2f ), "
+        "actual %.3E s / imbalance %.2f, wall %.3E s\n",
+        rep->ntask, rep->nmerged, rep->nteam, rep->nsplit, rep->nthread,
+        rep->predicted, rep->imbalance_pred, rep->imbalance_seed,
+        rep->actual, rep->imbalance, rep->wall );
+  }
+}
+
+
+void omp_dgsks_list_report(
+    ks_list_report_t *report
+    )
+{
+  *report = ks_list_last_report;
+}
+
+
+
 
 void omp_dgsks_list_unsymmetric(
     ks_t   *kernel,
@@ -71,6 +299,8 @@ void omp_dgsks_list_unsymmetric(
   XA2  = (double*)malloc( sizeof(double) * nxa );
   XB2  = (double*)malloc( sizeof(double) * nxb );
 
+  GSKS_STATS_TIC( tic );
+
   // Compute XA2
   #pragma omp parallel for 
   for ( int i = 0; i < nxa; i ++ ) {
@@ -91,6 +321,8 @@ void omp_dgsks_list_unsymmetric(
     XB2[ i ] = tmp;
   }
 
+  GSKS_STATS_TOC( KS_PHASE_LIST_NORM, tic );
+
   // Call omp_dgsks_list()
   omp_dgsks_list(
       kernel,
@@ -130,6 +362,8 @@ void omp_dgsks_list_symmetric(
   //printf( "%d, %d\n", nxa, u.size() );
 
 
+  GSKS_STATS_TIC( tic );
+
   // Compute XA2
   #pragma omp parallel for 
   for ( int i = 0; i < nxa; i ++ ) {
@@ -139,6 +373,8 @@ void omp_dgsks_list_symmetric(
     }
     XA2[ i ] = tmp;
   }
+
+  GSKS_STATS_TOC( KS_PHASE_LIST_NORM, tic );
   
   // Call omp_dgsks_list()
   omp_dgsks_list(
@@ -187,6 +423,8 @@ void omp_dgsks_list_separated_u_unsymmetric(
   XA2  = (double*)malloc( sizeof(double) * nxa );
   XB2  = (double*)malloc( sizeof(double) * nxb );
 
+  GSKS_STATS_TIC( tic );
+
   // Compute XA2
   #pragma omp parallel for 
   for ( int i = 0; i < nxa; i ++ ) {
@@ -207,6 +445,8 @@ void omp_dgsks_list_separated_u_unsymmetric(
     XB2[ i ] = tmp;
   }
 
+  GSKS_STATS_TOC( KS_PHASE_LIST_NORM, tic );
+
   // Call omp_dgsks_list()
   omp_dgsks_list(
       kernel,
@@ -245,6 +485,8 @@ void omp_dgsks_list_separated_u_symmetric(
 
   XA2  = (double*)malloc( sizeof(double) * nxa );
 
+  GSKS_STATS_TIC( tic );
+
   // Compute XA2
   #pragma omp parallel for 
   for ( int i = 0; i < nxa; i ++ ) {
@@ -255,6 +497,8 @@ void omp_dgsks_list_separated_u_symmetric(
     XA2[ i ] = tmp;
   }
 
+  GSKS_STATS_TOC( KS_PHASE_LIST_NORM, tic );
+
   //if ( kernel->type == KS_GAUSSIAN_VAR_BANDWIDTH ) {
   //  for ( int i = 0; i < 100; i ++ ) {
   //    printf( "%5.2lf, ", kernel->h[ i ] );
@@ -294,128 +538,1412 @@ void omp_dgsks_list_separated_u_symmetric(
 }
 
 
-void omp_dgsks_list(
+/*
+ * --------------------------------------------------------------------------
+ * Views of a list set. List i has size( i ) entries starting at data( i ).
+ * Both are zero-copy wrappers of the caller's storage.
+ * --------------------------------------------------------------------------
+ */
+struct ks_list_vec {
+  std::vector< std::vector<int> > &v;
+  ks_list_vec( std::vector< std::vector<int> > &v ) : v( v ) {}
+  int  n() const { return v.size(); }
+  int  size( int i ) const { return v[ i ].size(); }
+  int  *data( int i ) const { return v[ i ].data(); }
+};
+
+struct ks_list_csr {
+  int       nlist;
+  const int *ptr;
+  const int *idx;
+  ks_list_csr( int nlist, const int *ptr, const int *idx ) :
+    nlist( nlist ), ptr( ptr ), idx( idx ) {}
+  int  n() const { return nlist; }
+  int  size( int i ) const { return ptr[ i + 1 ] - ptr[ i ]; }
+  int  *data( int i ) const { return const_cast<int*>( idx + ptr[ i ] ); }
+};
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Reproducible merge. Piece p summed its targets umap[ abeg ~ aend
+ *         - 1 ] into slot[ p ] of ubuf. The contributions are bucketed by
+ *         target in piece order, then each target adds its own in that
+ *         order. The pieces depend on the lists only, so u does not
+ *         depend on the threads or on which thread ran what.
+ * --------------------------------------------------------------------------
+ */
+template<typename LIST>
+static void ks_list_merge(
+    double *u,
+    const LIST &ulist,
+    std::vector<ks_task_t> &pieces,
+    std::vector<long> &slot,
+    std::vector<double> &ubuf
+    )
+{
+  int    nu = 0;
+
+  for ( size_t t = 0; t < pieces.size(); t++ ) {
+    int *umap = ulist.data( pieces[ t ].id );
+    for ( int i = pieces[ t ].abeg; i < pieces[ t ].aend; i++ ) {
+      if ( umap[ i ] >= nu ) nu = umap[ i ] + 1;
+    }
+  }
+
+  std::vector<long> ptr( nu + 1, 0 ), src( slot.back() / KS_RHS );
+
+  for ( size_t t = 0; t < pieces.size(); t++ ) {
+    int *umap = ulist.data( pieces[ t ].id );
+    for ( int i = pieces[ t ].abeg; i < pieces[ t ].aend; i++ ) ptr[ umap[ i ] + 1 ] ++;
+  }
+  for ( int i = 0; i < nu; i++ ) ptr[ i + 1 ] += ptr[ i ];
+  for ( size_t t = 0; t < pieces.size(); t++ ) {
+    int  *umap = ulist.data( pieces[ t ].id );
+    long off   = slot[ t ];
+    for ( int i = pieces[ t ].abeg; i < pieces[ t ].aend; i++, off += KS_RHS ) {
+      src[ ptr[ umap[ i ] ] ++ ] = off;
+    }
+  }
+  for ( int i = nu; i > 0; i-- ) ptr[ i ] = ptr[ i - 1 ];
+  ptr[ 0 ] = 0;
+
+  #pragma omp parallel for schedule( static )
+  for ( int i = 0; i < nu; i++ ) {
+    for ( long j = ptr[ i ]; j < ptr[ i + 1 ]; j++ ) {
+      for ( int p = 0; p < KS_RHS; p++ ) {
+        u[ i * KS_RHS + p ] += ubuf[ src[ j ] + p ];
+      }
+    }
+  }
+}
+
+
+
+/*
+ * The state the threads of omp_dgsks_list_sched() share. remaining counts
+ * the tasks that are queued or running, idle the threads that are
+ * stealing, and teams the team tasks that are still running.
+ */
+template<typename LIST>
+struct ks_list_work_t {
+  ks_t       *kernel;
+  int        k;
+  double     *u;
+  const LIST *ulist;
+  double     *XA;
+  double     *XA2;
+  const LIST *alist;
+  double     *XB;
+  double     *XB2;
+  const LIST *blist;
+  double     *w;
+  const LIST *wlist;
+  int        nthd;
+  int        repro;
+  int        *iota;
+  ks_deque_t *jobs;
+  int        remaining;
+  int        idle;
+  int        teams;
+  ks_task_t  *pieces;                              // reproducible mode
+  long       *slot;
+  double     *ubuf;
+  std::vector< std::vector<ks_task_t*> > *splits;
+  double     *busy;
+  double     *busy_pred;
+};
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Work stealing loop of one thread, on deque me. The thread drains
+ *         its own deque from the bottom and steals from the top of a
+ *         random victim once it runs dry. It returns once no task is
+ *         left, or, with while_teams, once the team tasks are done. Each
+ *         task runs on this thread alone ( ks_set_ic_nt( 1 ) ).
+ * --------------------------------------------------------------------------
+ */
+template<typename LIST>
+static void ks_list_worker(
+    ks_list_work_t<LIST> *wk,
+    int    me,
+    int    while_teams
+    )
+{
+  int          nthd = wk->nthd, repro = wk->repro;
+  unsigned int seed = 2 * me + 1;
+  double       *u_piece = (double*)malloc( sizeof(double) * KS_LIST_PIECE * KS_RHS );
+
+  ks_set_ic_nt( 1 );
+
+  while ( __atomic_load_n( &wk->remaining, __ATOMIC_ACQUIRE ) > 0 &&
+      ( !while_teams || __atomic_load_n( &wk->teams, __ATOMIC_ACQUIRE ) > 0 ) ) {
+    ks_task_t *task = (ks_task_t*)ks_deque_pop( &wk->jobs[ me ] );
+
+    if ( task == KS_DEQUE_EMPTY ) {
+      __atomic_add_fetch( &wk->idle, 1, __ATOMIC_RELAXED );
+      for ( int miss = 1; __atomic_load_n( &wk->remaining, __ATOMIC_ACQUIRE ) > 0; miss ++ ) {
+        void *x;
+        if ( while_teams && __atomic_load_n( &wk->teams, __ATOMIC_ACQUIRE ) == 0 ) break;
+        x = ks_deque_steal( &wk->jobs[ rand_r( &seed ) % nthd ] );
+        if ( x != KS_DEQUE_EMPTY && x != KS_DEQUE_ABORT ) {
+          task = (ks_task_t*)x;
+          break;
+        }
+        // Give the core back after a round of misses ( oversubscription ).
+        if ( miss % nthd == 0 ) sched_yield();
+      }
+      __atomic_sub_fetch( &wk->idle, 1, __ATOMIC_RELAXED );
+      if ( task == KS_DEQUE_EMPTY ) break;
+    }
+
+    int       *amap = wk->alist->data( task->id );
+    int       *umap = wk->ulist->data( task->id ); // New feature, a separate ulist
+    int       *bmap = wk->blist->data( task->id );
+    int       *wmap = wk->wlist->data( task->id );
+    ks_task_t rest = *task, piece;
+
+    // Run the task piece by piece. Before each piece, hand the back half
+    // of what is left to the thieves, once per idle thread. A task of
+    // the reproducible mode is one piece.
+    while ( 1 ) {
+      int    nidle = repro ? 0 : __atomic_load_n( &wk->idle, __ATOMIC_RELAXED );
+      double *u_out = u_piece;
+
+      for ( ; nidle > 0; nidle -- ) {
+        ks_task_t *half = ks_task_split( &rest );
+        if ( !half ) break;
+        ( *wk->splits )[ me ].push_back( half );
+        __atomic_add_fetch( &wk->remaining, 1, __ATOMIC_RELEASE );
+        ks_deque_push( &wk->jobs[ me ], half );
+      }
+
+      if ( repro ) {
+        if ( rest.aend == rest.abeg ) break;
+        piece     = rest;
+        rest.aend = rest.abeg;
+        u_out     = wk->ubuf + wk->slot[ task - wk->pieces ];
+      }
+      else if ( !ks_task_take( &rest, &piece ) ) break;
+
+      int    ma  = piece.aend - piece.abeg;
+      double beg = omp_get_wtime();
+
+      for ( int i = 0; i < ma * KS_RHS; i++ ) u_out[ i ] = 0.0;
+
+      GSKS_STATS_TIC( tic_task );
+      dgsks(
+          wk->kernel,
+          ma,
+          piece.bend - piece.bbeg,
+          wk->k,
+          u_out,
+          wk->iota,
+          wk->XA,
+          wk->XA2,
+          amap + piece.abeg,
+          wk->XB,
+          wk->XB2,
+          bmap + piece.bbeg,
+          wk->w,
+          wmap + piece.bbeg
+          );
+      GSKS_STATS_TOC( KS_PHASE_LIST_TASK, tic_task );
+
+      // Flush the piece. Other threads may hold the same targets, so the
+      // adds are atomic; there are only ma of them per ma x nb piece.
+      // The reproducible mode leaves the piece in its slot.
+      GSKS_STATS_TIC( tic_reduce );
+      for ( int i = 0; i < ma; i++ ) {
+        int ui = umap[ piece.abeg + i ];
+        for ( int p = 0; p < KS_RHS; p++ ) {
+          double val = u_out[ i * KS_RHS + p ];
+          if ( val != val ) {
+            printf( "gsks error: nan at u[%d] of task %d\n", ui, task->id );
+          }
+          if ( repro ) continue;
+          #pragma omp atomic
+          wk->u[ ui * KS_RHS + p ] += val;
+        }
+      }
+      GSKS_STATS_TOC( KS_PHASE_LIST_REDUCE, tic_reduce );
+
+      wk->busy[ me * 8 ]      += omp_get_wtime() - beg;
+      wk->busy_pred[ me * 8 ] += ks_cost_predict( wk->kernel,
+          piece.aend - piece.abeg, piece.bend - piece.bbeg, wk->k );
+    }
+
+    __atomic_sub_fetch( &wk->remaining, 1, __ATOMIC_RELEASE );
+  }
+
+  ks_set_ic_nt( 0 );
+  free( u_piece );
+}
+
+
+
+/*
+ * A scheduled task set. ks_list_sched_init() cuts the tasks ( into the
+ * pieces of the reproducible mode ), predicts their costs, sorts them,
+ * picks the thread teams and the deque every other task is seeded on.
+ * ks_list_sched_run() runs it, and may run it again on new u and w as
+ * long as the lists and the points stay the same. nmerged is only
+ * reported.
+ */
+struct ks_list_sched_t {
+  int    nthd;
+  int    ntask;
+  int    repro;
+  int    nmerged;
+  int    nteam;
+  int    nleft;
+  std::vector<ks_task_t> tasks;               // one per list
+  std::vector<ks_task_t> pieces;              // reproducible mode
+  std::vector<long>      slot;
+  std::vector<double>    ubuf;
+  std::vector<double>    cost;
+  std::vector<int>       order;               // decreasing cost, teams first
+  std::vector<int>       team;
+  std::vector<int>       des;                 // deque of order[ t ], -1 if none
+  std::vector<double>    workload;            // predicted seed load per thread
+  std::vector<int>       iota;
+  ks_deque_t             *jobs;
+};
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Build the schedule of omp_dgsks_list_sched().
+ * --------------------------------------------------------------------------
+ */
+template<typename LIST>
+static void ks_list_sched_init(
+    ks_list_sched_t *sc,
     ks_t   *kernel,
     int    k,
-    std::vector<double> &u,
-    std::vector< std::vector<int> > &ulist, // New feature, a separate ulist
-    double *XA,
-    double *XA2,
-    std::vector< std::vector<int> > &alist,
-    double *XB,
-    double *XB2,
-    std::vector< std::vector<int> > &blist,
-    double *w,
-    std::vector< std::vector<int> > &wlist
+    const LIST &alist,
+    const LIST &blist,
+    const LIST &wlist,
+    int    nmerged
     )
 {
-  int    nthd, nu, n_list;
-  double *u_local[ KS_NUM_THREAD ];
-  std::deque<int> jobs[ KS_NUM_THREAD ];
-  double workload[ KS_NUM_THREAD ];
+  int    nthd, n_list;
+  char   *str = getenv( "KS_LIST_REPRO" );
+
+  sc->nthd    = nthd = omp_get_max_threads();
+  sc->ntask   = 0;
+  sc->repro   = 0;
+  sc->nmerged = nmerged;
+  sc->nteam   = 0;
+  sc->nleft   = nthd;
+  sc->jobs    = NULL;
 
   // Early return
-  if ( alist.size() == 0 || blist.size() == 0 ) return;
+  if ( alist.n() == 0 || blist.n() == 0 ) return;
 
   // Sanity check
-  if ( ( alist.size() != blist.size() ) || ( blist.size() != wlist.size() ) ) {
+  if ( ( alist.n() != blist.n() ) || ( blist.n() != wlist.n() ) ) {
     printf( "omp_dgsks_list(): alist, blist and wlist must have the same sizes.\n" );
     exit( 1 );
   }
 
 
-  nu     = u.size();
-  n_list = alist.size();
+  n_list = alist.n();
+  if ( str != NULL ) sc->repro = (int)strtol( str, NULL, 10 );
 
-  // Initialize u_local to prevent race conditions 
-  for ( int i = 0; i < KS_NUM_THREAD; i++ ) {
-    u_local[ i ] = (double*)malloc( sizeof(double) * nu );
-    for ( int j = 0; j < nu; j++ ) {
-      u_local[ i ][ j ] = 0.0;
-    }
-  }
+  sc->tasks.resize( n_list );
+  sc->cost.resize( n_list );
+  sc->order.resize( n_list );
 
-  //printf( "Finish Initialize u_local\n" );
+  // Each piece accumulates into a compact per-thread buffer of its own
+  // targets, which is then added to u. The buffers only need the
+  // KS_LIST_PIECE targets of a piece, instead of a copy of u per thread.
+  sc->iota.resize( KS_LIST_PIECE );
+  for ( int i = 0; i < KS_LIST_PIECE; i++ ) sc->iota[ i ] = i;
 
 
-  // Initialize workload
-  for ( int i = 0; i < KS_NUM_THREAD; i++ ) workload[ i ] = 0.0;
-  
+  GSKS_STATS_TIC( tic_sched );
 
-  // Enqueue with a load greedy load-balanced strategy.
-  // TODO: implement weighted load-balanced stragegy in the future.
+  // Seed the deques greedily with the largest predicted task first
+  // ( ks_cost.c ); stealing and splitting fix what the model gets wrong.
   for ( int i = 0; i < n_list; i++ ) {
+    sc->tasks[ i ].id   = i;
+    sc->tasks[ i ].abeg = 0;
+    sc->tasks[ i ].aend = alist.size( i );
+    sc->tasks[ i ].bbeg = 0;
+    sc->tasks[ i ].bend = blist.size( i );
+    sc->cost[ i ]  = ks_cost_predict( kernel, alist.size( i ), blist.size( i ), k );
+    sc->order[ i ] = i;
+  }
+
+  // Reproducible mode: the pieces become the tasks.
+  sc->slot.assign( 1, 0 );
+  if ( sc->repro ) {
+    for ( int i = 0; i < n_list; i++ ) {
+      ks_task_t rest = sc->tasks[ i ], piece;
+      while ( ks_task_take( &rest, &piece ) ) {
+        sc->pieces.push_back( piece );
+        sc->slot.push_back( sc->slot.back() + (long)( piece.aend - piece.abeg ) * KS_RHS );
+      }
+    }
+    sc->ubuf.resize( sc->slot.back() );
+    sc->cost.resize( sc->pieces.size() );
+    sc->order.resize( sc->pieces.size() );
+    for ( size_t t = 0; t < sc->pieces.size(); t++ ) {
+      sc->cost[ t ]  = ks_cost_predict( kernel, sc->pieces[ t ].aend - sc->pieces[ t ].abeg,
+          sc->pieces[ t ].bend - sc->pieces[ t ].bbeg, k );
+      sc->order[ t ] = t;
+    }
+  }
+  sc->ntask = sc->order.size();
+
+  sc->jobs = (ks_deque_t*)ks_malloc_aligned( nthd, 1, sizeof(ks_deque_t) );
+  for ( int i = 0; i < nthd; i++ ) ks_deque_init( &sc->jobs[ i ], sc->ntask / nthd + 1 );
+  std::sort( sc->order.begin(), sc->order.end(), ks_cost_greater( sc->cost ) );
+
+  // Tasks that cost more than a fair share of a thread run first, each
+  // on a team of its own ( see ks_list_teams() ).
+  sc->team.assign( n_list, 1 );
+  if ( !sc->repro ) sc->nteam = ks_list_teams( nthd, sc->order, sc->cost, alist, sc->team );
+  for ( int t = 0; t < sc->nteam; t++ ) sc->nleft -= sc->team[ sc->order[ t ] ];
+
+  sc->workload.assign( nthd, 0.0 );
+  sc->des.assign( sc->ntask, -1 );
+  for ( int t = sc->nteam; t < sc->ntask; t++ ) {
+    int    i       = sc->order[ t ];
     int    des     = 0;
-    double cost    = ( (double)alist[ i ].size() ) * blist[ i ].size();
-    double minload = workload[ des ];
-    for ( int j = 0; j < KS_NUM_THREAD; j++ ) {
-      if ( workload[ j ] < minload ) {
+    double minload = sc->workload[ des ];
+    ks_task_t *task = sc->repro ? &sc->pieces[ i ] : &sc->tasks[ i ];
+
+    if ( task->aend == task->abeg || task->bend == task->bbeg ) continue;
+
+    for ( int j = 0; j < nthd; j++ ) {
+      if ( sc->workload[ j ] < minload ) {
         des     = j;
-        minload = workload[ j ];
+        minload = sc->workload[ j ];
       }
     }
-    workload[ des ] += cost;
-    jobs[ des ].push_back( i );
+    sc->workload[ des ] += sc->cost[ i ];
+    sc->des[ t ] = des;
   }
-  
 
-  //printf( "Finish jobs distribution: %d workers\n", KS_NUM_THREAD );
+  GSKS_STATS_TOC( KS_PHASE_LIST_SCHED, tic_sched );
+}
+
+
+
+static void ks_list_sched_free(
+    ks_list_sched_t *sc
+    )
+{
+  if ( !sc->jobs ) return;
+  for ( int i = 0; i < sc->nthd; i++ ) ks_deque_free( &sc->jobs[ i ] );
+  ks_free_aligned( sc->jobs );
+  sc->jobs = NULL;
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Run a schedule of ks_list_sched_init() on the same lists. u is
+ *         indexed through ulist like in dgsks(): u[ ulist * KS_RHS + p ].
+ *         The deques are refilled from the recorded seeding; the tasks
+ *         themselves are never changed, splits are new tasks freed here.
+ * --------------------------------------------------------------------------
+ */
+template<typename LIST>
+static void ks_list_sched_run(
+    ks_list_sched_t *sc,
+    ks_t   *kernel,
+    int    k,
+    double *u,
+    const LIST &ulist,
+    double *XA,
+    double *XA2,
+    const LIST &alist,
+    double *XB,
+    double *XB2,
+    const LIST &blist,
+    double *w,
+    const LIST &wlist
+    )
+{
+  int    nthd = sc->nthd, nteam = sc->nteam, nleft = sc->nleft;
+  int    remaining = 0;
+  ks_deque_t *jobs = sc->jobs;
+
+  if ( !jobs ) return;
+
+  std::vector< std::vector<ks_task_t*> > splits( nthd );
+
+  // Predicted and measured dgsks time of each thread, a cache line apart.
+  std::vector<double>     busy_pred( nthd * 8, 0.0 );
+  std::vector<double>     busy( nthd * 8, 0.0 );
+  double                  wall = omp_get_wtime();
 
+  GSKS_STATS_TIC( tic_seed );
 
-  // Dequeue in parallel with omp parallel for
-  #pragma omp parallel for num_threads( KS_NUM_THREAD )
-  for ( int i = 0; i < KS_NUM_THREAD; i++ ) {
-    while ( !jobs[ i ].empty() ) {
-      int tar = jobs[ i ].front();
+  for ( int t = nteam; t < sc->ntask; t++ ) {
+    int    i = sc->order[ t ];
 
-      //printf( "job id = %d\n", tar );
+    if ( sc->des[ t ] < 0 ) continue;
+    ks_deque_push( &jobs[ sc->des[ t ] ], sc->repro ? &sc->pieces[ i ] : &sc->tasks[ i ] );
+    remaining ++;
+  }
+
+  GSKS_STATS_TOC( KS_PHASE_LIST_SCHED, tic_seed );
+
+  ks_list_work_t<LIST> wk;
+
+  wk.kernel    = kernel;
+  wk.k         = k;
+  wk.u         = u;
+  wk.ulist     = &ulist;
+  wk.XA        = XA;
+  wk.XA2       = XA2;
+  wk.alist     = &alist;
+  wk.XB        = XB;
+  wk.XB2       = XB2;
+  wk.blist     = &blist;
+  wk.w         = w;
+  wk.wlist     = &wlist;
+  wk.nthd      = nthd;
+  wk.repro     = sc->repro;
+  wk.iota      = sc->iota.data();
+  wk.jobs      = jobs;
+  wk.remaining = remaining;
+  wk.idle      = 0;
+  wk.teams     = nteam;
+  wk.pieces    = sc->pieces.data();
+  wk.slot      = sc->slot.data();
+  wk.ubuf      = sc->ubuf.data();
+  wk.splits    = &splits;
+  wk.busy      = busy.data();
+  wk.busy_pred = busy_pred.data();
 
-      std::vector<int>& amap = alist[ tar ];
-      std::vector<int>& umap = ulist[ tar ]; // New feature, a separate ulist
-      std::vector<int>& bmap = blist[ tar ];
-      std::vector<int>& wmap = wlist[ tar ];
+  // The team tasks run next to the nleft threads they leave over, which
+  // work on the seeded deques in the meantime instead of idling.
+  if ( nteam ) {
+    int lvl = omp_get_max_active_levels();
 
-      //printf( "amap.size() = %d, bmap.size() = %d\n", amap.size(), bmap.size() );
+    if ( nteam + nleft > 1 && lvl < 2 ) omp_set_max_active_levels( 2 );
 
-      if ( amap.size() != 0 && bmap.size() != 0 ) {
+    #pragma omp parallel num_threads( nteam + nleft )
+    {
+      int tid = omp_get_thread_num();
+      int nth = omp_get_num_threads();
+
+      for ( int t = tid; t < nteam; t += nth ) {
+        int    i  = sc->order[ t ];
+        int    ma = alist.size( i );
+        int    *umap = ulist.data( i );
+        int    *imap = (int*)malloc( sizeof(int) * ma );
+        double *u_team = (double*)malloc( sizeof(double) * ma * KS_RHS );
+
+        for ( int j = 0; j < ma; j++ ) imap[ j ] = j;
+        for ( int j = 0; j < ma * KS_RHS; j++ ) u_team[ j ] = 0.0;
+
+        GSKS_STATS_TIC( tic_task );
+        ks_set_ic_nt( sc->team[ i ] );
         dgsks(
             kernel,
-            amap.size(),
-            bmap.size(),
+            ma,
+            blist.size( i ),
             k,
-            u_local[ i ],
-            umap.data(),
+            u_team,
+            imap,
             XA,
             XA2,
-            amap.data(),
+            alist.data( i ),
             XB,
             XB2,
-            bmap.data(),
+            blist.data( i ),
             w,
-            wmap.data()
+            wlist.data( i )
             );
+        ks_set_ic_nt( 0 );
+        GSKS_STATS_TOC( KS_PHASE_LIST_TASK, tic_task );
+
+        for ( int j = 0; j < ma; j++ ) {
+          for ( int p = 0; p < KS_RHS; p++ ) {
+            #pragma omp atomic
+            u[ umap[ j ] * KS_RHS + p ] += u_team[ j * KS_RHS + p ];
+          }
+        }
+        free( imap );
+        free( u_team );
+        __atomic_sub_fetch( &wk.teams, 1, __ATOMIC_RELEASE );
       }
-      
-      //printf( "Finish\n" );
 
-      // Pop the job out to decrease the number of remaining jobs
-      jobs[ i ].pop_front();
+      // Team threads join once their task is done, on the deques after
+      // those of the nleft threads.
+      ks_list_worker( &wk, tid < nteam ? nleft + tid : tid - nteam, 1 );
     }
+
+    if ( nteam + nleft > 1 && lvl < 2 ) omp_set_max_active_levels( lvl );
   }
 
-  // Merge u_local back to u in sequential
-  for ( int i = 0; i < KS_NUM_THREAD; i++ ) {
-    for ( int j = 0; j < nu; j++ ) {
-	  if ( u_local[ i ][ j ] != u_local[ i ][ j ] ) {
-		printf( "gsks error: nan at ulocal[%d][%d]\n", i, j );
-	  }
-      u[ j ] += u_local[ i ][ j ];
-    }
+  // All threads steal what is left.
+  #pragma omp parallel num_threads( nthd )
+  {
+    ks_list_worker( &wk, omp_get_thread_num(), 0 );
+  }
+
+  if ( sc->repro ) {
+    GSKS_STATS_TIC( tic_merge );
+    ks_list_merge( u, ulist, sc->pieces, sc->slot, sc->ubuf );
+    GSKS_STATS_TOC( KS_PHASE_LIST_REDUCE, tic_merge );
   }
 
-  // Free u_local and return
-  for ( int i = 0; i < KS_NUM_THREAD; i++ ) {
-    free( u_local[ i ] );
+  ks_list_report_fill( nthd, alist.n(), sc->nmerged, nteam, sc->workload,
+      busy_pred, busy, splits, omp_get_wtime() - wall );
+
+  for ( int i = 0; i < nthd; i++ ) {
+    for ( size_t j = 0; j < splits[ i ].size(); j++ ) free( splits[ i ][ j ] );
   }
 }
 
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  The scheduler behind both list interfaces: build the schedule,
+ *         run it once. u is indexed through ulist like in dgsks():
+ *         u[ ulist * KS_RHS + p ]. nmerged is only reported.
+ *
+ *         With KS_LIST_REPRO=1 the result is bitwise the same for any
+ *         number of threads: every task is cut up front into the pieces
+ *         ks_task_take() would run, there are no teams and no splits,
+ *         and each piece writes its own slot, merged by ks_list_merge().
+ *         Stealing still balances the pieces. dgsks() itself sums each
+ *         target in an order that only depends on the piece.
+ * --------------------------------------------------------------------------
+ */
+template<typename LIST>
+static void omp_dgsks_list_sched(
+    ks_t   *kernel,
+    int    k,
+    double *u,
+    const LIST &ulist,
+    double *XA,
+    double *XA2,
+    const LIST &alist,
+    double *XB,
+    double *XB2,
+    const LIST &blist,
+    double *w,
+    const LIST &wlist,
+    int    nmerged
+    )
+{
+  ks_list_sched_t sc;
+
+  ks_list_sched_init( &sc, kernel, k, alist, blist, wlist, nmerged );
+  ks_list_sched_run( &sc, kernel, k, u, ulist, XA, XA2, alist,
+      XB, XB2, blist, w, wlist );
+  ks_list_sched_free( &sc );
+}
+
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * Task coalescing.
+ *
+ * Interaction lists repeat the same target set with many source sets, and
+ * the other way around. Tasks with equal ( alist, ulist ) are merged into
+ * one task whose blist and wlist are the concatenation of theirs; this is
+ * the same sum, but the targets are gathered, packed ( packA, packA2 ) and
+ * accumulated ( packu ) once per piece instead of once per task, and the
+ * sources stream through as one long panel sequence. Tasks left alone are
+ * then merged by equal ( blist, wlist ) the same way, concatenating the
+ * targets. KS_LIST_COALESCE=0 turns it off.
+ * --------------------------------------------------------------------------
+ */
+template<typename LIST>
+static unsigned long long ks_list_hash(
+    const LIST &x,
+    const LIST &y,
+    int    i
+    )
+{
+  unsigned long long h = 14695981039346656037ULL;
+  const int *a = x.data( i ), *b = y.data( i );
+  int    na = x.size( i ), nb = y.size( i );
+
+  h = ( h ^ (unsigned int)na ) * 1099511628211ULL;
+  for ( int j = 0; j < na; j++ ) h = ( h ^ (unsigned int)a[ j ] ) * 1099511628211ULL;
+  h = ( h ^ (unsigned int)nb ) * 1099511628211ULL;
+  for ( int j = 0; j < nb; j++ ) h = ( h ^ (unsigned int)b[ j ] ) * 1099511628211ULL;
+
+  return h;
+}
+
+template<typename LIST>
+static bool ks_list_equal(
+    const LIST &x,
+    const LIST &y,
+    int    i,
+    int    j
+    )
+{
+  if ( x.size( i ) != x.size( j ) || y.size( i ) != y.size( j ) ) return false;
+  return std::equal( x.data( i ), x.data( i ) + x.size( i ), x.data( j ) ) &&
+         std::equal( y.data( i ), y.data( i ) + y.size( i ), y.data( j ) );
+}
+
+/*
+ * Group the tasks with grouped[ i ] == 0 by equal ( x, y ) lists. head[ i ]
+ * is the first task of i's group and next[] chains the group. Members of
+ * groups of two or more are marked in grouped[]. Returns the number of
+ * tasks merged into an earlier one.
+ */
+template<typename LIST>
+static int ks_list_group(
+    const LIST &x,
+    const LIST &y,
+    std::vector<char> &grouped,
+    std::vector<int> &head,
+    std::vector<int> &next
+    )
+{
+  int    n = x.n(), nmerged = 0;
+  std::vector<unsigned long long> hash( n );
+  std::vector<int> tail( n );
+  std::unordered_map< unsigned long long, std::vector<int> > bucket;
+
+  #pragma omp parallel for schedule( dynamic, 16 )
+  for ( int i = 0; i < n; i++ ) {
+    if ( !grouped[ i ] ) hash[ i ] = ks_list_hash( x, y, i );
+  }
+
+  for ( int i = 0; i < n; i++ ) {
+    head[ i ] = i;
+    next[ i ] = -1;
+    tail[ i ] = i;
+    if ( grouped[ i ] ) continue;
+
+    std::vector<int> &heads = bucket[ hash[ i ] ];
+    for ( size_t j = 0; j < heads.size(); j++ ) {
+      if ( ks_list_equal( x, y, heads[ j ], i ) ) {
+        head[ i ] = heads[ j ];
+        break;
+      }
+    }
+    if ( head[ i ] == i ) {
+      heads.push_back( i );
+    }
+    else {
+      next[ tail[ head[ i ] ] ] = i;
+      tail[ head[ i ] ] = i;
+      nmerged ++;
+    }
+  }
+
+  for ( int i = 0; i < n; i++ ) {
+    if ( !grouped[ i ] && ( head[ i ] != i || next[ i ] >= 0 ) ) grouped[ i ] = 1;
+  }
+
+  return nmerged;
+}
+
+/*
+ * The lists of the coalesced tasks. List g is list map[ g ] of the
+ * caller's x if map[ g ] >= 0, otherwise merged list ~map[ g ], which is
+ * idx[ ptr[ ~map[ g ] ] ] ~ idx[ ptr[ ~map[ g ] + 1 ] - 1 ]. Only the
+ * merged side of a group is copied.
+ */
+template<typename LIST>
+struct ks_list_mix {
+  const LIST &x;
+  const int  *map;
+  const long *ptr;
+  const int  *idx;
+  int        ngroup;
+  ks_list_mix( const LIST &x, int ngroup, const int *map, const long *ptr,
+      const int *idx ) :
+    x( x ), map( map ), ptr( ptr ), idx( idx ), ngroup( ngroup ) {}
+  int  n() const { return ngroup; }
+  int  size( int g ) const {
+    return map[ g ] >= 0 ? x.size( map[ g ] ) : (int)( ptr[ ~map[ g ] + 1 ] - ptr[ ~map[ g ] ] );
+  }
+  int  *data( int g ) const {
+    return map[ g ] >= 0 ? x.data( map[ g ] ) : const_cast<int*>( idx + ptr[ ~map[ g ] ] );
+  }
+};
+
+/*
+ * Append the lists of x along the chain next[] from i as one merged list.
+ * Returns false, leaving idx alone, if it would be longer than an int
+ * can count.
+ */
+template<typename LIST>
+static bool ks_list_append(
+    std::vector<int> &map,
+    std::vector<long> &ptr,
+    std::vector<int> &idx,
+    const LIST &x,
+    int    i,
+    const std::vector<int> &next
+    )
+{
+  long   len = 0;
+
+  for ( int j = i; j >= 0; j = next[ j ] ) len += x.size( j );
+  if ( len > INT_MAX ) return false;
+
+  map.push_back( ~(int)( ptr.size() - 1 ) );
+  for ( int j = i; j >= 0; j = next[ j ] ) {
+    idx.insert( idx.end(), x.data( j ), x.data( j ) + x.size( j ) );
+  }
+  ptr.push_back( idx.size() );
+
+  return true;
+}
+
+
+
+/*
+ * The coalesced lists. Group g of x is the view
+ * ks_list_mix( x, ngroup, xmap, xptr, xidx ) ( see above ).
+ */
+struct ks_list_groups_t {
+  int    ngroup;
+  int    nmerged;
+  std::vector<int>  umap, amap, bmap, wmap;
+  std::vector<long> uptr, aptr, bptr, wptr;
+  std::vector<int>  uidx, aidx, bidx, widx;
+};
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Coalesce the tasks ( see above ) into gr. Only the merged side
+ *         of each group is copied, into CSR form with long offsets;
+ *         everything else points at the caller's lists. Returns false,
+ *         for the caller to run the lists as they are, if coalescing is
+ *         off, merges nothing, or a merged list would be longer than
+ *         INT_MAX.
+ * --------------------------------------------------------------------------
+ */
+template<typename LIST>
+static bool ks_list_coalesce(
+    ks_list_groups_t *gr,
+    const LIST &ulist,
+    const LIST &alist,
+    const LIST &blist,
+    const LIST &wlist
+    )
+{
+  int    n_list = alist.n();
+  char   *str = getenv( "KS_LIST_COALESCE" );
+
+  if ( n_list < 2 || ulist.n() != n_list || blist.n() != n_list ||
+      wlist.n() != n_list || ( str != NULL && !(int)strtol( str, NULL, 10 ) ) ) {
+    return false;
+  }
+
+  GSKS_STATS_TIC( tic_coalesce );
+
+  std::vector<char> grouped( n_list, 0 );
+  std::vector<int>  ahead( n_list ), anext( n_list );
+  std::vector<int>  bhead( n_list ), bnext( n_list );
+  std::vector<char> by_target;
+
+  // Shared targets first, then shared sources among the rest.
+  gr->nmerged  = ks_list_group( alist, ulist, grouped, ahead, anext );
+  by_target    = grouped;
+  gr->nmerged += ks_list_group( blist, wlist, grouped, bhead, bnext );
+
+  GSKS_STATS_TOC( KS_PHASE_LIST_SCHED, tic_coalesce );
+
+  if ( gr->nmerged == 0 ) return false;
+
+  GSKS_STATS_TIC( tic_build );
+
+  bool   fits = true;
+
+  gr->uptr.assign( 1, 0 );
+  gr->aptr.assign( 1, 0 );
+  gr->bptr.assign( 1, 0 );
+  gr->wptr.assign( 1, 0 );
+
+  for ( int i = 0; i < n_list && fits; i++ ) {
+    if ( by_target[ i ] ) {
+      if ( ahead[ i ] != i ) continue;
+      gr->umap.push_back( i );
+      gr->amap.push_back( i );
+      fits = ks_list_append( gr->bmap, gr->bptr, gr->bidx, blist, i, anext ) &&
+             ks_list_append( gr->wmap, gr->wptr, gr->widx, wlist, i, anext );
+    }
+    else if ( grouped[ i ] ) {
+      if ( bhead[ i ] != i ) continue;
+      fits = ks_list_append( gr->umap, gr->uptr, gr->uidx, ulist, i, bnext ) &&
+             ks_list_append( gr->amap, gr->aptr, gr->aidx, alist, i, bnext );
+      gr->bmap.push_back( i );
+      gr->wmap.push_back( i );
+    }
+    else {
+      gr->umap.push_back( i );
+      gr->amap.push_back( i );
+      gr->bmap.push_back( i );
+      gr->wmap.push_back( i );
+    }
+  }
+  gr->ngroup = gr->amap.size();
+
+  GSKS_STATS_TOC( KS_PHASE_LIST_SCHED, tic_build );
+
+  return fits;
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Coalesce the tasks and run the scheduler. A merged list longer
+ *         than INT_MAX runs without coalescing.
+ * --------------------------------------------------------------------------
+ */
+template<typename LIST>
+static void omp_dgsks_list_run(
+    ks_t   *kernel,
+    int    k,
+    double *u,
+    const LIST &ulist,
+    double *XA,
+    double *XA2,
+    const LIST &alist,
+    double *XB,
+    double *XB2,
+    const LIST &blist,
+    double *w,
+    const LIST &wlist
+    )
+{
+  ks_list_groups_t gr;
+
+  if ( !ks_list_coalesce( &gr, ulist, alist, blist, wlist ) ) {
+    omp_dgsks_list_sched( kernel, k, u, ulist, XA, XA2, alist,
+        XB, XB2, blist, w, wlist, 0 );
+    return;
+  }
+
+  omp_dgsks_list_sched(
+      kernel, k,
+      u,        ks_list_mix<LIST>( ulist, gr.ngroup, gr.umap.data(), gr.uptr.data(), gr.uidx.data() ),
+      XA, XA2,  ks_list_mix<LIST>( alist, gr.ngroup, gr.amap.data(), gr.aptr.data(), gr.aidx.data() ),
+      XB, XB2,  ks_list_mix<LIST>( blist, gr.ngroup, gr.bmap.data(), gr.bptr.data(), gr.bidx.data() ),
+      w,        ks_list_mix<LIST>( wlist, gr.ngroup, gr.wmap.data(), gr.wptr.data(), gr.widx.data() ),
+      gr.nmerged
+      );
+}
+
+void omp_dgsks_list(
+    ks_t   *kernel,
+    int    k,
+    std::vector<double> &u,
+    std::vector< std::vector<int> > &ulist, // New feature, a separate ulist
+    double *XA,
+    double *XA2,
+    std::vector< std::vector<int> > &alist,
+    double *XB,
+    double *XB2,
+    std::vector< std::vector<int> > &blist,
+    double *w,
+    std::vector< std::vector<int> > &wlist
+    )
+{
+  omp_dgsks_list_run(
+      kernel, k,
+      u.data(), ks_list_vec( ulist ),
+      XA, XA2,  ks_list_vec( alist ),
+      XB, XB2,  ks_list_vec( blist ),
+      w,        ks_list_vec( wlist )
+      );
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  CSR overload. List i of x is xidx[ xptr[ i ] ] ~ xidx[ xptr[ i + 1 ]
+ *         - 1 ], so xptr has n_list + 1 entries. The arrays are used in
+ *         place. uptr and uidx may be NULL to use alist as ulist, wptr
+ *         and widx may be NULL to use blist as wlist.
+ * --------------------------------------------------------------------------
+ */
+void omp_dgsks_list(
+    ks_t   *kernel,
+    int    k,
+    int    n_list,
+    double *u,
+    const int *uptr,
+    const int *uidx,
+    double *XA,
+    double *XA2,
+    const int *aptr,
+    const int *aidx,
+    double *XB,
+    double *XB2,
+    const int *bptr,
+    const int *bidx,
+    double *w,
+    const int *wptr,
+    const int *widx
+    )
+{
+  if ( !uptr || !uidx ) {
+    uptr = aptr;
+    uidx = aidx;
+  }
+  if ( !wptr || !widx ) {
+    wptr = bptr;
+    widx = bidx;
+  }
+
+  omp_dgsks_list_run(
+      kernel, k,
+      u,        ks_list_csr( n_list, uptr, uidx ),
+      XA, XA2,  ks_list_csr( n_list, aptr, aidx ),
+      XB, XB2,  ks_list_csr( n_list, bptr, bidx ),
+      w,        ks_list_csr( n_list, wptr, widx )
+      );
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Make the cached norms and bandwidth factors of the points in
+ *         the lists ready. Points outside every list are not touched.
+ * --------------------------------------------------------------------------
+ */
+template<typename LIST>
+static void ks_list_require(
+    gsks_points_t *pts,
+    const LIST &list
+    )
+{
+  #pragma omp parallel for schedule( dynamic )
+  for ( int i = 0; i < list.n(); i ++ ) {
+    gsks_points_require( pts, list.size( i ), list.data( i ) );
+  }
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  omp_dgsks_list_run() on dataset handles. For the variable
+ *         bandwidth kernel the cached factors of A and B are used as hi
+ *         and hj if both handles have bandwidths; otherwise kernel->hi
+ *         and hj are used as given.
+ * --------------------------------------------------------------------------
+ */
+template<typename LIST>
+static void omp_dgsks_list_points(
+    ks_t   *kernel,
+    double *u,
+    const LIST &ulist,
+    gsks_points_t *A,
+    const LIST &alist,
+    gsks_points_t *B,
+    const LIST &blist,
+    double *w,
+    const LIST &wlist
+    )
+{
+  ks_t   ker = *kernel;
+
+  if ( A->k != B->k ) {
+    printf( "omp_dgsks_list(): A and B must have the same dimension.\n" );
+    exit( 1 );
+  }
+
+  GSKS_STATS_TIC( tic );
+  ks_list_require( A, alist );
+  ks_list_require( B, blist );
+  GSKS_STATS_TOC( KS_PHASE_LIST_NORM, tic );
+
+  if ( ker.type == KS_GAUSSIAN_VAR_BANDWIDTH && A->hfac && B->hfac ) {
+    ker.hi = A->hfac;
+    ker.hj = B->hfac;
+  }
+
+  omp_dgsks_list_run(
+      &ker, A->k,
+      u,               ulist,
+      A->X, A->X2,     alist,
+      B->X, B->X2,     blist,
+      w,               wlist
+      );
+}
+
+
+
+void omp_dgsks_list_unsymmetric(
+    ks_t   *kernel,
+    std::vector<double> &u,
+    gsks_points_t *A,
+    std::vector< std::vector<int> > &alist,
+    gsks_points_t *B,
+    std::vector< std::vector<int> > &blist,
+    double *w,
+    std::vector< std::vector<int> > &wlist
+    )
+{
+  omp_dgsks_list_points(
+      kernel,
+      u.data(), ks_list_vec( alist ), // Use an unified ulist
+      A,        ks_list_vec( alist ),
+      B,        ks_list_vec( blist ),
+      w,        ks_list_vec( wlist )
+      );
+}
+
+void omp_dgsks_list_symmetric(
+    ks_t   *kernel,
+    std::vector<double> &u,
+    gsks_points_t *A,
+    std::vector< std::vector<int> > &alist,
+    std::vector< std::vector<int> > &blist,
+    double *w,
+    std::vector< std::vector<int> > &wlist
+    )
+{
+  omp_dgsks_list_points(
+      kernel,
+      u.data(), ks_list_vec( alist ), // Use an unified ulist
+      A,        ks_list_vec( alist ),
+      A,        ks_list_vec( blist ),
+      w,        ks_list_vec( wlist )
+      );
+}
+
+void omp_dgsks_list_separated_u_unsymmetric(
+    ks_t   *kernel,
+    std::vector<double> &u,
+    std::vector< std::vector<int> > &ulist,
+    gsks_points_t *A,
+    std::vector< std::vector<int> > &alist,
+    gsks_points_t *B,
+    std::vector< std::vector<int> > &blist,
+    double *w,
+    std::vector< std::vector<int> > &wlist
+    )
+{
+  omp_dgsks_list_points(
+      kernel,
+      u.data(), ks_list_vec( ulist ),
+      A,        ks_list_vec( alist ),
+      B,        ks_list_vec( blist ),
+      w,        ks_list_vec( wlist )
+      );
+}
+
+void omp_dgsks_list_separated_u_symmetric(
+    ks_t   *kernel,
+    std::vector<double> &u,
+    std::vector< std::vector<int> > &ulist,
+    gsks_points_t *A,
+    std::vector< std::vector<int> > &alist,
+    std::vector< std::vector<int> > &blist,
+    double *w,
+    std::vector< std::vector<int> > &wlist
+    )
+{
+  omp_dgsks_list_points(
+      kernel,
+      u.data(), ks_list_vec( ulist ),
+      A,        ks_list_vec( alist ),
+      A,        ks_list_vec( blist ),
+      w,        ks_list_vec( wlist )
+      );
+}
+
+void omp_dgsks_list(
+    ks_t   *kernel,
+    int    n_list,
+    double *u,
+    const int *uptr,
+    const int *uidx,
+    gsks_points_t *A,
+    const int *aptr,
+    const int *aidx,
+    gsks_points_t *B,
+    const int *bptr,
+    const int *bidx,
+    double *w,
+    const int *wptr,
+    const int *widx
+    )
+{
+  if ( !uptr || !uidx ) {
+    uptr = aptr;
+    uidx = aidx;
+  }
+  if ( !wptr || !widx ) {
+    wptr = bptr;
+    widx = bidx;
+  }
+
+  omp_dgsks_list_points(
+      kernel,
+      u,  ks_list_csr( n_list, uptr, uidx ),
+      A,  ks_list_csr( n_list, aptr, aidx ),
+      B,  ks_list_csr( n_list, bptr, bidx ),
+      w,  ks_list_csr( n_list, wptr, widx )
+      );
+}
+
+
+
+/*
+ * A coalesced and scheduled CSR list set on dataset handles, for calls
+ * that repeat the same lists with new u and w ( see the header ).
+ */
+struct ks_list_plan_s {
+  ks_t             kernel;
+  gsks_points_t    *A;
+  gsks_points_t    *B;
+  ks_list_csr      ulist;
+  ks_list_csr      alist;
+  ks_list_csr      blist;
+  ks_list_csr      wlist;
+  ks_list_groups_t groups;
+  ks_list_sched_t  sched;
+  ks_list_plan_s( ks_t *kernel, gsks_points_t *A, gsks_points_t *B,
+      const ks_list_csr &ulist, const ks_list_csr &alist,
+      const ks_list_csr &blist, const ks_list_csr &wlist ) :
+    kernel( *kernel ), A( A ), B( B ), ulist( ulist ), alist( alist ),
+    blist( blist ), wlist( wlist ) {}
+};
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Coalesce and schedule the CSR lists of omp_dgsks_list() on
+ *         handles once, and make the norms of the points in them ready.
+ *         The lists are used in place and must outlive the plan, so must
+ *         A and B.
+ * --------------------------------------------------------------------------
+ */
+ks_list_plan_t *omp_dgsks_list_plan(
+    ks_t   *kernel,
+    int    n_list,
+    const int *uptr,
+    const int *uidx,
+    gsks_points_t *A,
+    const int *aptr,
+    const int *aidx,
+    gsks_points_t *B,
+    const int *bptr,
+    const int *bidx,
+    const int *wptr,
+    const int *widx
+    )
+{
+  ks_list_plan_t   *plan;
+  ks_list_groups_t *gr;
+
+  if ( !uptr || !uidx ) {
+    uptr = aptr;
+    uidx = aidx;
+  }
+  if ( !wptr || !widx ) {
+    wptr = bptr;
+    widx = bidx;
+  }
+  if ( A->k != B->k ) {
+    printf( "omp_dgsks_list(): A and B must have the same dimension.\n" );
+    exit( 1 );
+  }
+
+  plan = new ks_list_plan_t( kernel, A, B,
+      ks_list_csr( n_list, uptr, uidx ), ks_list_csr( n_list, aptr, aidx ),
+      ks_list_csr( n_list, bptr, bidx ), ks_list_csr( n_list, wptr, widx ) );
+  gr   = &plan->groups;
+
+  GSKS_STATS_TIC( tic );
+  ks_list_require( A, plan->alist );
+  ks_list_require( B, plan->blist );
+  GSKS_STATS_TOC( KS_PHASE_LIST_NORM, tic );
+
+  if ( plan->kernel.type == KS_GAUSSIAN_VAR_BANDWIDTH && A->hfac && B->hfac ) {
+    plan->kernel.hi = A->hfac;
+    plan->kernel.hj = B->hfac;
+  }
+
+  // Lists that do not coalesce run as they are, through identity maps.
+  if ( !ks_list_coalesce( gr, plan->ulist, plan->alist, plan->blist, plan->wlist ) ) {
+    *gr = ks_list_groups_t();
+    gr->ngroup  = n_list;
+    gr->nmerged = 0;
+    gr->umap.resize( n_list );
+    for ( int i = 0; i < n_list; i++ ) gr->umap[ i ] = i;
+    gr->amap = gr->bmap = gr->wmap = gr->umap;
+  }
+
+  ks_list_sched_init( &plan->sched, &plan->kernel, A->k,
+      ks_list_mix<ks_list_csr>( plan->alist, gr->ngroup, gr->amap.data(), gr->aptr.data(), gr->aidx.data() ),
+      ks_list_mix<ks_list_csr>( plan->blist, gr->ngroup, gr->bmap.data(), gr->bptr.data(), gr->bidx.data() ),
+      ks_list_mix<ks_list_csr>( plan->wlist, gr->ngroup, gr->wmap.data(), gr->wptr.data(), gr->widx.data() ),
+      gr->nmerged );
+
+  return plan;
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  u += K w over the lists of plan, like omp_dgsks_list() on the
+ *         handles, without coalescing, scheduling or norm checks.
+ * --------------------------------------------------------------------------
+ */
+void omp_dgsks_list_execute(
+    ks_list_plan_t *plan,
+    double *u,
+    double *w
+    )
+{
+  ks_list_groups_t *gr = &plan->groups;
+
+  ks_list_sched_run( &plan->sched, &plan->kernel, plan->A->k,
+      u,                          ks_list_mix<ks_list_csr>( plan->ulist, gr->ngroup, gr->umap.data(), gr->uptr.data(), gr->uidx.data() ),
+      plan->A->X, plan->A->X2,    ks_list_mix<ks_list_csr>( plan->alist, gr->ngroup, gr->amap.data(), gr->aptr.data(), gr->aidx.data() ),
+      plan->B->X, plan->B->X2,    ks_list_mix<ks_list_csr>( plan->blist, gr->ngroup, gr->bmap.data(), gr->bptr.data(), gr->bidx.data() ),
+      w,                          ks_list_mix<ks_list_csr>( plan->wlist, gr->ngroup, gr->wmap.data(), gr->wptr.data(), gr->widx.data() )
+      );
+}
+
+
+
+void omp_dgsks_list_plan_free(
+    ks_list_plan_t *plan
+    )
+{
+  if ( !plan ) return;
+  ks_list_sched_free( &plan->sched );
+  delete plan;
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Incremental list update. The weights w[ changed_wmap[ c ] ]
+ *         changed by delta_w[ c * KS_RHS + p ], c = 0 ~ n_changed - 1;
+ *         u gets the change of every task instead of a full recompute.
+ *         Task i only sums over its sources with a changed weight, with
+ *         dgsks_delta() on targets[ i ], the packed alist[ i ].
+ *
+ *         targets is the caller's cache of packed targets: it is resized
+ *         to the number of lists, a handle is created the first time its
+ *         task is hit and kept for later calls. Free the handles with
+ *         gsks_targets_free() once XA or the lists change.
+ * --------------------------------------------------------------------------
+ */
+void omp_dgsks_list_delta(
+    ks_t   *kernel,
+    int    k,
+    std::vector<double> &u,
+    std::vector< std::vector<int> > &ulist,
+    double *XA,
+    double *XA2,
+    std::vector< std::vector<int> > &alist,
+    double *XB,
+    double *XB2,
+    std::vector< std::vector<int> > &blist,
+    std::vector< std::vector<int> > &wlist,
+    std::vector<gsks_targets_t*> &targets,
+    int    n_changed,
+    int    *changed_wmap,
+    double *delta_w
+    )
+{
+  int    n_list = alist.size(), nw = 0, maxa = 0;
+
+  if ( n_changed <= 0 || n_list == 0 ) return;
+
+  if ( ( alist.size() != blist.size() ) || ( blist.size() != wlist.size() ) ) {
+    printf( "omp_dgsks_list_delta(): alist, blist and wlist must have the same sizes.\n" );
+    exit( 1 );
+  }
+
+  targets.resize( n_list, NULL );
+
+  // pos[ wi ] is the change of weight wi, or -1.
+  for ( int c = 0; c < n_changed; c++ ) nw = std::max( nw, changed_wmap[ c ] + 1 );
+  std::vector<int> pos( nw, -1 );
+  for ( int c = 0; c < n_changed; c++ ) pos[ changed_wmap[ c ] ] = c;
+
+  for ( int i = 0; i < n_list; i++ ) maxa = std::max( maxa, (int)alist[ i ].size() );
+  std::vector<int> iota( maxa );
+  for ( int i = 0; i < maxa; i++ ) iota[ i ] = i;
+
+  #pragma omp parallel
+  {
+    std::vector<int>    bmap;
+    std::vector<double> dw, u_task;
+
+    // Tasks are narrow now; each runs on one thread.
+    ks_set_ic_nt( 1 );
+
+    #pragma omp for schedule( dynamic )
+    for ( int i = 0; i < n_list; i++ ) {
+      int    ma = alist[ i ].size();
+
+      bmap.clear();
+      dw.clear();
+      for ( size_t j = 0; j < wlist[ i ].size(); j++ ) {
+        int wi = wlist[ i ][ j ];
+        if ( wi < nw && pos[ wi ] >= 0 ) {
+          bmap.push_back( blist[ i ][ j ] );
+          dw.insert( dw.end(), delta_w + pos[ wi ] * KS_RHS,
+              delta_w + ( pos[ wi ] + 1 ) * KS_RHS );
+        }
+      }
+      if ( bmap.empty() || ma == 0 ) continue;
+
+      if ( !targets[ i ] ) {
+        targets[ i ] = gsks_targets_create( kernel, ma, k, XA, XA2, alist[ i ].data() );
+      }
+
+      u_task.assign( ma * KS_RHS, 0.0 );
+
+      GSKS_STATS_TIC( tic_task );
+      dgsks_delta(
+          kernel,
+          targets[ i ],
+          u_task.data(),
+          iota.data(),
+          bmap.size(),
+          XB,
+          XB2,
+          bmap.data(),
+          dw.data()
+          );
+      GSKS_STATS_TOC( KS_PHASE_LIST_TASK, tic_task );
+
+      GSKS_STATS_TIC( tic_reduce );
+      for ( int j = 0; j < ma; j++ ) {
+        for ( int p = 0; p < KS_RHS; p++ ) {
+          #pragma omp atomic
+          u[ ulist[ i ][ j ] * KS_RHS + p ] += u_task[ j * KS_RHS + p ];
+        }
+      }
+      GSKS_STATS_TOC( KS_PHASE_LIST_REDUCE, tic_reduce );
+    }
+
+    ks_set_ic_nt( 0 );
+  }
+}
@@ -0,0 +1,83 @@
+/*
+ * --------------------------------------------------------------------------
+ * GSKS (General Stride Kernel Summation)
+ * --------------------------------------------------------------------------
+ * Copyright (C) 2015, The University of Texas at Austin
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ * gsks_stats.h
+ *
+ * Chenhan D. Yu - Department of Computer Science, 
+ *                 The University of Texas at Austin
+ *
+ *
+ * Purpose: 
+ * Internal hooks of the per-phase statistics. Without GSKS_USE_STATS all
+ * macros expand to nothing, so the hot path is unchanged.
+ *
+ *
+ * Todo:
+ *
+ *
+ * Modification:
+ *
+ *
+ * */
+
+#ifndef __GSKS_STATS_H__
+#define __GSKS_STATS_H__
+
+#ifdef GSKS_USE_STATS
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <x86intrin.h>
+#define gsks_stats_tick() ( (unsigned long long)__rdtsc() )
+#else
+#include <omp.h>
+#define gsks_stats_tick() ( (unsigned long long)( omp_get_wtime() * 1E+9 ) )
+#endif
+
+void gsks_stats_add(
+    ks_phase_t phase,
+    unsigned long long cycles
+    );
+
+void gsks_stats_pack(
+    unsigned long long bytes_packA,
+    unsigned long long bytes_packB
+    );
+
+void gsks_stats_tile(
+    int    useful,
+    int    lanes
+    );
+
+#define GSKS_STATS_TIC( t )          unsigned long long t = gsks_stats_tick()
+#define GSKS_STATS_TOC( phase, t )   gsks_stats_add( phase, gsks_stats_tick() - ( t ) )
+#define GSKS_STATS_PACK( a, b )      gsks_stats_pack( a, b )
+#define GSKS_STATS_TILE( u, l )      gsks_stats_tile( u, l )
+
+#else
+
+#define GSKS_STATS_TIC( t )
+#define GSKS_STATS_TOC( phase, t )
+#define GSKS_STATS_PACK( a, b )
+#define GSKS_STATS_TILE( u, l )
+
+#endif
+
+#endif // define __GSKS_STATS_H__
@@ -57,6 +57,8 @@ typedef enum {
   KS_EPANECHNIKOV
 } ks_type;
 
+#define KS_NUM_KERNEL 8
+
 struct kernel_s {
   ks_type type;
   double powe;
@@ -87,6 +89,9 @@ void dgsks(
     int    *wmap
     );
 
+// Release the buffers dgsks() keeps between calls ( frame/dgsks.c ).
+void dgsks_release();
+
 void dgsks_ref(
     ks_t   *kernel,
     int    m,
@@ -104,10 +109,533 @@ void dgsks_ref(
     int    *wmap
     );
 
+// The m x n column major kernel matrix K( XA[ amap ], XB[ bmap ] ) of
+// dgsks_ref(); As ( m * k ) and Bs ( n * k ) are workspace.
+void dgsks_ref_block(
+    ks_t   *kernel,
+    int    m,
+    int    n,
+    int    k,
+    double *XA,
+    double *XA2,
+    int    *amap,
+    double *XB,
+    double *XB2,
+    int    *bmap,
+    double *As,
+    double *Bs,
+    double *Cs
+    );
+
 double *ks_malloc_aligned(
     int    m,
     int    n,
     int    size
     );
 
+void ks_free_aligned(
+    void   *ptr
+    );
+
+// Huge page backed buffers ( frame/ks_util.c )
+#define KS_HUGE_PAGE_SIZE ( 2 * 1024 * 1024 )
+
+typedef enum {
+  KS_BUF_PACKA,
+  KS_BUF_PACKB,
+  KS_BUF_PACKC,
+  KS_BUF_OTHER,
+  KS_BUF_NUM
+} ks_buf_t;
+
+struct hugepage_stat_s {
+  long   nbuf[ KS_BUF_NUM ];     // requests
+  long   nhugetlb[ KS_BUF_NUM ]; // explicit hugetlbfs pages
+  long   nthp[ KS_BUF_NUM ];     // 2MB aligned, advised with MADV_HUGEPAGE
+  long   nsmall[ KS_BUF_NUM ];   // regular pages ( small, disabled or fallback )
+  size_t bytes_huge;             // hugetlbfs + thp bytes
+};
+
+typedef struct hugepage_stat_s ks_hugepage_stat_t;
+
+double *ks_malloc_huge(
+    int    m,
+    int    n,
+    int    size,
+    ks_buf_t kind
+    );
+
+void ks_free_huge(
+    void   *ptr
+    );
+
+void ks_hugepage_stat(
+    ks_hugepage_stat_t *stat
+    );
+
+void ks_hugepage_stat_reset();
+
+void ks_hugepage_release();
+
+// Threads of the dgsks() ic loop: KS_IC_NT, or a per-thread override.
+void ks_set_ic_nt(
+    int    nt
+    );
+
+int ks_get_ic_nt();
+
+// Per-phase statistics ( frame/gsks_stats.c ), collected only if the
+// library is compiled with GSKS_USE_STATS.
+typedef enum {
+  KS_PHASE_GATHER,      // u and w gathers through umap and wmap
+  KS_PHASE_PACKA,
+  KS_PHASE_PACKB,
+  KS_PHASE_RANKK,       // rank-k slices of k > DKS_KC
+  KS_PHASE_KERNEL,      // last rank-k slice fused with kernel evaluation
+  KS_PHASE_UNPACKU,
+  KS_PHASE_LIST_NORM,   // square 2-norms in the omp_dgsks_list wrappers
+  KS_PHASE_LIST_SCHED,
+  KS_PHASE_LIST_TASK,   // dgsks calls issued by omp_dgsks_list
+  KS_PHASE_LIST_REDUCE,
+  KS_PHASE_NUM
+} ks_phase_t;
+
+struct gsks_stats_s {
+  int    nthread;                                 // threads with records
+  unsigned long long cycles[ KS_PHASE_NUM ];      // summed over threads
+  unsigned long long cycles_max[ KS_PHASE_NUM ];  // busiest thread
+  unsigned long long calls[ KS_PHASE_NUM ];
+  unsigned long long bytes_packA;
+  unsigned long long bytes_packB;
+  unsigned long long tiles;                       // micro-kernel calls
+  unsigned long long fringe_tiles;                // with padded rows or columns
+  unsigned long long lanes;                       // lanes computed
+  unsigned long long lanes_wasted;                // lanes spent on padding
+};
+
+typedef struct gsks_stats_s gsks_stats_t;
+
+void gsks_stats_get(
+    gsks_stats_t *stats
+    );
+
+void gsks_stats_get_thread(
+    int    tid,
+    gsks_stats_t *stats
+    );
+
+void gsks_stats_reset();
+
+// NUMA topology ( frame/ks_numa.c )
+#define KS_NUMA_MAX_NODE 8
+
+int ks_numa_num_nodes();
+
+int ks_numa_node_of_cpu(
+    int    cpu
+    );
+
+int ks_numa_local_node();
+
+void ks_numa_bind(
+    void   *ptr,
+    size_t bytes,
+    int    node
+    );
+
+int ks_numa_llc_of_cpu(
+    int    cpu
+    );
+
+// Time model of one dgsks() call ( frame/ks_cost.c ), in seconds:
+// c0 + cpack * ( m + n ) * k + mp * np * ( cflop * k + cpair ).
+struct cost_s {
+  double c0;         // per call
+  double cpack;      // per gathered and packed coordinate
+  double cflop;      // per padded pair and dimension ( rank-k update )
+  double cpair;      // per padded pair ( kernel and weighted sum )
+};
+
+typedef struct cost_s ks_cost_t;
+
+const char *ks_cost_name(
+    ks_type type
+    );
+
+int ks_cost_load(
+    const char *file
+    );
+
+void ks_cost_get(
+    ks_type   type,
+    ks_cost_t *cost
+    );
+
+void ks_cost_set(
+    ks_type   type,
+    ks_cost_t *cost
+    );
+
+double ks_cost_predict(
+    ks_t   *kernel,
+    int    m,
+    int    n,
+    int    k
+    );
+
+void ks_cost_fit(
+    ks_t   *kernel,
+    int    nk,
+    int    *klist,
+    ks_cost_t *cost
+    );
+
+// Dataset handle ( frame/ks_points.c ). Point i is X[ i * k ] ~
+// X[ i * k + k - 1 ]. Square norms and variable bandwidth factors
+// -1 / ( 2 h^2 ) are computed per point on first use and cached.
+struct points_s {
+  int    n;
+  int    k;
+  double *X;
+  double *X2;              // cached square 2-norms
+  double *h;               // bandwidths, NULL if not set
+  double *hfac;            // cached -1 / ( 2 h^2 ), for hi and hj
+  unsigned char *state;    // per point: none, busy or ready
+  int    own;              // X is a copy owned by the handle
+};
+
+typedef struct points_s gsks_points_t;
+
+gsks_points_t *gsks_points_create(
+    int    n,
+    int    k,
+    double *X,
+    int    copy
+    );
+
+void gsks_points_free(
+    gsks_points_t *pts
+    );
+
+void gsks_points_set_bandwidth(
+    gsks_points_t *pts,
+    double *h
+    );
+
+void gsks_points_modified(
+    gsks_points_t *pts,
+    int    beg,
+    int    end
+    );
+
+void gsks_points_require(
+    gsks_points_t *pts,
+    int    nidx,
+    const int *idx
+    );
+
+double *gsks_points_norms(
+    gsks_points_t *pts
+    );
+
+double *gsks_points_bandwidth(
+    gsks_points_t *pts
+    );
+
+// Asynchronous summation ( frame/ks_queue.c ) with a persistent pool of
+// workers. One task is one dgsks() call: u[ umap ] += K( A[ amap ],
+// B[ bmap ] ) w[ wmap ]. The maps must stay valid until gsks_wait().
+struct gsks_task_s {
+  int    m;
+  int    n;
+  int    *umap;          // NULL uses amap
+  int    *amap;
+  int    *bmap;
+  int    *wmap;          // NULL uses bmap
+};
+
+typedef struct gsks_task_s gsks_task_t;
+
+typedef struct queue_s gsks_queue_t;
+
+gsks_queue_t *gsks_queue_create(
+    ks_t   *kernel,
+    gsks_points_t *A,
+    gsks_points_t *B,
+    double *u,
+    double *w,
+    int    nworker
+    );
+
+void gsks_submit(
+    gsks_queue_t *q,
+    gsks_task_t  *task
+    );
+
+void gsks_flush(
+    gsks_queue_t *q
+    );
+
+void gsks_wait(
+    gsks_queue_t *q
+    );
+
+void gsks_queue_free(
+    gsks_queue_t *q
+    );
+
+// Incremental updates ( frame/dgsks.c ). A targets handle keeps XA[ amap ]
+// packed; dgsks_delta() adds K( targets, changed sources ) delta_w to u
+// when only a few weights changed.
+typedef struct targets_s gsks_targets_t;
+
+gsks_targets_t *gsks_targets_create(
+    ks_t   *kernel,
+    int    m,
+    int    k,
+    double *XA,
+    double *XA2,
+    int    *amap
+    );
+
+void gsks_targets_free(
+    gsks_targets_t *A
+    );
+
+void dgsks_delta(
+    ks_t   *kernel,
+    gsks_targets_t *A,
+    double *u,
+    int    *umap,
+    int    n,
+    double *XB,
+    double *XB2,
+    int    *changed_bmap,
+    double *delta_w
+    );
+
+// Space partitioning tree ( frame/ks_tree.c ). Balanced median splits in
+// heap order: the children of node i are 2 i + 1 and 2 i + 2, leaf l is
+// node nleaf - 1 + l. X is reordered in place; node i owns the rows
+// beg[ i ] ~ end[ i ] - 1, and row r was row perm[ r ] before.
+struct tree_s {
+  int    n;
+  int    k;
+  int    leaf_size;
+  int    depth;
+  int    nleaf;            // 2^depth
+  int    nnode;            // 2 nleaf - 1
+  double *X;               // the caller's points, in tree order
+  int    *perm;
+  int    *beg;
+  int    *end;
+  double *center;          // nnode x k, centroids
+  double *radius;          // bounding ball radii, < 0 for empty nodes
+};
+
+typedef struct tree_s gsks_tree_t;
+
+// Interaction lists in the CSR form of omp_dgsks_list(). List i is leaf
+// pair[ 2 i ] ( targets ) against leaf pair[ 2 i + 1 ] ( sources ).
+struct lists_s {
+  int    n_list;
+  int    *pair;
+  int    *aptr;
+  int    *aidx;
+  int    *bptr;
+  int    *bidx;
+};
+
+typedef struct lists_s gsks_lists_t;
+
+gsks_tree_t *gsks_tree_create(
+    int    n,
+    int    k,
+    double *X,
+    int    leaf_size
+    );
+
+void gsks_tree_free(
+    gsks_tree_t *T
+    );
+
+void gsks_tree_permute(
+    gsks_tree_t *T,
+    int    ld,
+    double *v
+    );
+
+void gsks_tree_unpermute(
+    gsks_tree_t *T,
+    int    ld,
+    double *v
+    );
+
+double gsks_tree_gap(
+    gsks_tree_t *T,
+    int    i,
+    gsks_tree_t *S,
+    int    j
+    );
+
+gsks_lists_t *gsks_tree_near_lists(
+    gsks_tree_t *T,
+    gsks_tree_t *S,
+    double cutoff
+    );
+
+void gsks_lists_free(
+    gsks_lists_t *L
+    );
+
+// Nested skeletons of a source tree ( frame/ks_skel.c ). The skeleton of
+// node i is the rows sidx[ sptr[ i ] ~ sptr[ i + 1 ] - 1 ] of S->X, and
+// K( far, candidates of i ) ~= K( far, skeleton of i ) proj( i ), with
+// proj( i ) the column major skeleton size x candidates matrix at
+// proj + pptr[ i ]. The candidates of a leaf are its points, those of an
+// inner node the skeletons of its children.
+struct skel_s {
+  gsks_tree_t *S;
+  double tol;
+  int    max_rank;
+  int    *sptr;
+  int    *sidx;
+  long   *pptr;
+  double *proj;
+};
+
+typedef struct skel_s gsks_skel_t;
+
+gsks_skel_t *gsks_skel_create(
+    ks_t   *kernel,
+    gsks_tree_t *S,
+    double tol,
+    int    max_rank
+    );
+
+void gsks_skel_free(
+    gsks_skel_t *sk
+    );
+
+void gsks_skel_weights(
+    gsks_skel_t *sk,
+    double *w,
+    double *wskel
+    );
+
+// Treecode ( frame/ks_treecode.cpp ). Far node pairs,
+// radius( t ) + radius( s ) <= theta | center( t ) - center( s ) |, use
+// the centroids of the nodes rep_level levels below s with their summed
+// weights; the rest is summed directly. u and w are in tree order.
+// gsks_treecode_set_skel() switches the far field to the skeletons of S.
+typedef struct treecode_s gsks_treecode_t;
+
+gsks_treecode_t *gsks_treecode_create(
+    gsks_tree_t *T,
+    gsks_tree_t *S,
+    double theta,
+    int    rep_level
+    );
+
+void gsks_treecode_free(
+    gsks_treecode_t *tc
+    );
+
+void gsks_treecode_stat(
+    gsks_treecode_t *tc,
+    int    *n_near,
+    int    *n_far
+    );
+
+void gsks_treecode_set_skel(
+    gsks_treecode_t *tc,
+    gsks_skel_t *sk
+    );
+
+void gsks_treecode_eval(
+    ks_t   *kernel,
+    gsks_treecode_t *tc,
+    double *u,
+    double *w
+    );
+
+// Kernel ridge regression solver ( frame/ks_solver.cpp ). Solves
+// ( K + lambda I ) alpha = y matrix-free, K given by symmetric CSR lists
+// on a dataset handle. Right hand sides are the columns of y; the work
+// vectors and factorized preconditioner blocks are kept across solves.
+typedef enum {
+  KS_SOLVER_CG,
+  KS_SOLVER_MINRES          // K only symmetric; M must still be SPD
+} ks_solver_method_t;
+
+typedef enum {
+  KS_PRECOND_NONE,
+  KS_PRECOND_DIAG,
+  KS_PRECOND_BLOCK_JACOBI,  // Cholesky factors of diagonal blocks
+  KS_PRECOND_USER           // gsks_solver_set_precond_fn()
+} ks_precond_t;
+
+// z( :, j ) = M^-1 r( :, j ), j < nrhs.
+typedef void (*gsks_precond_fn)(
+    int    n,
+    int    nrhs,
+    const double *r,
+    int    ldr,
+    double *z,
+    int    ldz,
+    void   *arg
+    );
+
+typedef struct solver_s gsks_solver_t;
+
+gsks_solver_t *gsks_solver_create(
+    ks_t   *kernel,
+    gsks_points_t *X,
+    int    n_list,
+    const int *aptr,
+    const int *aidx,
+    const int *bptr,
+    const int *bidx,
+    double lambda
+    );
+
+void gsks_solver_free(
+    gsks_solver_t *sol
+    );
+
+void gsks_solver_set_precond(
+    gsks_solver_t *sol,
+    ks_precond_t precond,
+    int    nblock,
+    const int *block_ptr
+    );
+
+void gsks_solver_set_precond_fn(
+    gsks_solver_t *sol,
+    gsks_precond_fn fn,
+    void   *arg
+    );
+
+void gsks_solver_matvec(
+    gsks_solver_t *sol,
+    int    nrhs,
+    const double *x,
+    int    ldx,
+    double *u,
+    int    ldu
+    );
+
+int gsks_solver_solve(
+    gsks_solver_t *sol,
+    ks_solver_method_t method,
+    int    nrhs,
+    const double *y,
+    int    ldy,
+    double *alpha,
+    int    ldalpha,
+    double tol,
+    int    maxit,
+    double *relres
+    );
+
 #endif // defined __KS_H__
@@ -0,0 +1,189 @@
+/*
+ * --------------------------------------------------------------------------
+ * GSKS (General Stride Kernel Summation)
+ * --------------------------------------------------------------------------
+ * Copyright (C) 2015, The University of Texas at Austin
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ * ks_deque.h
+ *
+ * Chenhan D. Yu - Department of Computer Science,
+ *                 The University of Texas at Austin
+ *
+ *
+ * Purpose:
+ * Lock-free work-stealing deque of Chase and Lev, with the memory orders
+ * of Le et al., "Correct and efficient work-stealing for weak memory
+ * models" ( PPoPP'13 ). The owner pushes and pops at the bottom; other
+ * threads steal from the top. Entries are pointers. The ring grows on the
+ * owner side; retired rings are kept until ks_deque_free(), because a
+ * thief may still be reading one.
+ *
+ *
+ * Todo:
+ *
+ *
+ * Modification:
+ *
+ *
+ * */
+
+#ifndef __KS_DEQUE_H__
+#define __KS_DEQUE_H__
+
+#include <stdlib.h>
+
+#define KS_DEQUE_EMPTY ( (void*)0 )
+#define KS_DEQUE_ABORT ( (void*)1 )
+
+typedef struct ks_ring_s {
+  long             size;               // power of two
+  struct ks_ring_s *prev;              // retired ring
+  void             **buf;              // follows the header
+} ks_ring_t;
+
+typedef struct {
+  long      top    __attribute__(( aligned( 64 ) ));
+  long      bottom __attribute__(( aligned( 64 ) ));
+  ks_ring_t *ring;
+} ks_deque_t;
+
+
+static inline ks_ring_t *ks_ring_new( long size, ks_ring_t *prev )
+{
+  ks_ring_t *ring = (ks_ring_t*)malloc( sizeof(ks_ring_t) + sizeof(void*) * size );
+  ring->size = size;
+  ring->prev = prev;
+  ring->buf  = (void**)( ring + 1 );
+  return ring;
+}
+
+
+static inline void ks_deque_init( ks_deque_t *dq, long size )
+{
+  long   cap = 16;
+
+  while ( cap < size ) cap *= 2;
+  dq->top    = 0;
+  dq->bottom = 0;
+  dq->ring   = ks_ring_new( cap, NULL );
+}
+
+
+static inline void ks_deque_free( ks_deque_t *dq )
+{
+  ks_ring_t *ring = dq->ring, *prev;
+
+  while ( ring ) {
+    prev = ring->prev;
+    free( ring );
+    ring = prev;
+  }
+  dq->ring = NULL;
+}
+
+
+/* Owner only. */
+static inline void ks_deque_push( ks_deque_t *dq, void *x )
+{
+  long      b    = __atomic_load_n( &dq->bottom, __ATOMIC_RELAXED );
+  long      t    = __atomic_load_n( &dq->top,    __ATOMIC_ACQUIRE );
+  ks_ring_t *ring = __atomic_load_n( &dq->ring,  __ATOMIC_RELAXED );
+
+  if ( b - t > ring->size - 1 ) {
+    ks_ring_t *grow = ks_ring_new( 2 * ring->size, ring );
+    for ( long i = t; i < b; i ++ ) {
+      grow->buf[ i & ( grow->size - 1 ) ] =
+        __atomic_load_n( &ring->buf[ i & ( ring->size - 1 ) ], __ATOMIC_RELAXED );
+    }
+    __atomic_store_n( &dq->ring, grow, __ATOMIC_RELEASE );
+    ring = grow;
+  }
+  __atomic_store_n( &ring->buf[ b & ( ring->size - 1 ) ], x, __ATOMIC_RELAXED );
+  __atomic_thread_fence( __ATOMIC_RELEASE );
+  __atomic_store_n( &dq->bottom, b + 1, __ATOMIC_RELAXED );
+}
+
+
+/* Owner only. Returns KS_DEQUE_EMPTY if there is nothing left. */
+static inline void *ks_deque_pop( ks_deque_t *dq )
+{
+  long      b    = __atomic_load_n( &dq->bottom, __ATOMIC_RELAXED ) - 1;
+  ks_ring_t *ring = __atomic_load_n( &dq->ring,  __ATOMIC_RELAXED );
+  long      t;
+  void      *x;
+
+  __atomic_store_n( &dq->bottom, b, __ATOMIC_RELAXED );
+  __atomic_thread_fence( __ATOMIC_SEQ_CST );
+  t = __atomic_load_n( &dq->top, __ATOMIC_RELAXED );
+
+  if ( t <= b ) {
+    x = __atomic_load_n( &ring->buf[ b & ( ring->size - 1 ) ], __ATOMIC_RELAXED );
+    if ( t == b ) {
+      // Last entry: race the thieves for it.
+      if ( !__atomic_compare_exchange_n( &dq->top, &t, t + 1, 0,
+            __ATOMIC_SEQ_CST, __ATOMIC_RELAXED ) ) {
+        x = KS_DEQUE_EMPTY;
+      }
+      __atomic_store_n( &dq->bottom, b + 1, __ATOMIC_RELAXED );
+    }
+  }
+  else {
+    x = KS_DEQUE_EMPTY;
+    __atomic_store_n( &dq->bottom, b + 1, __ATOMIC_RELAXED );
+  }
+
+  return x;
+}
+
+
+/*
+ * Any thread. Returns KS_DEQUE_EMPTY if there is nothing to steal and
+ * KS_DEQUE_ABORT if another thread won the race.
+ */
+static inline void *ks_deque_steal( ks_deque_t *dq )
+{
+  long      t = __atomic_load_n( &dq->top, __ATOMIC_ACQUIRE );
+  long      b;
+  ks_ring_t *ring;
+  void      *x = KS_DEQUE_EMPTY;
+
+  __atomic_thread_fence( __ATOMIC_SEQ_CST );
+  b = __atomic_load_n( &dq->bottom, __ATOMIC_ACQUIRE );
+
+  if ( t < b ) {
+    ring = __atomic_load_n( &dq->ring, __ATOMIC_ACQUIRE );
+    x    = __atomic_load_n( &ring->buf[ t & ( ring->size - 1 ) ], __ATOMIC_RELAXED );
+    if ( !__atomic_compare_exchange_n( &dq->top, &t, t + 1, 0,
+          __ATOMIC_SEQ_CST, __ATOMIC_RELAXED ) ) {
+      return KS_DEQUE_ABORT;
+    }
+  }
+
+  return x;
+}
+
+
+/* Approximate number of entries, for idle checks. */
+static inline long ks_deque_size( ks_deque_t *dq )
+{
+  long   b = __atomic_load_n( &dq->bottom, __ATOMIC_RELAXED );
+  long   t = __atomic_load_n( &dq->top,    __ATOMIC_RELAXED );
+  return b > t ? b - t : 0;
+}
+
+#endif // define __KS_DEQUE_H__
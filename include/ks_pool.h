@@ -0,0 +1,78 @@
+/*
+ * --------------------------------------------------------------------------
+ * GSKS (General Stride Kernel Summation)
+ * --------------------------------------------------------------------------
+ * Copyright (C) 2015, The University of Texas at Austin
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ * ks_pool.h
+ *
+ * Chenhan D. Yu - Department of Computer Science,
+ *                 The University of Texas at Austin
+ *
+ *
+ * Purpose:
+ * Persistent worker pool of dgsks() ( frame/ks_pool.c ). ks_pool_run()
+ * runs fn( tid, nt, arg ) on nt threads: the caller as tid 0 and nt - 1
+ * pool workers, which are created on first use, pinned and kept for later
+ * calls. Idle workers spin for KS_POOL_SPIN polls, then sleep. Busy waits
+ * inside fn should call ks_pool_relax() once per poll.
+ *
+ * One run at a time: ks_pool_run() returns 0 without running fn if the
+ * pool is busy ( another caller, or a call from inside a run ), turned
+ * off with KS_POOL=0, or short of workers ( nt is then never lowered );
+ * the caller then takes its OpenMP path.
+ *
+ *
+ * Todo:
+ *
+ *
+ * Modification:
+ *
+ *
+ * */
+
+#ifndef __KS_POOL_H__
+#define __KS_POOL_H__
+
+#define KS_POOL_MAX_THREAD 256
+
+typedef void (*ks_pool_fn)( int tid, int nt, void *arg );
+
+int ks_pool_run(
+    int        nt,
+    ks_pool_fn fn,
+    void       *arg
+    );
+
+void ks_pool_relax(
+    int    *polls
+    );
+
+int ks_pool_llc_of(
+    int    tid
+    );
+
+int ks_pool_node_of(
+    int    tid
+    );
+
+void ks_pool_pin(
+    int    tid
+    );
+
+#endif // define __KS_POOL_H__
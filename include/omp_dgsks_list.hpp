@@ -99,6 +99,12 @@ void omp_dgsks_list_separated_u_symmetric(
     std::vector< std::vector<int> > &wlist
     );
 
+/*
+ * KS_LIST_REPRO=1 makes every call below bitwise reproducible across runs
+ * and thread counts: the tasks are cut into a fixed set of pieces, each
+ * summed into its own buffer, and the buffers are added to u in piece
+ * order per target. Thread teams and on-demand splits are off.
+ */
 void omp_dgsks_list(
     ks_t   *kernel,
     int    k,
@@ -114,4 +120,182 @@ void omp_dgsks_list(
     std::vector< std::vector<int> > &wlist
     );
 
+/*
+ * CSR form of the lists, used in place. List i of x is
+ * xidx[ xptr[ i ] ] ... xidx[ xptr[ i + 1 ] - 1 ]. NULL uptr / uidx use
+ * the alist, NULL wptr / widx use the blist. Same scheduler as above.
+ */
+void omp_dgsks_list(
+    ks_t   *kernel,
+    int    k,
+    int    n_list,
+    double *u,
+    const int *uptr,
+    const int *uidx,
+    double *XA,
+    double *XA2,
+    const int *aptr,
+    const int *aidx,
+    double *XB,
+    double *XB2,
+    const int *bptr,
+    const int *bidx,
+    double *w,
+    const int *wptr,
+    const int *widx
+    );
+
+/*
+ * The same calls on dataset handles ( gsks_points_create() ). The cached
+ * norms, and bandwidth factors for KS_GAUSSIAN_VAR_BANDWIDTH, are reused
+ * across calls and computed only for points in the lists; k is taken
+ * from the handles.
+ */
+void omp_dgsks_list_unsymmetric(
+    ks_t   *kernel,
+    std::vector<double> &u,
+    gsks_points_t *A,
+    std::vector< std::vector<int> > &alist,
+    gsks_points_t *B,
+    std::vector< std::vector<int> > &blist,
+    double *w,
+    std::vector< std::vector<int> > &wlist
+    );
+
+void omp_dgsks_list_symmetric(
+    ks_t   *kernel,
+    std::vector<double> &u,
+    gsks_points_t *A,
+    std::vector< std::vector<int> > &alist,
+    std::vector< std::vector<int> > &blist,
+    double *w,
+    std::vector< std::vector<int> > &wlist
+    );
+
+void omp_dgsks_list_separated_u_unsymmetric(
+    ks_t   *kernel,
+    std::vector<double> &u,
+    std::vector< std::vector<int> > &ulist,
+    gsks_points_t *A,
+    std::vector< std::vector<int> > &alist,
+    gsks_points_t *B,
+    std::vector< std::vector<int> > &blist,
+    double *w,
+    std::vector< std::vector<int> > &wlist
+    );
+
+void omp_dgsks_list_separated_u_symmetric(
+    ks_t   *kernel,
+    std::vector<double> &u,
+    std::vector< std::vector<int> > &ulist,
+    gsks_points_t *A,
+    std::vector< std::vector<int> > &alist,
+    std::vector< std::vector<int> > &blist,
+    double *w,
+    std::vector< std::vector<int> > &wlist
+    );
+
+void omp_dgsks_list(
+    ks_t   *kernel,
+    int    n_list,
+    double *u,
+    const int *uptr,
+    const int *uidx,
+    gsks_points_t *A,
+    const int *aptr,
+    const int *aidx,
+    gsks_points_t *B,
+    const int *bptr,
+    const int *bidx,
+    double *w,
+    const int *wptr,
+    const int *widx
+    );
+
+/*
+ * The CSR call on handles, coalesced and scheduled once for repeated
+ * sums over the same lists and points: omp_dgsks_list_plan() groups the
+ * tasks, predicts and sorts their costs, picks the teams and the seeding
+ * and makes the norms ready; each omp_dgsks_list_execute() only refills
+ * the deques and runs. The lists are used in place and, with A and B,
+ * must outlive the plan. The plan keeps the thread count and
+ * KS_LIST_REPRO of the time it was made.
+ */
+typedef struct ks_list_plan_s ks_list_plan_t;
+
+ks_list_plan_t *omp_dgsks_list_plan(
+    ks_t   *kernel,
+    int    n_list,
+    const int *uptr,
+    const int *uidx,
+    gsks_points_t *A,
+    const int *aptr,
+    const int *aidx,
+    gsks_points_t *B,
+    const int *bptr,
+    const int *bidx,
+    const int *wptr,
+    const int *widx
+    );
+
+void omp_dgsks_list_execute(
+    ks_list_plan_t *plan,
+    double *u,
+    double *w
+    );
+
+void omp_dgsks_list_plan_free(
+    ks_list_plan_t *plan
+    );
+
+/*
+ * Incremental update after the weights w[ changed_wmap[ c ] ] changed by
+ * delta_w[ c * KS_RHS + p ]: only the changed sources of each list are
+ * summed, on the packed targets cached in targets ( one handle per list,
+ * created on first use, freed by the caller with gsks_targets_free() ).
+ */
+void omp_dgsks_list_delta(
+    ks_t   *kernel,
+    int    k,
+    std::vector<double> &u,
+    std::vector< std::vector<int> > &ulist,
+    double *XA,
+    double *XA2,
+    std::vector< std::vector<int> > &alist,
+    double *XB,
+    double *XB2,
+    std::vector< std::vector<int> > &blist,
+    std::vector< std::vector<int> > &wlist,
+    std::vector<gsks_targets_t*> &targets,
+    int    n_changed,
+    int    *changed_wmap,
+    double *delta_w
+    );
+
+/*
+ * Balance of the last omp_dgsks_list() call. Loads are summed dgsks()
+ * times per thread; an imbalance is max / mean over the threads. The
+ * predicted numbers come from the ks_cost_predict() model, "seed" is the
+ * initial assignment before stealing. KS_LIST_REPORT=1 prints it.
+ */
+struct ks_list_report_s {
+  int    nthread;
+  int    ntask;                 // after coalescing
+  int    nmerged;               // tasks merged into another one
+  int    nteam;                 // tasks run first on thread teams ( not in the loads )
+  int    nsplit;                // tasks split for idle threads
+  double predicted;             // predicted dgsks time, summed ( sec )
+  double actual;                // measured dgsks time, summed ( sec )
+  double imbalance_seed;        // predicted, initial assignment
+  double imbalance_pred;        // predicted, what each thread ran
+  double imbalance;             // measured
+  double wall;                  // sec
+};
+
+typedef struct ks_list_report_s ks_list_report_t;
+
+void omp_dgsks_list_report(
+    ks_list_report_t *report
+    );
+
 #endif
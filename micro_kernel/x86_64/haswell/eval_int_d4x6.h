@@ -0,0 +1,132 @@
+#ifndef __EVAL_INT_D4X6_H__
+#define __EVAL_INT_D4X6_H__
+
+/*
+ * --------------------------------------------------------------------------
+ * Kernel evaluation on one 4-wide row vector of a tile with nr live
+ * columns. This is shared by the fringe and the low dimension
+ * micro-kernels, which cannot use the fully unrolled 8x6 fragments.
+ *
+ * For the distance based kernels c[ j ] must already hold the square
+ * distances; for the polynomial and tanh kernels c[ j ] holds the inner
+ * products. hi points to the 4 packed target bandwidths of this row
+ * vector, hj to the packed source bandwidths.
+ * --------------------------------------------------------------------------
+ */
+
+
+/*
+ * Whether the kernel is a function of the square distance.
+ */
+static inline int eval_is_dist( ks_type type )
+{
+  return ( type != KS_POLYNOMIAL && type != KS_TANH );
+}
+
+
+/*
+ * Square distance from the rank-k result, aa[ i ] - 2c + bb[ j ]. Negative
+ * values caused by cancellation are clamped to zero as in sq2nrm_int_d8x6.h.
+ */
+static inline __m256d sq2nrm_d4(
+    __m256d c,
+    __m256d aa,
+    double  *bb
+    )
+{
+  __m256d neg2  = _mm256_set1_pd( -2.0 );
+
+  c = _mm256_fmadd_pd( neg2, c, aa );
+  c = _mm256_add_pd( c, _mm256_broadcast_sd( bb ) );
+
+  return _mm256_max_pd( c, _mm256_setzero_pd() );
+}
+
+
+static inline void eval_int_d4x6(
+    ks_t   *ker,
+    int    nr,
+    v4df_t *c,
+    double *hi,
+    double *hj
+    )
+{
+  int    j;
+  double powe = ker->powe;
+  v4df_t a_tmp, b_tmp, h_tmp;
+
+  switch ( ker->type ) {
+    case KS_GAUSSIAN:
+      b_tmp.v = _mm256_broadcast_sd( &ker->scal );
+      for ( j = 0; j < nr; j ++ ) {
+        c[ j ].v = _mm256_exp_pd( _mm256_mul_pd( b_tmp.v, c[ j ].v ) );
+      }
+      break;
+    case KS_GAUSSIAN_VAR_BANDWIDTH:
+      h_tmp.v = _mm256_load_pd( hi );
+      h_tmp.v = _mm256_mul_pd( _mm256_set1_pd( -0.5 ), h_tmp.v );
+      for ( j = 0; j < nr; j ++ ) {
+        a_tmp.v = _mm256_mul_pd( h_tmp.v, c[ j ].v );
+        b_tmp.v = _mm256_broadcast_sd( hj + j );
+        c[ j ].v = _mm256_exp_pd( _mm256_mul_pd( b_tmp.v, a_tmp.v ) );
+      }
+      break;
+    case KS_POLYNOMIAL:
+      for ( j = 0; j < nr; j ++ ) {
+        a_tmp.v = _mm256_fmadd_pd( _mm256_set1_pd( ker->scal ), c[ j ].v,
+            _mm256_set1_pd( ker->cons ) );
+        if ( powe == 2.0 ) {
+          a_tmp.v = _mm256_mul_pd( a_tmp.v, a_tmp.v );
+        }
+        else if ( powe == 4.0 ) {
+          a_tmp.v = _mm256_mul_pd( a_tmp.v, a_tmp.v );
+          a_tmp.v = _mm256_mul_pd( a_tmp.v, a_tmp.v );
+        }
+        else {
+          a_tmp.v = _mm256_pow_pd( a_tmp.v, _mm256_set1_pd( powe ) );
+        }
+        c[ j ].v = a_tmp.v;
+      }
+      break;
+    case KS_LAPLACE:
+      for ( j = 0; j < nr; j ++ ) {
+        h_tmp.v = _mm256_cmp_pd( c[ j ].v, _mm256_set1_pd( 1E-15 ), _CMP_LT_OQ );
+        a_tmp.v = _mm256_blendv_pd( c[ j ].v, _mm256_set1_pd( 1.79E+308 ), h_tmp.v );
+        a_tmp.v = _mm256_pow_pd( a_tmp.v, _mm256_set1_pd( powe ) );
+        c[ j ].v = _mm256_mul_pd( _mm256_set1_pd( ker->scal ), a_tmp.v );
+      }
+      break;
+    case KS_TANH:
+      for ( j = 0; j < nr; j ++ ) {
+        a_tmp.v = _mm256_fmadd_pd( _mm256_set1_pd( ker->scal ), c[ j ].v,
+            _mm256_set1_pd( ker->cons ) );
+        c[ j ].v = _mm256_tanh_pd( a_tmp.v );
+      }
+      break;
+    case KS_QUARTIC:
+      for ( j = 0; j < nr; j ++ ) {
+        a_tmp.v = _mm256_min_pd( _mm256_set1_pd( 1.0 ), c[ j ].v );
+        a_tmp.v = _mm256_sub_pd( _mm256_set1_pd( 1.0 ), a_tmp.v );
+        a_tmp.v = _mm256_mul_pd( a_tmp.v, a_tmp.v );
+        c[ j ].v = _mm256_mul_pd( _mm256_set1_pd( 15.0 / 16.0 ), a_tmp.v );
+      }
+      break;
+    case KS_MULTIQUADRATIC:
+      for ( j = 0; j < nr; j ++ ) {
+        c[ j ].v = _mm256_add_pd( _mm256_set1_pd( ker->cons ), c[ j ].v );
+      }
+      break;
+    case KS_EPANECHNIKOV:
+      for ( j = 0; j < nr; j ++ ) {
+        a_tmp.v = _mm256_min_pd( _mm256_set1_pd( 1.0 ), c[ j ].v );
+        a_tmp.v = _mm256_sub_pd( _mm256_set1_pd( 1.0 ), a_tmp.v );
+        c[ j ].v = _mm256_mul_pd( _mm256_set1_pd( 3.0 / 4.0 ), a_tmp.v );
+      }
+      break;
+    default:
+      printf( "Error eval_int_d4x6(): illegal kernel type\n" );
+      exit( 1 );
+  }
+}
+
+#endif // define __EVAL_INT_D4X6_H__
@@ -0,0 +1,116 @@
+#include <math.h>
+#include <immintrin.h> // AVX
+#include <ks.h>
+#include <gsks_internal.h>
+#include <avx_type.h>
+#include <gsks_config.h>
+#include <eval_int_d4x6.h>
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  This is the fringe micro-kernel for edge tiles that have only
+ *         mr <= 8 valid target rows and nr <= 6 valid source columns.
+ *         Rows are processed in 4-wide vectors and only the live columns
+ *         are visited, so a 3 x 6 tile costs a 4 x 6 kernel and an 8 x 2
+ *         tile costs an 8 x 2 kernel instead of the full 8 x 6 one. The
+ *         packing layout is the same as the full micro-kernel, so the
+ *         macro-kernel can switch between them per tile.
+ *
+ * @param  k       Data point dimension
+ * @param  mr      Number of valid rows ( 1 ~ 8 )
+ * @param  nr      Number of valid columns ( 1 ~ 6 )
+ * @param  rhs     Number of right hand sides
+ * @param  *u      Packed potentials ( 8 )
+ * @param  *aa     Packed target square 2-norms ( 8 )
+ * @param  *a      Packed target coordinates ( 8 * k )
+ * @param  *bb     Packed source square 2-norms ( 6 )
+ * @param  *b      Packed source coordinates ( 6 * k )
+ * @param  *w      Packed weights ( 6 )
+ * @param  *c      Accumulated rank-k update if aux->pc != 0
+ * --------------------------------------------------------------------------
+ */
+void fringe_int_d8x6(
+    int    k,
+    int    mr,
+    int    nr,
+    int    rhs,
+    double *u,
+    double *aa,
+    double *a,
+    double *bb,
+    double *b,
+    double *w,
+    double *c,
+    ks_t   *ker,
+    aux_t  *aux
+    )
+{
+  int    r, j, p, nv, dist;
+  v4df_t c_tmp[ 2 ][ 6 ];
+  v4df_t a_tmp, b_tmp, u_tmp;
+
+  (void)rhs;                             // KS_RHS is fixed at compile time
+
+  // Number of 4-wide row vectors that carry valid targets.
+  nv = ( mr > 4 ) ? 2 : 1;
+
+  // Low dimension tiles take the square distances directly, see
+  // lowdim_int_d8x6.c.
+  dist = ( !aux->pc && k <= DKS_LOWDIM_KMAX && eval_is_dist( ker->type ) );
+
+  for ( r = 0; r < nv; r ++ ) {
+    for ( j = 0; j < nr; j ++ ) {
+      c_tmp[ r ][ j ].v = _mm256_setzero_pd();
+    }
+  }
+
+  // Rank-k update on the live part of the tile.
+  for ( p = 0; p < k; p ++ ) {
+    for ( r = 0; r < nv; r ++ ) {
+      a_tmp.v = _mm256_load_pd( a + p * 8 + r * 4 );
+      for ( j = 0; j < nr; j ++ ) {
+        b_tmp.v = _mm256_broadcast_sd( b + p * 6 + j );
+        if ( dist ) {
+          b_tmp.v = _mm256_sub_pd( a_tmp.v, b_tmp.v );
+          c_tmp[ r ][ j ].v = _mm256_fmadd_pd( b_tmp.v, b_tmp.v, c_tmp[ r ][ j ].v );
+        }
+        else {
+          c_tmp[ r ][ j ].v = _mm256_fmadd_pd( a_tmp.v, b_tmp.v, c_tmp[ r ][ j ].v );
+        }
+      }
+    }
+  }
+
+  // Accumulate the previous kc slices ( k > DKS_KC ).
+  if ( aux->pc ) {
+    for ( r = 0; r < nv; r ++ ) {
+      for ( j = 0; j < nr; j ++ ) {
+        a_tmp.v = _mm256_load_pd( c + j * 8 + r * 4 );
+        c_tmp[ r ][ j ].v = _mm256_add_pd( a_tmp.v, c_tmp[ r ][ j ].v );
+      }
+    }
+  }
+
+  // Kernel evaluation
+  for ( r = 0; r < nv; r ++ ) {
+    if ( !dist && eval_is_dist( ker->type ) ) {
+      a_tmp.v = _mm256_load_pd( aa + r * 4 );
+      for ( j = 0; j < nr; j ++ ) {
+        c_tmp[ r ][ j ].v = sq2nrm_d4( c_tmp[ r ][ j ].v, a_tmp.v, bb + j );
+      }
+    }
+    eval_int_d4x6( ker, nr, c_tmp[ r ], aux->hi + r * 4, aux->hj );
+  }
+
+  // Weighted sum on the live columns only.
+  for ( r = 0; r < nv; r ++ ) {
+    u_tmp.v = _mm256_load_pd( u + r * 4 );
+    for ( j = 0; j < nr; j ++ ) {
+      b_tmp.v = _mm256_broadcast_sd( w + j );
+      u_tmp.v = _mm256_fmadd_pd( c_tmp[ r ][ j ].v, b_tmp.v, u_tmp.v );
+    }
+    _mm256_store_pd( u + r * 4, u_tmp.v );
+  }
+}
@@ -10,4 +10,12 @@
 #define DKS_PACK_MR 8
 #define DKS_PACK_NR 6
 
+// Edge tiles with at most DKS_FRINGE_MR rows or fewer than DKS_NR columns
+// are handed to the fringe micro-kernel.
+#define DKS_FRINGE_MR 4
+
+// Dimensions up to DKS_LOWDIM_KMAX use the unrolled direct distance
+// micro-kernels in lowdim_int_d8x6.c.
+#define DKS_LOWDIM_KMAX 4
+
 // Single Precision Parameters
@@ -26,6 +26,23 @@
     aux_t  *aux            \
     )
 
+#define KERNEL3(name,type) \
+  name(                    \
+    int    k,              \
+    int    mr,             \
+    int    nr,             \
+    int    rhs,            \
+    type   *u,             \
+    type   *a,             \
+    type   *aa,            \
+    type   *b,             \
+    type   *bb,            \
+    type   *w,             \
+    type   *c,             \
+    ks_t   *ker,           \
+    aux_t  *aux            \
+    )
+
 void KERNEL1(rank_k_int_d8x6,double);
 void KERNEL1(rank_k_asm_d8x6,double);
 void KERNEL2(gaussian_int_d8x6,double);
@@ -36,6 +53,11 @@ void KERNEL2(tanh_int_d8x6,double);
 void KERNEL2(quartic_int_d8x6,double);
 void KERNEL2(multiquadratic_int_d8x6,double);
 void KERNEL2(epanechnikov_int_d8x6,double);
+void KERNEL2(lowdim_int_d8x6_k1,double);
+void KERNEL2(lowdim_int_d8x6_k2,double);
+void KERNEL2(lowdim_int_d8x6_k3,double);
+void KERNEL2(lowdim_int_d8x6_k4,double);
+void KERNEL3(fringe_int_d8x6,double);
 
 void KERNEL1((*rankk),double)  = {
   rank_k_asm_d8x6
@@ -53,4 +75,15 @@ void KERNEL2((*micro[ 8 ]),double) = {
   epanechnikov_int_d8x6
 };
 
+void KERNEL2((*lowdim[ 4 ]),double) = {
+  lowdim_int_d8x6_k1,
+  lowdim_int_d8x6_k2,
+  lowdim_int_d8x6_k3,
+  lowdim_int_d8x6_k4
+};
+
+void KERNEL3((*fringe),double) = {
+  fringe_int_d8x6
+};
+
 #endif // define __GSKS_KERNEL_H__
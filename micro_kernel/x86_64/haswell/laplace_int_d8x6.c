@@ -37,5 +37,88 @@ void laplace_int_d8x6(
     aux_t  *aux
     )
 {
-  printf( "laplace_int_d8x6 not yet implemented.\n" );
+  int    i;
+  double tiny  = 1E-15;
+  double huge  = 1.79E+308;
+  double powe  = ker->powe;
+  double alpha = ker->scal;
+  // 16 registers.
+  v4df_t c03_0, c03_1, c03_2, c03_3, c03_4, c03_5;
+  v4df_t c47_0, c47_1, c47_2, c47_3, c47_4, c47_5;
+  v4df_t a03, a47, b0, b1;
+
+  #include <rank_k_int_d8x6.h>
+  #include <sq2nrm_int_d8x6.h>
+
+  // Prefetch u, w
+  __asm__ volatile( "prefetcht0 0(%0)    \n\t" : :"r"( u ) );
+  __asm__ volatile( "prefetcht0 0(%0)    \n\t" : :"r"( w ) );
+
+  // If c < 1E-15, then c = 1.79E+308 so that the self interaction is
+  // (almost) zero, as in the fringe and low dimension kernels.
+  a03.v   = _mm256_broadcast_sd( &tiny );
+  a47.v   = _mm256_broadcast_sd( &huge );
+  b1.v    = _mm256_cmp_pd( c03_0.v, a03.v, _CMP_LT_OQ );
+  c03_0.v = _mm256_blendv_pd( c03_0.v, a47.v, b1.v );
+  b1.v    = _mm256_cmp_pd( c03_1.v, a03.v, _CMP_LT_OQ );
+  c03_1.v = _mm256_blendv_pd( c03_1.v, a47.v, b1.v );
+  b1.v    = _mm256_cmp_pd( c03_2.v, a03.v, _CMP_LT_OQ );
+  c03_2.v = _mm256_blendv_pd( c03_2.v, a47.v, b1.v );
+  b1.v    = _mm256_cmp_pd( c03_3.v, a03.v, _CMP_LT_OQ );
+  c03_3.v = _mm256_blendv_pd( c03_3.v, a47.v, b1.v );
+  b1.v    = _mm256_cmp_pd( c03_4.v, a03.v, _CMP_LT_OQ );
+  c03_4.v = _mm256_blendv_pd( c03_4.v, a47.v, b1.v );
+  b1.v    = _mm256_cmp_pd( c03_5.v, a03.v, _CMP_LT_OQ );
+  c03_5.v = _mm256_blendv_pd( c03_5.v, a47.v, b1.v );
+
+  b1.v    = _mm256_cmp_pd( c47_0.v, a03.v, _CMP_LT_OQ );
+  c47_0.v = _mm256_blendv_pd( c47_0.v, a47.v, b1.v );
+  b1.v    = _mm256_cmp_pd( c47_1.v, a03.v, _CMP_LT_OQ );
+  c47_1.v = _mm256_blendv_pd( c47_1.v, a47.v, b1.v );
+  b1.v    = _mm256_cmp_pd( c47_2.v, a03.v, _CMP_LT_OQ );
+  c47_2.v = _mm256_blendv_pd( c47_2.v, a47.v, b1.v );
+  b1.v    = _mm256_cmp_pd( c47_3.v, a03.v, _CMP_LT_OQ );
+  c47_3.v = _mm256_blendv_pd( c47_3.v, a47.v, b1.v );
+  b1.v    = _mm256_cmp_pd( c47_4.v, a03.v, _CMP_LT_OQ );
+  c47_4.v = _mm256_blendv_pd( c47_4.v, a47.v, b1.v );
+  b1.v    = _mm256_cmp_pd( c47_5.v, a03.v, _CMP_LT_OQ );
+  c47_5.v = _mm256_blendv_pd( c47_5.v, a47.v, b1.v );
+
+  // c = scal * c^powe, powe = ( 2 - k ) / 2
+  b0.v    = _mm256_broadcast_sd( &powe );
+  c03_0.v = _mm256_pow_pd( c03_0.v, b0.v );
+  c03_1.v = _mm256_pow_pd( c03_1.v, b0.v );
+  c03_2.v = _mm256_pow_pd( c03_2.v, b0.v );
+  c03_3.v = _mm256_pow_pd( c03_3.v, b0.v );
+  c03_4.v = _mm256_pow_pd( c03_4.v, b0.v );
+  c03_5.v = _mm256_pow_pd( c03_5.v, b0.v );
+
+  c47_0.v = _mm256_pow_pd( c47_0.v, b0.v );
+  c47_1.v = _mm256_pow_pd( c47_1.v, b0.v );
+  c47_2.v = _mm256_pow_pd( c47_2.v, b0.v );
+  c47_3.v = _mm256_pow_pd( c47_3.v, b0.v );
+  c47_4.v = _mm256_pow_pd( c47_4.v, b0.v );
+  c47_5.v = _mm256_pow_pd( c47_5.v, b0.v );
+
+  a03.v   = _mm256_broadcast_sd( &alpha );
+  c03_0.v = _mm256_mul_pd( a03.v, c03_0.v );
+  c03_1.v = _mm256_mul_pd( a03.v, c03_1.v );
+  c03_2.v = _mm256_mul_pd( a03.v, c03_2.v );
+  c03_3.v = _mm256_mul_pd( a03.v, c03_3.v );
+  c03_4.v = _mm256_mul_pd( a03.v, c03_4.v );
+  c03_5.v = _mm256_mul_pd( a03.v, c03_5.v );
+
+  c47_0.v = _mm256_mul_pd( a03.v, c47_0.v );
+  c47_1.v = _mm256_mul_pd( a03.v, c47_1.v );
+  c47_2.v = _mm256_mul_pd( a03.v, c47_2.v );
+  c47_3.v = _mm256_mul_pd( a03.v, c47_3.v );
+  c47_4.v = _mm256_mul_pd( a03.v, c47_4.v );
+  c47_5.v = _mm256_mul_pd( a03.v, c47_5.v );
+
+  // Preload u03, u47
+  a03.v    = _mm256_load_pd( (double*)  u       );
+  a47.v    = _mm256_load_pd( (double*)( u + 4 ) );
+
+  // Multiple rhs weighted sum.
+  #include<weighted_sum_int_d8x6.h>
 }
@@ -0,0 +1,162 @@
+#include <math.h>
+#include <immintrin.h> // AVX
+#include <ks.h>
+#include <gsks_internal.h>
+#include <avx_type.h>
+#include <gsks_config.h>
+#include <eval_int_d4x6.h>
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  This is the 8x6 micro-kernel body for very low dimensions
+ *         ( k <= DKS_LOWDIM_KMAX ). It is instantiated once per k below so
+ *         that the compiler sees a constant trip count and fully unrolls
+ *         the k loop.
+ *
+ *         Distance based kernels accumulate ( a - b )^2 directly instead
+ *         of aa - 2ab + bb. At k = 1 ~ 4 this costs one extra subtraction
+ *         per term, but there is no norm expansion epilogue, and nearby
+ *         points no longer lose their digits to cancellation.
+ *
+ *         Only called with aux->pc == 0; k never exceeds DKS_KC here.
+ *         The wrappers pass k as a constant and never read aa, bb or c.
+ * --------------------------------------------------------------------------
+ */
+static inline void lowdim_d8x6(
+    const int k,
+    double *u,
+    double *a,
+    double *b,
+    double *w,
+    ks_t   *ker,
+    aux_t  *aux
+    )
+{
+  int    j, p, dist;
+  v4df_t c03[ 6 ], c47[ 6 ];
+  v4df_t a03, a47, b0, d03, d47;
+
+  dist = eval_is_dist( ker->type );
+
+  __asm__ volatile( "prefetcht0 0(%0)    \n\t" : :"r"( u ) );
+  __asm__ volatile( "prefetcht0 0(%0)    \n\t" : :"r"( w ) );
+
+  for ( j = 0; j < 6; j ++ ) {
+    c03[ j ].v = _mm256_setzero_pd();
+    c47[ j ].v = _mm256_setzero_pd();
+  }
+
+  if ( dist ) {
+    for ( p = 0; p < k; p ++ ) {
+      a03.v = _mm256_load_pd( a + p * 8     );
+      a47.v = _mm256_load_pd( a + p * 8 + 4 );
+      for ( j = 0; j < 6; j ++ ) {
+        b0.v       = _mm256_broadcast_sd( b + p * 6 + j );
+        d03.v      = _mm256_sub_pd( a03.v, b0.v );
+        d47.v      = _mm256_sub_pd( a47.v, b0.v );
+        c03[ j ].v = _mm256_fmadd_pd( d03.v, d03.v, c03[ j ].v );
+        c47[ j ].v = _mm256_fmadd_pd( d47.v, d47.v, c47[ j ].v );
+      }
+    }
+  }
+  else {
+    for ( p = 0; p < k; p ++ ) {
+      a03.v = _mm256_load_pd( a + p * 8     );
+      a47.v = _mm256_load_pd( a + p * 8 + 4 );
+      for ( j = 0; j < 6; j ++ ) {
+        b0.v       = _mm256_broadcast_sd( b + p * 6 + j );
+        c03[ j ].v = _mm256_fmadd_pd( a03.v, b0.v, c03[ j ].v );
+        c47[ j ].v = _mm256_fmadd_pd( a47.v, b0.v, c47[ j ].v );
+      }
+    }
+  }
+
+  eval_int_d4x6( ker, 6, c03, aux->hi,     aux->hj );
+  eval_int_d4x6( ker, 6, c47, aux->hi + 4, aux->hj );
+
+  // Weighted sum
+  a03.v = _mm256_load_pd( u     );
+  a47.v = _mm256_load_pd( u + 4 );
+  for ( j = 0; j < 6; j ++ ) {
+    b0.v  = _mm256_broadcast_sd( w + j );
+    a03.v = _mm256_fmadd_pd( c03[ j ].v, b0.v, a03.v );
+    a47.v = _mm256_fmadd_pd( c47[ j ].v, b0.v, a47.v );
+  }
+  _mm256_store_pd( u    , a03.v );
+  _mm256_store_pd( u + 4, a47.v );
+}
+
+
+void lowdim_int_d8x6_k1(
+    int    k,
+    int    rhs,
+    double *u,
+    double *aa,
+    double *a,
+    double *bb,
+    double *b,
+    double *w,
+    double *c,
+    ks_t   *ker,
+    aux_t  *aux
+    )
+{
+  (void)k; (void)rhs; (void)aa; (void)bb; (void)c;
+  lowdim_d8x6( 1, u, a, b, w, ker, aux );
+}
+
+void lowdim_int_d8x6_k2(
+    int    k,
+    int    rhs,
+    double *u,
+    double *aa,
+    double *a,
+    double *bb,
+    double *b,
+    double *w,
+    double *c,
+    ks_t   *ker,
+    aux_t  *aux
+    )
+{
+  (void)k; (void)rhs; (void)aa; (void)bb; (void)c;
+  lowdim_d8x6( 2, u, a, b, w, ker, aux );
+}
+
+void lowdim_int_d8x6_k3(
+    int    k,
+    int    rhs,
+    double *u,
+    double *aa,
+    double *a,
+    double *bb,
+    double *b,
+    double *w,
+    double *c,
+    ks_t   *ker,
+    aux_t  *aux
+    )
+{
+  (void)k; (void)rhs; (void)aa; (void)bb; (void)c;
+  lowdim_d8x6( 3, u, a, b, w, ker, aux );
+}
+
+void lowdim_int_d8x6_k4(
+    int    k,
+    int    rhs,
+    double *u,
+    double *aa,
+    double *a,
+    double *bb,
+    double *b,
+    double *w,
+    double *c,
+    ks_t   *ker,
+    aux_t  *aux
+    )
+{
+  (void)k; (void)rhs; (void)aa; (void)bb; (void)c;
+  lowdim_d8x6( 4, u, a, b, w, ker, aux );
+}
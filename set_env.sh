@@ -27,6 +27,14 @@ echo "GSKS_USE_BLAS = $GSKS_USE_BLAS"
 export GSKS_USE_VML=true
 echo "GSKS_USE_VML = $GSKS_USE_VML"
 
+## Whether use libnuma for the NUMA topology? (otherwise read /sys)
+export GSKS_USE_NUMA=false
+echo "GSKS_USE_NUMA = $GSKS_USE_NUMA"
+
+## Whether collect per-phase statistics? (gsks_stats_get())
+export GSKS_USE_STATS=false
+echo "GSKS_USE_STATS = $GSKS_USE_STATS"
+
 ## Compile with KNL –xMIC-AVX512
 export GSKS_MIC_AVX512=true
 
@@ -0,0 +1,721 @@
+/*
+ * bench_dgsks.c
+ *
+ * Chenhan D. Yu
+ *
+ * Department of Computer Science, University of Texas at Austin
+ *
+ * Purpose:
+ * this is the benchmark driver of dgsks(). It sweeps kernels, m, n, k,
+ * the number of threads ( KS_IC_NT ) and the index map pattern, repeats
+ * every configuration and reports the median and percentiles of the
+ * runtime as text, CSV or JSON. It replaces the MATLAB style output of
+ * run_dgsks.sh for regression tracking across releases.
+ *
+ * Usage:
+ *   bench_dgsks.x [ --kernel all | Gaussian,Polynomial,... ]
+ *                 [ --m 1000:4000:1000 ] [ --n 4097 ] [ --k 4,16,64 ]
+ *                 [ --threads 1,2,4 ] [ --map identity,random,strided ]
+ *                 [ --reps 10 ] [ --warmup 1 ] [ --cold ]
+ *                 [ --format text | csv | json ] [ --out file ]
+ *                 [ --perf ] [ --fit ]
+ *
+ *   --perf adds hardware counters ( per call ) and roofline numbers, see
+ *   ks_perf.h.
+ *
+ *   --fit fits the time model of ks_cost.c for every kernel instead ( at
+ *   --k, default 4,36,260; Laplace at 3 ) and writes it in the KS_COST_FILE
+ *   format, e.g. bench_dgsks.x --fit --out gsks_cost.txt.
+ *
+ *   Ranges are beg:end:inc ( end inclusive ) or comma separated lists.
+ *
+ * Todo:
+ *
+ * Modification:
+ *
+ * */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include <math.h>
+#include <ks.h>
+#include "ks_perf.h"
+
+
+#define BENCH_MAX_LIST   256
+#define BENCH_NUM_POINTS 32000
+#define BENCH_FLUSH_SIZE ( 64 * 1024 * 1024 )
+
+typedef enum {
+  BENCH_MAP_IDENTITY,
+  BENCH_MAP_RANDOM,
+  BENCH_MAP_STRIDED,
+  BENCH_MAP_NUM
+} bench_map_t;
+
+static const char *bench_map_name[ BENCH_MAP_NUM ] = {
+  "identity",
+  "random",
+  "strided"
+};
+
+static const char *bench_kernel_name[] = {
+  "Gaussian",
+  "Polynomial",
+  "Laplace",
+  "Var_bandwidth",
+  "Tanh",
+  "Quartic",
+  "Multiquadratic",
+  "Epanechnikov"
+};
+
+#define BENCH_NUM_KERNEL ( (int)( sizeof(bench_kernel_name) / sizeof(char*) ) )
+
+typedef enum {
+  BENCH_TEXT,
+  BENCH_CSV,
+  BENCH_JSON
+} bench_format_t;
+
+struct bench_list_s {
+  int    n;
+  int    v[ BENCH_MAX_LIST ];
+};
+
+typedef struct bench_list_s bench_list_t;
+
+struct bench_result_s {
+  double median;
+  double p10;
+  double p90;
+  double min;
+  double max;
+  double flops;
+  int    perf;                      // counters below are valid
+  double counter[ KS_PERF_NUM ];    // per call, -1 if not available
+  ks_roofline_t roof;
+};
+
+typedef struct bench_result_s bench_result_t;
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Parse "beg:end:inc" ( end inclusive ) or "a,b,c" into a list.
+ * --------------------------------------------------------------------------
+ */
+void bench_parse_list(
+    const char   *str,
+    bench_list_t *list
+    )
+{
+  int    beg, end, inc;
+
+  list->n = 0;
+
+  if ( sscanf( str, "%d:%d:%d", &beg, &end, &inc ) == 3 && inc > 0 ) {
+    for ( ; beg <= end && list->n < BENCH_MAX_LIST; beg += inc ) {
+      list->v[ list->n ++ ] = beg;
+    }
+    return;
+  }
+
+  while ( *str && list->n < BENCH_MAX_LIST ) {
+    list->v[ list->n ++ ] = (int)strtol( str, (char**)&str, 10 );
+    if ( *str == ',' ) str ++;
+    else break;
+  }
+}
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Parse a comma separated list of names against a table. "all"
+ *         selects every entry.
+ * --------------------------------------------------------------------------
+ */
+void bench_parse_names(
+    const char   *str,
+    const char   **table,
+    int          ntable,
+    bench_list_t *list
+    )
+{
+  char   buf[ 1024 ], *tok;
+  int    i;
+
+  list->n = 0;
+
+  if ( !strcmp( str, "all" ) ) {
+    for ( i = 0; i < ntable; i ++ ) list->v[ list->n ++ ] = i;
+    return;
+  }
+
+  strncpy( buf, str, sizeof(buf) - 1 );
+  buf[ sizeof(buf) - 1 ] = '\0';
+
+  for ( tok = strtok( buf, "," ); tok; tok = strtok( NULL, "," ) ) {
+    for ( i = 0; i < ntable; i ++ ) {
+      if ( !strcmp( tok, table[ i ] ) ) break;
+    }
+    if ( i == ntable ) {
+      fprintf( stderr, "bench_dgsks(): unknown name %s\n", tok );
+      exit( 1 );
+    }
+    list->v[ list->n ++ ] = i;
+  }
+}
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Kernel parameters, same defaults as test_dgsks.c.
+ * --------------------------------------------------------------------------
+ */
+void bench_setup_kernel(
+    ks_t   *kernel,
+    int    id
+    )
+{
+  memset( kernel, 0, sizeof(ks_t) );
+
+  switch ( id ) {
+    case 0:
+      kernel->type = KS_GAUSSIAN;
+      kernel->scal = -0.5;
+      break;
+    case 1:
+      kernel->type = KS_POLYNOMIAL;
+      kernel->powe = 4.0;
+      kernel->scal = 0.1;
+      kernel->cons = 0.1;
+      break;
+    case 2:
+      kernel->type = KS_LAPLACE;
+      break;
+    case 3:
+      kernel->type = KS_GAUSSIAN_VAR_BANDWIDTH;
+      break;
+    case 4:
+      kernel->type = KS_TANH;
+      kernel->scal = 0.1;
+      kernel->cons = 0.1;
+      break;
+    case 5:
+      kernel->type = KS_QUARTIC;
+      break;
+    case 6:
+      kernel->type = KS_MULTIQUADRATIC;
+      kernel->cons = 1.0;
+      break;
+    case 7:
+      kernel->type = KS_EPANECHNIKOV;
+      break;
+  }
+}
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Flops per target-source pair. The rank-k update costs 2k, the
+ *         rest is the kernel evaluation and the weighted sum; the
+ *         evaluation counts are the ones of test_dgsks.c.
+ * --------------------------------------------------------------------------
+ */
+double bench_flops_per_pair(
+    ks_type type,
+    int    k
+    )
+{
+  switch ( type ) {
+    case KS_GAUSSIAN:               return 2.0 * k + 37;
+    case KS_GAUSSIAN_VAR_BANDWIDTH: return 2.0 * k + 35;
+    case KS_POLYNOMIAL:             return 2.0 * k + 6;
+    case KS_LAPLACE:                return 2.0 * k + 60;
+    case KS_TANH:                   return 2.0 * k + 89;
+    case KS_QUARTIC:                return 2.0 * k + 8;
+    case KS_MULTIQUADRATIC:         return 2.0 * k + 6;
+    case KS_EPANECHNIKOV:           return 2.0 * k + 7;
+  }
+  return 2.0 * k;
+}
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Fit and print the ks_cost.c coefficients of every kernel.
+ * --------------------------------------------------------------------------
+ */
+void bench_fit(
+    FILE         *fp,
+    bench_list_t *kernels,
+    bench_list_t *ks
+    )
+{
+  int       ik, i, k3 = 3;
+  ks_t      kernel;
+  ks_cost_t cost;
+
+  fprintf( fp, "# kernel c0 cpack cflop cpair ( seconds ), KS_IC_NT=%s\n",
+      getenv( "KS_IC_NT" ) ? getenv( "KS_IC_NT" ) : "1" );
+
+  for ( ik = 0; ik < kernels->n; ik ++ ) {
+    bench_setup_kernel( &kernel, kernels->v[ ik ] );
+    if ( kernel.type == KS_GAUSSIAN_VAR_BANDWIDTH ) {
+      kernel.hi = (double*)malloc( sizeof(double) * 1024 );
+      kernel.hj = (double*)malloc( sizeof(double) * 1024 );
+      for ( i = 0; i < 1024; i ++ ) kernel.hi[ i ] = kernel.hj[ i ] = -0.5;
+    }
+
+    if ( kernel.type == KS_LAPLACE ) {
+      ks_cost_fit( &kernel, 1, &k3, &cost );
+    }
+    else {
+      ks_cost_fit( &kernel, ks->n, ks->v, &cost );
+    }
+
+    fprintf( fp, "%-14s %.4E %.4E %.4E %.4E\n", ks_cost_name( kernel.type ),
+        cost.c0, cost.cpack, cost.cflop, cost.cpair );
+    fflush( fp );
+
+    if ( kernel.type == KS_GAUSSIAN_VAR_BANDWIDTH ) {
+      free( kernel.hi );
+      free( kernel.hj );
+    }
+  }
+}
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Index maps of length len over nx points. random is a random
+ *         subset in random order, strided touches every stride-th point.
+ * --------------------------------------------------------------------------
+ */
+void bench_fill_map(
+    bench_map_t pattern,
+    int    *map,
+    int    len,
+    int    nx,
+    int    offset
+    )
+{
+  int    i, j, tmp, stride;
+  int    *perm;
+
+  switch ( pattern ) {
+    case BENCH_MAP_IDENTITY:
+      for ( i = 0; i < len; i ++ ) map[ i ] = ( offset + i ) % nx;
+      break;
+    case BENCH_MAP_RANDOM:
+      perm = (int*)malloc( sizeof(int) * nx );
+      for ( i = 0; i < nx; i ++ ) perm[ i ] = i;
+      for ( i = 0; i < len; i ++ ) {
+        j = i + rand() % ( nx - i );
+        tmp = perm[ i ]; perm[ i ] = perm[ j ]; perm[ j ] = tmp;
+        map[ i ] = perm[ i ];
+      }
+      free( perm );
+      break;
+    case BENCH_MAP_STRIDED:
+      stride = nx / len;
+      if ( stride < 1 ) stride = 1;
+      for ( i = 0; i < len; i ++ ) map[ i ] = ( offset + i * stride ) % nx;
+      break;
+    default:
+      break;
+  }
+}
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Evict the caches by streaming through a buffer larger than the
+ *         last level cache.
+ * --------------------------------------------------------------------------
+ */
+volatile double bench_sink;
+
+void bench_flush( double *buf )
+{
+  int    i, len = BENCH_FLUSH_SIZE / sizeof(double);
+  double sum = 0.0;
+
+  #pragma omp parallel for reduction( +:sum )
+  for ( i = 0; i < len; i ++ ) {
+    buf[ i ] += 1.0;
+    sum += buf[ i ];
+  }
+  bench_sink = sum;
+}
+
+
+int bench_compare( const void *a, const void *b )
+{
+  double x = *(const double*)a, y = *(const double*)b;
+  return ( x > y ) - ( x < y );
+}
+
+
+/* Linear interpolation between the order statistics. */
+double bench_percentile(
+    double *sorted,
+    int    n,
+    double q
+    )
+{
+  double pos = q * ( n - 1 );
+  int    lo  = (int)floor( pos );
+  int    hi  = ( lo + 1 < n ) ? lo + 1 : lo;
+
+  return sorted[ lo ] + ( pos - lo ) * ( sorted[ hi ] - sorted[ lo ] );
+}
+
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Run one configuration. warmup calls are not timed; with cold
+ *         the caches are flushed before every timed call.
+ * --------------------------------------------------------------------------
+ */
+void bench_dgsks(
+    ks_t   *kernel,
+    int    m,
+    int    n,
+    int    k,
+    int    nt,
+    bench_map_t pattern,
+    int    reps,
+    int    warmup,
+    int    cold,
+    double *flush,
+    ks_perf_t *perf,
+    bench_result_t *result
+    )
+{
+  int    i, p, nx, iter, e;
+  int    *amap, *bmap, *umap, *wmap;
+  double *XA, *XA2, *u, *w, *time, beg, total = 0.0;
+  char   nt_str[ 16 ];
+
+  nx = BENCH_NUM_POINTS;
+  if ( nx < m || nx < n ) nx = ( m > n ) ? m : n;
+
+  amap = (int*)malloc( sizeof(int) * m );
+  umap = (int*)malloc( sizeof(int) * m );
+  bmap = (int*)malloc( sizeof(int) * n );
+  wmap = (int*)malloc( sizeof(int) * n );
+  XA   = (double*)malloc( sizeof(double) * k * nx );
+  XA2  = (double*)malloc( sizeof(double) * nx );
+  u    = (double*)malloc( sizeof(double) * nx * KS_RHS );
+  w    = (double*)malloc( sizeof(double) * nx * KS_RHS );
+  time = (double*)malloc( sizeof(double) * reps );
+
+  for ( i = 0; i < nx * KS_RHS; i ++ ) {
+    u[ i ] = 0.0;
+    w[ i ] = (double)( rand() % 1000 ) / 1000.0;
+  }
+
+  for ( i = 0; i < nx; i ++ ) {
+    XA2[ i ] = 0.0;
+    for ( p = 0; p < k; p ++ ) {
+      XA[ i * k + p ] = (double)( rand() % 100 ) / 1000.0;
+      XA2[ i ] += XA[ i * k + p ] * XA[ i * k + p ];
+    }
+  }
+
+  bench_fill_map( pattern, amap, m, nx, 0 );
+  bench_fill_map( pattern, bmap, n, nx, nx / 2 );
+  memcpy( umap, amap, sizeof(int) * m );
+  memcpy( wmap, bmap, sizeof(int) * n );
+
+  if ( kernel->type == KS_GAUSSIAN_VAR_BANDWIDTH ) {
+    kernel->hi = (double*)malloc( sizeof(double) * nx );
+    kernel->hj = (double*)malloc( sizeof(double) * nx );
+    for ( i = 0; i < nx; i ++ ) {
+      kernel->hi[ i ] = ( 1.0 + 0.5 / ( 1 + exp( -1.0 * XA2[ i ] ) ) );
+      kernel->hi[ i ] = -1.0 / ( 2.0 * kernel->hi[ i ] * kernel->hi[ i ] );
+      kernel->hj[ i ] = kernel->hi[ i ];
+    }
+  }
+
+  // dgsks() reads KS_IC_NT on every call.
+  sprintf( nt_str, "%d", nt );
+  setenv( "KS_IC_NT", nt_str, 1 );
+
+  if ( perf ) ks_perf_reset( perf );
+
+  for ( iter = -warmup; iter < reps; iter ++ ) {
+    if ( cold ) bench_flush( flush );
+    if ( perf && iter >= 0 ) ks_perf_start( perf );
+    beg = omp_get_wtime();
+    dgsks(
+        kernel,
+        m, n, k,
+        u,       umap,
+        XA, XA2, amap,
+        XA, XA2, bmap,
+        w,       wmap
+        );
+    if ( iter >= 0 ) {
+      time[ iter ] = omp_get_wtime() - beg;
+      total += time[ iter ];
+      if ( perf ) ks_perf_stop( perf );
+    }
+  }
+
+  qsort( time, reps, sizeof(double), bench_compare );
+  result->median = bench_percentile( time, reps, 0.5 );
+  result->p10    = bench_percentile( time, reps, 0.1 );
+  result->p90    = bench_percentile( time, reps, 0.9 );
+  result->min    = time[ 0 ];
+  result->max    = time[ reps - 1 ];
+  result->flops  = (double)m * n * bench_flops_per_pair( kernel->type, k );
+  result->perf   = ( perf != NULL );
+
+  if ( perf ) {
+    for ( e = 0; e < KS_PERF_NUM; e ++ ) {
+      long long val = ks_perf_value( perf, (ks_perf_event_t)e );
+      result->counter[ e ] = ( val < 0 ) ? -1.0 : (double)val / reps;
+    }
+    ks_perf_roofline( perf, result->flops * reps, total, &result->roof );
+  }
+
+  if ( kernel->type == KS_GAUSSIAN_VAR_BANDWIDTH ) {
+    free( kernel->hi );
+    free( kernel->hj );
+  }
+  free( amap );
+  free( umap );
+  free( bmap );
+  free( wmap );
+  free( XA );
+  free( XA2 );
+  free( u );
+  free( w );
+  free( time );
+}
+
+
+
+void bench_print(
+    FILE   *fp,
+    bench_format_t format,
+    int    first,
+    const char *kname,
+    int    m,
+    int    n,
+    int    k,
+    int    nt,
+    const char *map,
+    int    cold,
+    int    reps,
+    bench_result_t *r
+    )
+{
+  double gflops = r->flops / r->median * 1E-9;
+  double pairs  = (double)m * n / r->median;
+  double *c     = r->counter;
+
+  switch ( format ) {
+    case BENCH_TEXT:
+      fprintf( fp, "%-14s m %6d n %6d k %5d nt %3d %-8s %s: "
+          "median %.4E s ( p10 %.4E, p90 %.4E ), %7.2lf GFLOPS\n",
+          kname, m, n, k, nt, map, cold ? "cold" : "warm",
+          r->median, r->p10, r->p90, gflops );
+      if ( r->perf ) {
+        fprintf( fp, "%-14s ipc %.2lf, flops/cycle %.2lf ( %.1lf%% peak ), "
+            "L1D %.3E, L2 %.3E, LLC %.3E misses, %.2lf GB/s, %.2lf flops/byte\n",
+            "", r->roof.ipc, r->roof.flops_per_cycle, r->roof.pct_peak,
+            c[ KS_PERF_L1D_MISS ], c[ KS_PERF_L2_MISS ], c[ KS_PERF_LLC_MISS ],
+            r->roof.bandwidth * 1E-9, r->roof.intensity );
+      }
+      break;
+    case BENCH_CSV:
+      if ( first ) {
+        fprintf( fp, "kernel,m,n,k,threads,map,cache,reps,"
+            "median_s,p10_s,p90_s,min_s,max_s,gflops,pairs_per_s" );
+        if ( r->perf ) {
+          fprintf( fp, ",cycles,instructions,l1d_miss,l2_miss,llc_miss,"
+              "ipc,flops_per_cycle,pct_peak,dram_bytes,bandwidth_Bps,intensity" );
+        }
+        fprintf( fp, "\n" );
+      }
+      fprintf( fp, "%s,%d,%d,%d,%d,%s,%s,%d,%.6E,%.6E,%.6E,%.6E,%.6E,%.4lf,%.6E",
+          kname, m, n, k, nt, map, cold ? "cold" : "warm", reps,
+          r->median, r->p10, r->p90, r->min, r->max, gflops, pairs );
+      if ( r->perf ) {
+        fprintf( fp, ",%.6E,%.6E,%.6E,%.6E,%.6E,%.4lf,%.4lf,%.2lf,%.6E,%.6E,%.4lf",
+            c[ KS_PERF_CYCLES ], c[ KS_PERF_INSTR ], c[ KS_PERF_L1D_MISS ],
+            c[ KS_PERF_L2_MISS ], c[ KS_PERF_LLC_MISS ],
+            r->roof.ipc, r->roof.flops_per_cycle, r->roof.pct_peak,
+            r->roof.dram_bytes, r->roof.bandwidth, r->roof.intensity );
+      }
+      fprintf( fp, "\n" );
+      break;
+    case BENCH_JSON:
+      fprintf( fp, "%s  { \"kernel\": \"%s\", \"m\": %d, \"n\": %d, \"k\": %d, "
+          "\"threads\": %d, \"map\": \"%s\", \"cache\": \"%s\", \"reps\": %d, "
+          "\"median_s\": %.6E, \"p10_s\": %.6E, \"p90_s\": %.6E, "
+          "\"min_s\": %.6E, \"max_s\": %.6E, \"gflops\": %.4lf, "
+          "\"pairs_per_s\": %.6E",
+          first ? "" : ",\n",
+          kname, m, n, k, nt, map, cold ? "cold" : "warm", reps,
+          r->median, r->p10, r->p90, r->min, r->max, gflops, pairs );
+      if ( r->perf ) {
+        fprintf( fp, ", \"cycles\": %.6E, \"instructions\": %.6E, "
+            "\"l1d_miss\": %.6E, \"l2_miss\": %.6E, \"llc_miss\": %.6E, "
+            "\"ipc\": %.4lf, \"flops_per_cycle\": %.4lf, \"pct_peak\": %.2lf, "
+            "\"dram_bytes\": %.6E, \"bandwidth_Bps\": %.6E, \"intensity\": %.4lf",
+            c[ KS_PERF_CYCLES ], c[ KS_PERF_INSTR ], c[ KS_PERF_L1D_MISS ],
+            c[ KS_PERF_L2_MISS ], c[ KS_PERF_LLC_MISS ],
+            r->roof.ipc, r->roof.flops_per_cycle, r->roof.pct_peak,
+            r->roof.dram_bytes, r->roof.bandwidth, r->roof.intensity );
+      }
+      fprintf( fp, " }" );
+      break;
+  }
+  fflush( fp );
+}
+
+
+
+int main( int argc, char *argv[] )
+{
+  bench_list_t   kernels, ms, ns, ks, nts, maps;
+  bench_format_t format = BENCH_TEXT;
+  bench_result_t result;
+  int    reps = 10, warmup = 1, cold = 0, first = 1, use_perf = 0;
+  int    fit = 0, ks_set = 0;
+  int    a, ik, im, in, ikk, it, ip, ntmax;
+  double *flush = NULL;
+  ks_perf_t *perf = NULL;
+  FILE   *fp = stdout;
+  ks_t   kernel;
+
+  bench_parse_names( "all", bench_kernel_name, BENCH_NUM_KERNEL, &kernels );
+  bench_parse_list( "3600", &ms );
+  bench_parse_list( "4097", &ns );
+  bench_parse_list( "4:2048:31", &ks );
+  bench_parse_list( "1", &nts );
+  bench_parse_names( "identity", bench_map_name, BENCH_MAP_NUM, &maps );
+
+  for ( a = 1; a < argc; a ++ ) {
+    if ( !strcmp( argv[ a ], "--cold" ) ) {
+      cold = 1;
+      continue;
+    }
+    if ( !strcmp( argv[ a ], "--perf" ) ) {
+      use_perf = 1;
+      continue;
+    }
+    if ( !strcmp( argv[ a ], "--fit" ) ) {
+      fit = 1;
+      continue;
+    }
+    if ( a + 1 >= argc ) {
+      fprintf( stderr, "bench_dgsks(): %s needs a value\n", argv[ a ] );
+      exit( 1 );
+    }
+    if      ( !strcmp( argv[ a ], "--kernel" ) )  bench_parse_names( argv[ ++ a ], bench_kernel_name, BENCH_NUM_KERNEL, &kernels );
+    else if ( !strcmp( argv[ a ], "--m" ) )       bench_parse_list( argv[ ++ a ], &ms );
+    else if ( !strcmp( argv[ a ], "--n" ) )       bench_parse_list( argv[ ++ a ], &ns );
+    else if ( !strcmp( argv[ a ], "--k" ) )       bench_parse_list( argv[ ++ a ], &ks ), ks_set = 1;
+    else if ( !strcmp( argv[ a ], "--threads" ) ) bench_parse_list( argv[ ++ a ], &nts );
+    else if ( !strcmp( argv[ a ], "--map" ) )     bench_parse_names( argv[ ++ a ], bench_map_name, BENCH_MAP_NUM, &maps );
+    else if ( !strcmp( argv[ a ], "--reps" ) )    reps   = atoi( argv[ ++ a ] );
+    else if ( !strcmp( argv[ a ], "--warmup" ) )  warmup = atoi( argv[ ++ a ] );
+    else if ( !strcmp( argv[ a ], "--format" ) ) {
+      a ++;
+      if      ( !strcmp( argv[ a ], "csv" ) )  format = BENCH_CSV;
+      else if ( !strcmp( argv[ a ], "json" ) ) format = BENCH_JSON;
+      else                                     format = BENCH_TEXT;
+    }
+    else if ( !strcmp( argv[ a ], "--out" ) ) {
+      fp = fopen( argv[ ++ a ], "w" );
+      if ( !fp ) {
+        fprintf( stderr, "bench_dgsks(): cannot open %s\n", argv[ a ] );
+        exit( 1 );
+      }
+    }
+    else {
+      fprintf( stderr, "bench_dgsks(): unknown option %s\n", argv[ a ] );
+      exit( 1 );
+    }
+  }
+
+  if ( fit ) {
+    if ( !ks_set ) bench_parse_list( "4,36,260", &ks );
+    bench_fit( fp, &kernels, &ks );
+    if ( fp != stdout ) fclose( fp );
+    return 0;
+  }
+
+  if ( reps < 1 ) reps = 1;
+  if ( warmup < 0 ) warmup = 0;
+  if ( cold ) flush = (double*)calloc( BENCH_FLUSH_SIZE / sizeof(double), sizeof(double) );
+
+  // Counters are opened once on the largest team that will run.
+  if ( use_perf ) {
+    ntmax = 1;
+    for ( it = 0; it < nts.n; it ++ ) {
+      if ( nts.v[ it ] > ntmax ) ntmax = nts.v[ it ];
+    }
+    perf = (ks_perf_t*)malloc( sizeof(ks_perf_t) );
+    ks_perf_open( perf, ntmax );
+  }
+
+  if ( format == BENCH_JSON ) fprintf( fp, "[\n" );
+
+  for ( ik = 0; ik < kernels.n; ik ++ ) {
+    bench_setup_kernel( &kernel, kernels.v[ ik ] );
+    for ( ikk = 0; ikk < ks.n; ikk ++ ) {
+      // The Laplace kernel needs k > 2.
+      if ( kernel.type == KS_LAPLACE && ks.v[ ikk ] < 3 ) continue;
+      for ( im = 0; im < ms.n; im ++ ) {
+        for ( in = 0; in < ns.n; in ++ ) {
+          for ( it = 0; it < nts.n; it ++ ) {
+            for ( ip = 0; ip < maps.n; ip ++ ) {
+              bench_dgsks(
+                  &kernel,
+                  ms.v[ im ], ns.v[ in ], ks.v[ ikk ],
+                  nts.v[ it ],
+                  (bench_map_t)maps.v[ ip ],
+                  reps, warmup, cold, flush,
+                  perf,
+                  &result
+                  );
+              bench_print(
+                  fp, format, first,
+                  bench_kernel_name[ kernels.v[ ik ] ],
+                  ms.v[ im ], ns.v[ in ], ks.v[ ikk ],
+                  nts.v[ it ],
+                  bench_map_name[ maps.v[ ip ] ],
+                  cold, reps,
+                  &result
+                  );
+              first = 0;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  if ( format == BENCH_JSON ) fprintf( fp, "\n]\n" );
+
+  if ( fp != stdout ) fclose( fp );
+  free( flush );
+  if ( perf ) {
+    ks_perf_close( perf );
+    free( perf );
+  }
+
+  return 0;
+}
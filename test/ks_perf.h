@@ -0,0 +1,271 @@
+/*
+ * ks_perf.h
+ *
+ * Chenhan D. Yu
+ *
+ * Department of Computer Science, University of Texas at Austin
+ *
+ * Purpose:
+ * Hardware counters for the test and benchmark drivers through
+ * perf_event_open(), without external tools. ks_perf_open( perf, nt )
+ * opens one set of counters on each thread of an nt-thread OpenMP team;
+ * later teams of at most nt threads reuse those threads, and the values
+ * are summed over them. The counters are inherited by threads created
+ * afterwards, so the dgsks() worker pool ( spawned by the first call )
+ * is counted with the thread that started it; open them before any
+ * dgsks() call. Counters the kernel refuses ( paranoid level, virtual
+ * machines ) are reported as -1.
+ *
+ * The L2 miss event has no generic encoding; set KS_PERF_L2_RAW to the
+ * raw event of the machine ( e.g. 0x3f24, L2_RQSTS.MISS on Haswell ).
+ *
+ * The roofline numbers take LLC misses x 64 bytes as the memory traffic
+ * and KS_PEAK_FLOPS_PER_CYCLE ( default 16, AVX2 with two FMA ports ) as
+ * the peak. Cycles are summed over the threads, so flops_per_cycle and
+ * pct_peak are per core.
+ *
+ * Todo:
+ *
+ * Modification:
+ *
+ * */
+
+#ifndef __KS_PERF_H__
+#define __KS_PERF_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+typedef enum {
+  KS_PERF_CYCLES,
+  KS_PERF_INSTR,
+  KS_PERF_L1D_MISS,
+  KS_PERF_L2_MISS,
+  KS_PERF_LLC_MISS,
+  KS_PERF_NUM
+} ks_perf_event_t;
+
+#define KS_PERF_MAX_THREAD 512
+
+struct ks_perf_s {
+  int       nt;
+  int       fd[ KS_PERF_MAX_THREAD ][ KS_PERF_NUM ];
+  int       ok[ KS_PERF_NUM ];      // opened on every thread
+  long long val[ KS_PERF_NUM ];     // accumulated over start / stop pairs
+  long long beg[ KS_PERF_NUM ];
+};
+
+typedef struct ks_perf_s ks_perf_t;
+
+struct ks_roofline_s {
+  double ipc;
+  double flops_per_cycle;
+  double pct_peak;                  // of KS_PEAK_FLOPS_PER_CYCLE
+  double dram_bytes;
+  double bandwidth;                 // bytes / sec
+  double intensity;                 // flops / byte
+};
+
+typedef struct ks_roofline_s ks_roofline_t;
+
+
+
+static inline int ks_perf_open_one(
+    unsigned int type,
+    unsigned long long config
+    )
+{
+#ifdef __linux__
+  struct perf_event_attr attr;
+
+  memset( &attr, 0, sizeof(attr) );
+  attr.size           = sizeof(attr);
+  attr.type           = type;
+  attr.config         = config;
+  attr.disabled       = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv     = 1;
+  attr.inherit        = 1;      // pool workers spawned later
+
+  return (int)syscall( __NR_perf_event_open, &attr, 0, -1, -1, 0 );
+#else
+  return -1;
+#endif
+}
+
+
+static inline void ks_perf_open(
+    ks_perf_t *perf,
+    int       nt
+    )
+{
+  memset( perf, 0, sizeof(ks_perf_t) );
+
+  if ( nt < 1 ) nt = 1;
+  if ( nt > KS_PERF_MAX_THREAD ) nt = KS_PERF_MAX_THREAD;
+  perf->nt = nt;
+
+  #pragma omp parallel num_threads( nt )
+  {
+    int    t = omp_get_thread_num();
+    int    *fd = perf->fd[ t ];
+    char   *str;
+
+    for ( int e = 0; e < KS_PERF_NUM; e ++ ) fd[ e ] = -1;
+
+#ifdef __linux__
+    fd[ KS_PERF_CYCLES ] = ks_perf_open_one(
+        PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES );
+    fd[ KS_PERF_INSTR ] = ks_perf_open_one(
+        PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS );
+    fd[ KS_PERF_L1D_MISS ] = ks_perf_open_one(
+        PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+        ( PERF_COUNT_HW_CACHE_OP_READ << 8 ) |
+        ( PERF_COUNT_HW_CACHE_RESULT_MISS << 16 ) );
+    fd[ KS_PERF_LLC_MISS ] = ks_perf_open_one(
+        PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL |
+        ( PERF_COUNT_HW_CACHE_OP_READ << 8 ) |
+        ( PERF_COUNT_HW_CACHE_RESULT_MISS << 16 ) );
+
+    str = getenv( "KS_PERF_L2_RAW" );
+    if ( str != NULL ) {
+      fd[ KS_PERF_L2_MISS ] = ks_perf_open_one(
+          PERF_TYPE_RAW, strtoull( str, NULL, 0 ) );
+    }
+#else
+    (void)str;
+#endif
+  }
+
+  for ( int e = 0; e < KS_PERF_NUM; e ++ ) {
+    perf->ok[ e ] = 1;
+    for ( int t = 0; t < nt; t ++ ) {
+      if ( perf->fd[ t ][ e ] < 0 ) perf->ok[ e ] = 0;
+    }
+  }
+}
+
+
+static inline long long ks_perf_read_one( int fd )
+{
+  long long val = 0;
+
+#ifdef __linux__
+  if ( fd < 0 || read( fd, &val, sizeof(val) ) != sizeof(val) ) return 0;
+#endif
+
+  return val;
+}
+
+
+static inline long long ks_perf_read_sum(
+    ks_perf_t *perf,
+    int       e
+    )
+{
+  long long sum = 0;
+
+  for ( int t = 0; t < perf->nt; t ++ ) {
+    sum += ks_perf_read_one( perf->fd[ t ][ e ] );
+  }
+
+  return sum;
+}
+
+
+static inline void ks_perf_start( ks_perf_t *perf )
+{
+  for ( int e = 0; e < KS_PERF_NUM; e ++ ) {
+    if ( !perf->ok[ e ] ) continue;
+#ifdef __linux__
+    for ( int t = 0; t < perf->nt; t ++ ) {
+      ioctl( perf->fd[ t ][ e ], PERF_EVENT_IOC_ENABLE, 0 );
+    }
+#endif
+    perf->beg[ e ] = ks_perf_read_sum( perf, e );
+  }
+}
+
+
+static inline void ks_perf_stop( ks_perf_t *perf )
+{
+  for ( int e = 0; e < KS_PERF_NUM; e ++ ) {
+    if ( !perf->ok[ e ] ) continue;
+#ifdef __linux__
+    for ( int t = 0; t < perf->nt; t ++ ) {
+      ioctl( perf->fd[ t ][ e ], PERF_EVENT_IOC_DISABLE, 0 );
+    }
+#endif
+    perf->val[ e ] += ks_perf_read_sum( perf, e ) - perf->beg[ e ];
+  }
+}
+
+
+static inline void ks_perf_reset( ks_perf_t *perf )
+{
+  for ( int e = 0; e < KS_PERF_NUM; e ++ ) perf->val[ e ] = 0;
+}
+
+
+static inline void ks_perf_close( ks_perf_t *perf )
+{
+  for ( int t = 0; t < perf->nt; t ++ ) {
+    for ( int e = 0; e < KS_PERF_NUM; e ++ ) {
+#ifdef __linux__
+      if ( perf->fd[ t ][ e ] >= 0 ) close( perf->fd[ t ][ e ] );
+#endif
+      perf->fd[ t ][ e ] = -1;
+    }
+  }
+  for ( int e = 0; e < KS_PERF_NUM; e ++ ) perf->ok[ e ] = 0;
+}
+
+
+/* Accumulated count, or -1 if the event is not available. */
+static inline long long ks_perf_value(
+    ks_perf_t *perf,
+    ks_perf_event_t e
+    )
+{
+  return perf->ok[ e ] ? perf->val[ e ] : -1;
+}
+
+
+/*
+ * Roofline style summary of nflops floating point operations done in
+ * time seconds. Entries that need an unavailable counter are -1.
+ */
+static inline void ks_perf_roofline(
+    ks_perf_t     *perf,
+    double        nflops,
+    double        time,
+    ks_roofline_t *roof
+    )
+{
+  double peak = 16.0;
+  double cyc  = (double)ks_perf_value( perf, KS_PERF_CYCLES );
+  double ins  = (double)ks_perf_value( perf, KS_PERF_INSTR );
+  double llc  = (double)ks_perf_value( perf, KS_PERF_LLC_MISS );
+  char   *str;
+
+  str = getenv( "KS_PEAK_FLOPS_PER_CYCLE" );
+  if ( str != NULL ) peak = strtod( str, NULL );
+
+  roof->ipc             = ( cyc > 0 && ins >= 0 ) ? ins / cyc : -1;
+  roof->flops_per_cycle = ( cyc > 0 ) ? nflops / cyc : -1;
+  roof->pct_peak        = ( cyc > 0 ) ? 100.0 * nflops / cyc / peak : -1;
+  roof->dram_bytes      = ( llc >= 0 ) ? llc * 64.0 : -1;
+  roof->bandwidth       = ( llc >= 0 && time > 0 ) ? llc * 64.0 / time : -1;
+  roof->intensity       = ( llc > 0 ) ? nflops / ( llc * 64.0 ) : -1;
+}
+
+#endif // define __KS_PERF_H__
@@ -0,0 +1,17 @@
+#!/bin/bash
+export DYLD_LIBRARY_PATH=${DYLD_LIBRARY_PATH}:/opt/intel/lib:${GSKS_MKL_DIR}/lib
+
+## Accuracy and throughput regression suite ( see test_dgsks_accuracy.c ).
+## The exit status is the number of failed cases. The throughput floors
+## are set for Haswell and off by default; set KS_ACC_FLOOR_SCALE=1 to
+## check them there.
+
+status=0
+
+for nt in 1 7
+do
+  echo "KS_IC_NT=$nt"
+  KS_IC_NT=$nt ./test_dgsks_accuracy.x --floor-scale ${KS_ACC_FLOOR_SCALE:-0} "$@" || status=1
+done
+
+exit $status
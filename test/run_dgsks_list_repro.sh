@@ -0,0 +1,34 @@
+#!/bin/bash
+export DYLD_LIBRARY_PATH=${DYLD_LIBRARY_PATH}:/opt/intel/lib:${KS_MKL_DIR}/lib
+
+## Reproducible mode ( KS_LIST_REPRO=1 ) across thread counts. Each run of
+## test_dgsks_list.x checks one thread against OMP_NUM_THREADS threads and
+## prints a checksum of the result; the checksums of all runs must agree.
+## Arguments go to test_dgsks_list.x ( default 4097 513 16 100 ). The exit
+## status is 1 if a run fails or the checksums differ.
+
+args=${@:-4097 513 16 100}
+status=0
+first=""
+
+for nt in 1 7 68
+do
+  out=$( OMP_NUM_THREADS=$nt ./test_dgsks_list.x $args )
+  rc=$?
+  line=$( echo "$out" | grep '^repro:' )
+  if [ $rc -ne 0 ] || [ -z "$line" ]; then
+    echo "OMP_NUM_THREADS=$nt: test_dgsks_list.x failed"
+    status=1
+    continue
+  fi
+  echo "OMP_NUM_THREADS=$nt: $line"
+  sum=${line##*checksum }
+  if [ -z "$first" ]; then
+    first=$sum
+  elif [ "$sum" != "$first" ]; then
+    echo "OMP_NUM_THREADS=$nt: checksum $sum differs from $first"
+    status=1
+  fi
+done
+
+exit $status
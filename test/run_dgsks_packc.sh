@@ -0,0 +1,38 @@
+#!/bin/bash
+export DYLD_LIBRARY_PATH=${DYLD_LIBRARY_PATH}:/opt/intel/lib:${GSKS_MKL_DIR}/lib
+
+## Compare the k-outer variant (default) with the packC variant for k > KC.
+
+m=3600
+n=4097
+kmin=260
+kmax=2048
+kinc=131
+
+echo 'Gaussian_kouter = ['
+for (( k=kmin; k<kmax; k+=kinc ))
+do
+  KS_PACKC=0 ./test_dgsks.x Gaussian $m $n $k
+done
+echo '];'
+
+echo 'Gaussian_packc = ['
+for (( k=kmin; k<kmax; k+=kinc ))
+do
+  KS_PACKC=1 ./test_dgsks.x Gaussian $m $n $k
+done
+echo '];'
+
+echo 'Polynomial_kouter = ['
+for (( k=kmin; k<kmax; k+=kinc ))
+do
+  KS_PACKC=0 ./test_dgsks.x Polynomial $m $n $k
+done
+echo '];'
+
+echo 'Polynomial_packc = ['
+for (( k=kmin; k<kmax; k+=kinc ))
+do
+  KS_PACKC=1 ./test_dgsks.x Polynomial $m $n $k
+done
+echo '];'
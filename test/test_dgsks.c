@@ -22,6 +22,9 @@
  * Chenhan
  * Dec  7, 2015: Simplify 
  *
+ * KS_PERF=1 prints hardware counters and roofline numbers of dgsks()
+ * after the usual line, see ks_perf.h.
+ *
  * */
 
 
@@ -30,6 +33,7 @@
 #include <omp.h>
 #include <math.h>
 #include <ks.h>
+#include "ks_perf.h"
 
 #ifdef GSKS_MIC_AVX512
 #include <hbwmalloc.h>
@@ -105,6 +109,8 @@ void test_dgsks(
   double *XA, *XB, *XA2, *XB2, *u, *w, *h, *umkl;
   double tmp, error, flops;
   double ref_beg, ref_time, dgsks_beg, dgsks_time;
+  ks_perf_t *perf = NULL;
+  char   *str;
 
   nx     = NUM_POINTS;
   rhs    = KS_RHS;
@@ -209,11 +215,28 @@ void test_dgsks(
 
 
 
+  // ------------------------------------------------------------------------
+  // Hardware counters ( KS_PERF=1 ) on the KS_IC_NT threads of dgsks.
+  // ------------------------------------------------------------------------
+  str = getenv( "KS_PERF" );
+  if ( str != NULL && (int)strtol( str, NULL, 10 ) ) {
+    int nt = 1;
+    str = getenv( "KS_IC_NT" );
+    if ( str != NULL ) nt = (int)strtol( str, NULL, 10 );
+    perf = (ks_perf_t*)malloc( sizeof(ks_perf_t) );
+    ks_perf_open( perf, nt );
+  }
+  // ------------------------------------------------------------------------
+
+
   // ------------------------------------------------------------------------
   // Call my implementation
   // ------------------------------------------------------------------------
   for ( iter = -1; iter < n_iter; iter ++ ) {
-    if ( iter == 0 ) dgsks_beg = omp_get_wtime();
+    if ( iter == 0 ) {
+      if ( perf ) ks_perf_start( perf );
+      dgsks_beg = omp_get_wtime();
+    }
     dgsks(
         kernel,
         m, n, k,
@@ -224,6 +247,7 @@ void test_dgsks(
     );
   }
   dgsks_time = omp_get_wtime() - dgsks_beg;
+  if ( perf ) ks_perf_stop( perf );
   // ------------------------------------------------------------------------
 
 
@@ -290,6 +314,20 @@ void test_dgsks(
   printf( "%d, %d, %d, %5.2lf, %5.2lf;\n", 
       m, n, k, flops / dgsks_time, flops / ref_time );
 
+  if ( perf ) {
+    ks_roofline_t roof;
+    ks_perf_roofline( perf, flops * GFLOPS * n_iter, dgsks_time * n_iter, &roof );
+    printf( "%% ipc %.2lf, flops/cycle %.2lf ( %.1lf%% peak ), "
+        "L1D %lld, L2 %lld, LLC %lld misses, %.2lf GB/s, %.2lf flops/byte\n",
+        roof.ipc, roof.flops_per_cycle, roof.pct_peak,
+        ks_perf_value( perf, KS_PERF_L1D_MISS ),
+        ks_perf_value( perf, KS_PERF_L2_MISS ),
+        ks_perf_value( perf, KS_PERF_LLC_MISS ),
+        roof.bandwidth * 1E-9, roof.intensity );
+    ks_perf_close( perf );
+    free( perf );
+  }
+
 }
 
 /*
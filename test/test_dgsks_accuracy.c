@@ -0,0 +1,606 @@
+/*
+ * test_dgsks_accuracy.c
+ *
+ * Chenhan D. Yu
+ *
+ * Department of Computer Science, University of Texas at Austin
+ *
+ * Purpose:
+ * accuracy and throughput regression suite of dgsks(). Every kernel is run
+ * on a set of adversarial point distributions and compared with a long
+ * double reference that takes the square distances directly ( no norm
+ * expansion ). The error of each potential is measured in units of
+ *
+ *   eps * cond_i, cond_i = sum_j |w_j| ( |K_ij| + |K'_ij| * s_ij ),
+ *
+ * where K' is the derivative of the kernel with respect to its argument
+ * ( r^2 or x^Ty ) and s_ij bounds the magnitude of the terms that form the
+ * argument ( aa + bb + 2|a||b| times k + 2 ). Cancellation in the norm
+ * expansion or in the weighted sum is therefore charged to the data, and
+ * what is left is the error of the implementation. Each kernel has a
+ * budget in these units; a case above the budget fails.
+ *
+ * Each kernel also has a throughput floor in GFLOPS per thread ( same flop
+ * model as test_dgsks.c ), scaled by --floor-scale. The floors are set for
+ * Haswell at about half of the measured speed, so they are off by default;
+ * pass --floor-scale 1 to check them on a Haswell machine.
+ *
+ *   test_dgsks_accuracy.x [ --kernel all|Gaussian,... ] [ --floor-scale s ]
+ *                         [ --no-perf ] [ --verbose ]
+ *
+ * The exit status is the number of failed cases.
+ *
+ * Todo:
+ *
+ * Modification:
+ *
+ * */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <omp.h>
+#include <math.h>
+#include <ks.h>
+
+
+#define GFLOPS 1073741824
+
+#define ACC_M 517                 // odd sizes so that fringe tiles are hit
+#define ACC_N 389
+#define ACC_PERF_M 2048
+#define ACC_PERF_N 2048
+#define ACC_PERF_K 36
+#define ACC_PERF_REPS 3
+
+typedef enum {
+  ACC_UNIFORM,                    // [ 0, 0.1 ]^k, as test_dgsks.c
+  ACC_UNDERFLOW,                  // [ 0, 40 ]^k, exp() into denormals and 0
+  ACC_OFFSET,                     // 1E-3 cluster around 100, r^2 << aa + bb
+  ACC_NEARBY,                     // sources 1E-6 away from targets ( r ~ 0 )
+  ACC_BOUNDARY,                   // sources at r = 1 +- 1E-10 ( compact support )
+  ACC_MAGNITUDE,                  // coordinates 1E-8 ~ 1E2 with random signs
+  ACC_NUM_DIST
+} acc_dist_t;
+
+static const char *acc_dist_name[ ACC_NUM_DIST ] = {
+  "uniform", "underflow", "offset", "nearby", "boundary", "magnitude"
+};
+
+typedef struct {
+  const char *name;
+  ks_type    type;
+  double     scal;
+  double     cons;
+  double     powe;
+  double     budget;              // in eps * cond_i
+  double     floor;               // GFLOPS per thread
+  int        flops_per_pair;      // excluding the 2k of the rank-k update
+} acc_kernel_t;
+
+static acc_kernel_t acc_kernel[] = {
+  { "Gaussian",       KS_GAUSSIAN,               -0.5, 0.0, 0.0, 8.0, 12.0, 37 },
+  { "Var_bandwidth",  KS_GAUSSIAN_VAR_BANDWIDTH,  0.0, 0.0, 0.0, 8.0, 12.0, 35 },
+  { "Polynomial",     KS_POLYNOMIAL,              0.1, 0.1, 4.0, 4.0, 10.0,  6 },
+  { "Laplace",        KS_LAPLACE,                 0.0, 0.0, 0.0, 8.0,  2.0, 60 },
+  { "Tanh",           KS_TANH,                    0.1, 0.1, 0.0, 8.0,  6.0, 89 },
+  { "Quartic",        KS_QUARTIC,                 0.0, 0.0, 0.0, 4.0, 12.0,  8 },
+  { "Multiquadratic", KS_MULTIQUADRATIC,          0.0, 1.0, 0.0, 4.0, 12.0,  6 },
+  { "Epanechnikov",   KS_EPANECHNIKOV,            0.0, 0.0, 0.0, 4.0, 10.0,  7 },
+};
+
+#define ACC_NUM_KERNEL ( (int)( sizeof(acc_kernel) / sizeof(acc_kernel[ 0 ]) ) )
+
+// Dimensions of every case; the last one takes the k > DKS_KC path.
+static const int acc_k[] = { 3, 8, 37, 300 };
+
+#define ACC_NUM_K ( (int)( sizeof(acc_k) / sizeof(acc_k[ 0 ]) ) )
+
+
+
+static double acc_rand( void )
+{
+  return (double)rand() / (double)RAND_MAX;
+}
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Fill the m targets XA and the n sources XB ( k leading ) with
+ *         distribution dist.
+ * --------------------------------------------------------------------------
+ */
+static void acc_points(
+    acc_dist_t dist,
+    int        m,
+    int        n,
+    int        k,
+    double     *XA,
+    double     *XB
+    )
+{
+  int    i, j, p;
+  double nrm, r;
+  double *dir;
+
+  switch ( dist ) {
+    case ACC_UNIFORM:
+      for ( i = 0; i < m * k; i ++ ) XA[ i ] = 0.1 * acc_rand();
+      for ( j = 0; j < n * k; j ++ ) XB[ j ] = 0.1 * acc_rand();
+      break;
+    case ACC_UNDERFLOW:
+      for ( i = 0; i < m * k; i ++ ) XA[ i ] = 40.0 * acc_rand();
+      for ( j = 0; j < n * k; j ++ ) XB[ j ] = 40.0 * acc_rand();
+      break;
+    case ACC_OFFSET:
+      for ( i = 0; i < m * k; i ++ ) XA[ i ] = 100.0 + 1E-3 * acc_rand();
+      for ( j = 0; j < n * k; j ++ ) XB[ j ] = 100.0 + 1E-3 * acc_rand();
+      break;
+    case ACC_NEARBY:
+      for ( i = 0; i < m * k; i ++ ) XA[ i ] = acc_rand();
+      for ( j = 0; j < n; j ++ ) {
+        for ( p = 0; p < k; p ++ ) {
+          XB[ j * k + p ] = XA[ ( j % m ) * k + p ] + 1E-6 * ( acc_rand() + 0.5 );
+        }
+      }
+      break;
+    case ACC_BOUNDARY:
+      // Each source sits on the unit sphere around a target, perturbed by
+      // up to 1E-10 either way, so r^2 straddles the support radius.
+      dir = (double*)malloc( sizeof(double) * k );
+      for ( i = 0; i < m * k; i ++ ) XA[ i ] = 0.5 * acc_rand();
+      for ( j = 0; j < n; j ++ ) {
+        nrm = 0.0;
+        for ( p = 0; p < k; p ++ ) {
+          dir[ p ] = acc_rand() - 0.5;
+          nrm += dir[ p ] * dir[ p ];
+        }
+        r = ( 1.0 + 1E-10 * ( 2.0 * acc_rand() - 1.0 ) ) / sqrt( nrm );
+        for ( p = 0; p < k; p ++ ) {
+          XB[ j * k + p ] = XA[ ( j % m ) * k + p ] + r * dir[ p ];
+        }
+      }
+      free( dir );
+      break;
+    case ACC_MAGNITUDE:
+      for ( i = 0; i < m * k; i ++ ) {
+        XA[ i ] = pow( 10.0, -8.0 + 10.0 * acc_rand() ) * ( rand() % 2 ? 1.0 : -1.0 );
+      }
+      for ( j = 0; j < n * k; j ++ ) {
+        XB[ j ] = pow( 10.0, -8.0 + 10.0 * acc_rand() ) * ( rand() % 2 ? 1.0 : -1.0 );
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Kernel value and derivative with respect to its argument t
+ *         ( r^2 for distance kernels, x^Ty otherwise ), following the
+ *         definitions of dgsks_ref(). slack is the rounding window of t;
+ *         Epanechnikov takes the derivative from inside the support when
+ *         t is within slack of the radius.
+ * --------------------------------------------------------------------------
+ */
+static void acc_eval(
+    ks_t        *kernel,
+    long double t,
+    long double hi,
+    long double hj,
+    long double slack,
+    long double *val,
+    long double *der
+    )
+{
+  long double x;
+
+  switch ( kernel->type ) {
+    case KS_GAUSSIAN:
+      *val = expl( kernel->scal * t );
+      *der = kernel->scal * *val;
+      break;
+    case KS_GAUSSIAN_VAR_BANDWIDTH:
+      x    = -0.5L * hi * hj;
+      *val = expl( x * t );
+      *der = x * *val;
+      break;
+    case KS_POLYNOMIAL:
+      x    = kernel->scal * t + kernel->cons;
+      *val = powl( x, kernel->powe );
+      *der = kernel->scal * kernel->powe * powl( x, kernel->powe - 1.0L );
+      break;
+    case KS_LAPLACE:
+      if ( t < 1E-15L ) {
+        *val = 0.0L;
+        *der = 0.0L;
+      }
+      else {
+        *val = kernel->scal * powl( t, kernel->powe );
+        *der = kernel->powe * *val / t;
+      }
+      break;
+    case KS_TANH:
+      *val = tanhl( kernel->scal * t + kernel->cons );
+      *der = kernel->scal * ( 1.0L - *val * *val );
+      break;
+    case KS_QUARTIC:
+      *val = ( t < 1.0L ) ? ( 15.0L / 16.0L ) * ( 1.0L - t ) * ( 1.0L - t ) : 0.0L;
+      *der = ( t < 1.0L + slack ) ? ( 15.0L / 8.0L ) * fabsl( 1.0L - t ) : 0.0L;
+      break;
+    case KS_MULTIQUADRATIC:
+      *val = t + kernel->cons;
+      *der = 1.0L;
+      break;
+    case KS_EPANECHNIKOV:
+      *val = ( t < 1.0L ) ? ( 3.0L / 4.0L ) * ( 1.0L - t ) : 0.0L;
+      *der = ( t < 1.0L + slack ) ? ( 3.0L / 4.0L ) : 0.0L;
+      break;
+    default:
+      *val = 0.0L;
+      *der = 0.0L;
+  }
+}
+
+
+static int acc_is_dist( ks_type type )
+{
+  return ( type != KS_POLYNOMIAL && type != KS_TANH );
+}
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Long double reference potentials uref[ i * KS_RHS + p ] and the
+ *         condition numbers cond[ i * KS_RHS + p ] of the m targets.
+ * --------------------------------------------------------------------------
+ */
+static void acc_reference(
+    ks_t   *kernel,
+    int    m,
+    int    n,
+    int    k,
+    double *XA,
+    double *XA2,
+    double *XB,
+    double *XB2,
+    double *w,
+    double *uref,
+    double *cond
+    )
+{
+  int    i;
+
+  #pragma omp parallel for schedule( dynamic, 8 )
+  for ( i = 0; i < m; i ++ ) {
+    int         j, p;
+    long double t, s, ab, d, val, der, slack;
+    long double hi = 0.0L, hj = 0.0L;
+    long double usum[ KS_RHS ], csum[ KS_RHS ];
+
+    for ( p = 0; p < KS_RHS; p ++ ) {
+      usum[ p ] = 0.0L;
+      csum[ p ] = 0.0L;
+    }
+
+    if ( kernel->type == KS_GAUSSIAN_VAR_BANDWIDTH ) hi = kernel->hi[ i ];
+
+    for ( j = 0; j < n; j ++ ) {
+      t  = 0.0L;
+      ab = 0.0L;
+      for ( p = 0; p < k; p ++ ) {
+        if ( acc_is_dist( kernel->type ) ) {
+          d  = (long double)XA[ i * k + p ] - (long double)XB[ j * k + p ];
+          t += d * d;
+        }
+        else {
+          t += (long double)XA[ i * k + p ] * (long double)XB[ j * k + p ];
+        }
+        ab += fabsl( (long double)XA[ i * k + p ] * (long double)XB[ j * k + p ] );
+      }
+
+      if ( acc_is_dist( kernel->type ) ) {
+        s = ( k + 2 ) * ( (long double)XA2[ i ] + (long double)XB2[ j ] + 2.0L * ab );
+      }
+      else {
+        s = ( k + 2 ) * ab + fabsl( (long double)kernel->cons / kernel->scal );
+      }
+      slack = 16.0L * DBL_EPSILON * s;
+
+      if ( kernel->type == KS_GAUSSIAN_VAR_BANDWIDTH ) hj = kernel->hj[ j ];
+      acc_eval( kernel, t, hi, hj, slack, &val, &der );
+
+      for ( p = 0; p < KS_RHS; p ++ ) {
+        usum[ p ] += val * w[ j * KS_RHS + p ];
+        csum[ p ] += fabsl( w[ j * KS_RHS + p ] ) *
+          ( fabsl( val ) + fabsl( der ) * s + DBL_MIN / DBL_EPSILON );
+      }
+    }
+
+    for ( p = 0; p < KS_RHS; p ++ ) {
+      uref[ i * KS_RHS + p ] = (double)usum[ p ];
+      cond[ i * KS_RHS + p ] = (double)csum[ p ];
+    }
+  }
+}
+
+
+static void acc_norms( int nx, int k, double *X, double *X2 )
+{
+  int    i, p;
+
+  for ( i = 0; i < nx; i ++ ) {
+    X2[ i ] = 0.0;
+    for ( p = 0; p < k; p ++ ) X2[ i ] += X[ i * k + p ] * X[ i * k + p ];
+  }
+}
+
+
+static void acc_setup( acc_kernel_t *acc, ks_t *kernel )
+{
+  memset( kernel, 0, sizeof(ks_t) );
+  kernel->type = acc->type;
+  kernel->scal = acc->scal;
+  kernel->cons = acc->cons;
+  kernel->powe = acc->powe;
+}
+
+
+static void acc_bandwidth( ks_t *kernel, int m, int n, double *XA2, double *XB2 )
+{
+  int    i;
+
+  if ( kernel->type != KS_GAUSSIAN_VAR_BANDWIDTH ) return;
+
+  kernel->hi = (double*)malloc( sizeof(double) * m );
+  kernel->hj = (double*)malloc( sizeof(double) * n );
+  for ( i = 0; i < m; i ++ ) {
+    kernel->hi[ i ] = ( 1.0 + 0.5 / ( 1 + exp( -1.0 * XA2[ i ] ) ) );
+    kernel->hi[ i ] = -1.0 / ( 2.0 * kernel->hi[ i ] * kernel->hi[ i ] );
+  }
+  for ( i = 0; i < n; i ++ ) {
+    kernel->hj[ i ] = ( 1.0 + 0.5 / ( 1 + exp( -1.0 * XB2[ i ] ) ) );
+    kernel->hj[ i ] = -1.0 / ( 2.0 * kernel->hj[ i ] * kernel->hj[ i ] );
+  }
+}
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  One accuracy case. Returns 1 if the error exceeds the budget of
+ *         the kernel.
+ * --------------------------------------------------------------------------
+ */
+static int acc_case(
+    acc_kernel_t *acc,
+    acc_dist_t   dist,
+    int          k,
+    int          verbose
+    )
+{
+  int    i, p, m = ACC_M, n = ACC_N, max_idx = -1;
+  int    *amap, *bmap;
+  double *XA, *XB, *XA2, *XB2, *u, *w, *uref, *cond;
+  double err, units, max_units = 0.0, max_rel = 0.0, nrm = 0.0, dif = 0.0;
+  ks_t   kernel;
+
+  amap = (int*)malloc( sizeof(int) * m );
+  bmap = (int*)malloc( sizeof(int) * n );
+  XA   = (double*)malloc( sizeof(double) * m * k );
+  XB   = (double*)malloc( sizeof(double) * n * k );
+  XA2  = (double*)malloc( sizeof(double) * m );
+  XB2  = (double*)malloc( sizeof(double) * n );
+  u    = (double*)malloc( sizeof(double) * m * KS_RHS );
+  uref = (double*)malloc( sizeof(double) * m * KS_RHS );
+  cond = (double*)malloc( sizeof(double) * m * KS_RHS );
+  w    = (double*)malloc( sizeof(double) * n * KS_RHS );
+
+  srand( 1000 * (int)acc->type + 10 * (int)dist + k );
+
+  for ( i = 0; i < m; i ++ ) amap[ i ] = i;
+  for ( i = 0; i < n; i ++ ) bmap[ i ] = i;
+  for ( i = 0; i < m * KS_RHS; i ++ ) u[ i ] = 0.0;
+  for ( i = 0; i < n * KS_RHS; i ++ ) w[ i ] = 2.0 * acc_rand() - 1.0;
+
+  acc_points( dist, m, n, k, XA, XB );
+  acc_norms( m, k, XA, XA2 );
+  acc_norms( n, k, XB, XB2 );
+
+  acc_setup( acc, &kernel );
+  acc_bandwidth( &kernel, m, n, XA2, XB2 );
+
+  dgsks(
+      &kernel,
+      m, n, k,
+      u,        amap,
+      XA, XA2,  amap,
+      XB, XB2,  bmap,
+      w,        bmap
+      );
+
+  // dgsks() sets powe and scal of the Laplace kernel from k.
+  acc_reference( &kernel, m, n, k, XA, XA2, XB, XB2, w, uref, cond );
+
+  for ( i = 0; i < m; i ++ ) {
+    for ( p = 0; p < KS_RHS; p ++ ) {
+      err   = fabs( u[ i * KS_RHS + p ] - uref[ i * KS_RHS + p ] );
+      units = err / ( DBL_EPSILON * cond[ i * KS_RHS + p ] );
+      if ( !( units <= max_units ) ) {
+        max_units = units;
+        max_idx   = i;
+      }
+      dif += err * err;
+      nrm += uref[ i * KS_RHS + p ] * uref[ i * KS_RHS + p ];
+    }
+  }
+  if ( nrm > 0.0 ) max_rel = sqrt( dif / nrm );
+
+  if ( verbose || !( max_units <= acc->budget ) ) {
+    printf( "%-14s %-9s k %3d: %8.2lf eps*cond ( budget %4.1lf ), rel error %.2E, idx %d%s\n",
+        acc->name, acc_dist_name[ dist ], k, max_units, acc->budget,
+        max_rel, max_idx, max_units <= acc->budget ? "" : "  FAIL" );
+  }
+
+  if ( kernel.type == KS_GAUSSIAN_VAR_BANDWIDTH ) {
+    free( kernel.hi );
+    free( kernel.hj );
+  }
+  free( amap );
+  free( bmap );
+  free( XA );
+  free( XB );
+  free( XA2 );
+  free( XB2 );
+  free( u );
+  free( uref );
+  free( cond );
+  free( w );
+
+  return !( max_units <= acc->budget );
+}
+
+
+/*
+ * --------------------------------------------------------------------------
+ * @brief  Throughput of one kernel at ACC_PERF_M x ACC_PERF_N x ACC_PERF_K
+ *         ( best of ACC_PERF_REPS ) against the floor times the number of
+ *         threads, at most one per processor. Returns 1 if it is below.
+ * --------------------------------------------------------------------------
+ */
+static int acc_perf(
+    acc_kernel_t *acc,
+    double       floor_scale
+    )
+{
+  int    i, r, m = ACC_PERF_M, n = ACC_PERF_N, nt = 1;
+  int    k = ( acc->type == KS_LAPLACE ) ? 3 : ACC_PERF_K;
+  int    *amap, *bmap;
+  double *XA, *XB, *XA2, *XB2, *u, *w;
+  double beg, time, best = 0.0, flops, gflops, floor;
+  char   *str;
+  ks_t   kernel;
+
+  str = getenv( "KS_IC_NT" );
+  if ( str != NULL ) nt = (int)strtol( str, NULL, 10 );
+  if ( nt < 1 ) nt = 1;
+  if ( nt > omp_get_num_procs() ) nt = omp_get_num_procs();
+
+  amap = (int*)malloc( sizeof(int) * m );
+  bmap = (int*)malloc( sizeof(int) * n );
+  XA   = (double*)malloc( sizeof(double) * m * k );
+  XB   = (double*)malloc( sizeof(double) * n * k );
+  XA2  = (double*)malloc( sizeof(double) * m );
+  XB2  = (double*)malloc( sizeof(double) * n );
+  u    = (double*)malloc( sizeof(double) * m * KS_RHS );
+  w    = (double*)malloc( sizeof(double) * n * KS_RHS );
+
+  for ( i = 0; i < m; i ++ ) amap[ i ] = i;
+  for ( i = 0; i < n; i ++ ) bmap[ i ] = i;
+  for ( i = 0; i < m * KS_RHS; i ++ ) u[ i ] = 0.0;
+  for ( i = 0; i < n * KS_RHS; i ++ ) w[ i ] = acc_rand();
+
+  acc_points( ACC_UNIFORM, m, n, k, XA, XB );
+  acc_norms( m, k, XA, XA2 );
+  acc_norms( n, k, XB, XB2 );
+
+  acc_setup( acc, &kernel );
+  acc_bandwidth( &kernel, m, n, XA2, XB2 );
+
+  for ( r = -1; r < ACC_PERF_REPS; r ++ ) {
+    beg = omp_get_wtime();
+    dgsks(
+        &kernel,
+        m, n, k,
+        u,        amap,
+        XA, XA2,  amap,
+        XB, XB2,  bmap,
+        w,        bmap
+        );
+    time = omp_get_wtime() - beg;
+    if ( r >= 0 && ( best == 0.0 || time < best ) ) best = time;
+  }
+
+  flops  = ( (double)m * n / GFLOPS ) * ( 2 * k + acc->flops_per_pair );
+  gflops = flops / best;
+  floor  = acc->floor * floor_scale * nt;
+
+  printf( "%-14s perf      k %3d: %8.2lf GFLOPS ( floor %5.1lf )%s\n",
+      acc->name, k, gflops, floor, gflops >= floor ? "" : "  FAIL" );
+
+  if ( kernel.type == KS_GAUSSIAN_VAR_BANDWIDTH ) {
+    free( kernel.hi );
+    free( kernel.hj );
+  }
+  free( amap );
+  free( bmap );
+  free( XA );
+  free( XB );
+  free( XA2 );
+  free( XB2 );
+  free( u );
+  free( w );
+
+  return gflops < floor;
+}
+
+
+int main( int argc, char *argv[] )
+{
+  int    a, e, d, k, nfail = 0, ncase = 0, perf = 1, verbose = 0;
+  int    use[ ACC_NUM_KERNEL ];
+  double floor_scale = 0.0;
+  char   *list = "all";
+
+  for ( a = 1; a < argc; a ++ ) {
+    if ( !strcmp( argv[ a ], "--kernel" ) && a + 1 < argc ) {
+      list = argv[ ++ a ];
+    }
+    else if ( !strcmp( argv[ a ], "--floor-scale" ) && a + 1 < argc ) {
+      floor_scale = strtod( argv[ ++ a ], NULL );
+    }
+    else if ( !strcmp( argv[ a ], "--no-perf" ) ) {
+      perf = 0;
+    }
+    else if ( !strcmp( argv[ a ], "--verbose" ) ) {
+      verbose = 1;
+    }
+    else {
+      printf( "usage: %s [ --kernel all|Gaussian,... ] [ --floor-scale s ] "
+          "[ --no-perf ] [ --verbose ]\n", argv[ 0 ] );
+      exit( 1 );
+    }
+  }
+
+  for ( e = 0; e < ACC_NUM_KERNEL; e ++ ) {
+    const char *s = strstr( list, acc_kernel[ e ].name );
+    size_t     len = strlen( acc_kernel[ e ].name );
+    use[ e ] = !strcmp( list, "all" ) ||
+      ( s && ( s == list || s[ -1 ] == ',' ) && ( s[ len ] == '\0' || s[ len ] == ',' ) );
+  }
+
+  for ( e = 0; e < ACC_NUM_KERNEL; e ++ ) {
+    if ( !use[ e ] ) continue;
+    for ( d = 0; d < ACC_NUM_DIST; d ++ ) {
+      for ( k = 0; k < ACC_NUM_K; k ++ ) {
+        // The Laplace kernel is only defined for k > 2, and r^( 2 - k )
+        // overflows a double at the largest k for the close offset points.
+        if ( acc_kernel[ e ].type == KS_LAPLACE &&
+            ( acc_k[ k ] < 3 || k == ACC_NUM_K - 1 ) ) continue;
+        nfail += acc_case( &acc_kernel[ e ], (acc_dist_t)d, acc_k[ k ], verbose );
+        ncase ++;
+      }
+    }
+    if ( perf && floor_scale > 0.0 ) {
+      nfail += acc_perf( &acc_kernel[ e ], floor_scale );
+      ncase ++;
+    }
+  }
+
+  printf( "%d / %d cases passed\n", ncase - nfail, ncase );
+
+  return nfail;
+}
@@ -1,8 +1,10 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <omp.h>
 #include <vector>
 #include <iostream>
+#include <algorithm>
 
 extern "C" {
 #include <ks.h>
@@ -29,16 +31,16 @@ void random_permutation( int* x, int nx )
 // C++ implementation using std::vector
 // Create two separate coordinate tables, n_list random lists
 // amap[ n_list ], bmap[ n_list ], wmap[ n_list ]
+// Returns 1 if the reproducible mode gives different bits on one thread.
 //
-//
-void test_dgsks_list(
+int test_dgsks_list(
     int    rangem,
     int    rangen,
     int    k,
     int    ntask
     ) 
 {
-  int    m, n, i, j, p, nx, iter;
+  int    m, n, i, j, p, nx, iter, status = 0;
   int    *amap, *bmap, *wmap;
   int    *randperm;
   double *XA, *XB, *XA2, *XB2, *u, *w, *umkl;
@@ -270,9 +272,388 @@ void test_dgsks_list(
   printf( "dgsks: %6.4lf secs / %4.1lf Gflops, ref: %6.4lf secs / %4.1lf Gflops, Absolute Error: %E\n", 
       dgsks_time, flops / dgsks_time, ref_time, flops / ref_time, sqrt( error ) );
 
+
+  // Same lists on a dataset handle: the norms are computed by the first
+  // call and reused by the second.
+  {
+    gsks_points_t *pts = gsks_points_create( nx, k, XA, 0 );
+    std::vector<double> upts;
+    double first, cached;
+
+    for ( int rep = 0; rep < 2; rep ++ ) {
+      upts.assign( nx, 0.0 );
+      dgsks_beg = omp_get_wtime();
+      omp_dgsks_list_separated_u_symmetric(
+          &kernel, upts, alist, pts, alist, blist, w, wlist );
+      if ( rep == 0 ) first  = omp_get_wtime() - dgsks_beg;
+      else            cached = omp_get_wtime() - dgsks_beg;
+    }
+
+    error = 0.0;
+    for ( i = 0; i < nx; i ++ ) {
+      tmp = umkl[ i ] - upts[ i ];
+      error += tmp * tmp;
+    }
+    printf( "handle: %6.4lf secs, cached norms: %6.4lf secs, Absolute Error: %E\n",
+        first, cached, sqrt( error ) );
+
+
+    // The same tasks through the asynchronous queue, submitted one by one.
+    gsks_queue_t *queue;
+
+    upts.assign( nx, 0.0 );
+    dgsks_beg = omp_get_wtime();
+    queue = gsks_queue_create( &kernel, pts, pts, upts.data(), w, 0 );
+    for ( i = 0; i < n_list; i ++ ) {
+      gsks_task_t task;
+      task.m    = alist[ i ].size();
+      task.n    = blist[ i ].size();
+      task.umap = alist[ i ].data();
+      task.amap = alist[ i ].data();
+      task.bmap = blist[ i ].data();
+      task.wmap = wlist[ i ].data();
+      gsks_submit( queue, &task );
+    }
+    gsks_wait( queue );
+    first = omp_get_wtime() - dgsks_beg;
+    gsks_queue_free( queue );
+
+    error = 0.0;
+    for ( i = 0; i < nx; i ++ ) {
+      tmp = umkl[ i ] - upts[ i ];
+      error += tmp * tmp;
+    }
+    printf( "queue: %6.4lf secs, Absolute Error: %E\n", first, sqrt( error ) );
+
+    gsks_points_free( pts );
+  }
+
+
+  // Reproducible mode: one thread and all threads must agree bitwise. The
+  // checksum compares runs with other OMP_NUM_THREADS.
+  {
+    std::vector<double> urep1, urep;
+    unsigned long long  sum = 0;
+    int    nthd = omp_get_max_threads(), same = 1;
+    double t1, tn;
+
+    setenv( "KS_LIST_REPRO", "1", 1 );
+
+    omp_set_num_threads( 1 );
+    urep1.assign( nx, 0.0 );
+    dgsks_beg = omp_get_wtime();
+    omp_dgsks_list_separated_u_symmetric(
+        &kernel, k, urep1, alist, XA, nx, alist, blist, w, wlist );
+    t1 = omp_get_wtime() - dgsks_beg;
+
+    omp_set_num_threads( nthd );
+    urep.assign( nx, 0.0 );
+    dgsks_beg = omp_get_wtime();
+    omp_dgsks_list_separated_u_symmetric(
+        &kernel, k, urep, alist, XA, nx, alist, blist, w, wlist );
+    tn = omp_get_wtime() - dgsks_beg;
+
+    unsetenv( "KS_LIST_REPRO" );
+
+    for ( i = 0; i < nx; i ++ ) {
+      unsigned long long bits;
+      memcpy( &bits, &urep[ i ], sizeof(bits) );
+      if ( memcmp( &urep[ i ], &urep1[ i ], sizeof(double) ) ) same = 0;
+      sum = ( sum ^ bits ) * 1099511628211ULL;
+    }
+    printf( "repro: %6.4lf secs ( 1 thread %6.4lf secs ), %d threads %s, checksum %016llx\n",
+        tn, t1, nthd, same ? "bitwise equal" : "DIFFERENT", sum );
+    if ( !same ) status = 1;
+  }
+
+  // Incremental update: change a few hundred weights, update uvec with
+  // omp_dgsks_list_delta() twice ( the second call reuses the packed
+  // targets ) and compare with the reference on the new weights.
+  {
+    std::vector<gsks_targets_t*> targets;
+    std::vector<int>    changed;
+    std::vector<double> delta;
+    double first, cached;
+
+    random_permutation( randperm, nx );
+    for ( i = 0; i < 300; i ++ ) {
+      changed.push_back( randperm[ i ] );
+      delta.push_back( 0.5 * ( (double)( rand() % 100 ) / 100.0 - 0.5 ) );
+    }
+
+    for ( int rep = 0; rep < 2; rep ++ ) {
+      dgsks_beg = omp_get_wtime();
+      omp_dgsks_list_delta( &kernel, k, uvec, alist, XA, XA2, alist,
+          XB, XB2, blist, wlist, targets, changed.size(), changed.data(),
+          delta.data() );
+      if ( rep == 0 ) first  = omp_get_wtime() - dgsks_beg;
+      else            cached = omp_get_wtime() - dgsks_beg;
+      for ( i = 0; i < (int)changed.size(); i ++ ) w[ changed[ i ] ] += delta[ i ];
+    }
+
+    for ( i = 0; i < nx; i ++ ) umkl[ i ] = 0.0;
+    for ( i = 0; i < n_list; i ++ ) {
+      dgsks_ref( &kernel, alist[ i ].size(), blist[ i ].size(), k, umkl,
+          alist[ i ].data(), XA, XA2, alist[ i ].data(), XB, XB2,
+          blist[ i ].data(), w, wlist[ i ].data() );
+    }
+
+    error = 0.0;
+    for ( i = 0; i < nx; i ++ ) {
+      tmp = umkl[ i ] - uvec[ i ];
+      error += tmp * tmp;
+    }
+    printf( "delta: %d weights, %6.4lf secs, cached targets: %6.4lf secs, Absolute Error: %E\n",
+        (int)changed.size(), first, cached, sqrt( error ) );
+
+    for ( i = 0; i < (int)targets.size(); i ++ ) gsks_targets_free( targets[ i ] );
+  }
+
+  // Tree lists: partition nx points in the unit cube, sum the near field
+  // of every leaf and check sampled targets against dgsks_ref() over the
+  // same sources. Every source within the cutoff must be in a near leaf
+  // of its target.
+  {
+    int    kt  = 3;
+    double *XT  = (double*)malloc( sizeof(double) * kt * nx );
+    double *XT2 = (double*)malloc( sizeof(double) * nx );
+    double *wt  = (double*)malloc( sizeof(double) * nx );
+    double cutoff = 0.2, build, listing, sum;
+    ks_t   near_kernel = kernel;
+    gsks_tree_t  *tree;
+    gsks_lists_t *L;
+    std::vector<double> ut( nx, 0.0 );
+    long   npair = 0, missed = 0;
+    int    zero = 0;
+
+    for ( i = 0; i < nx * kt; i ++ ) XT[ i ] = (double)( rand() % 10000 ) / 10000.0;
+    memcpy( wt, w, sizeof(double) * nx );
+    near_kernel.scal = -0.5 / ( 0.05 * 0.05 );
+
+    dgsks_beg = omp_get_wtime();
+    tree  = gsks_tree_create( nx, kt, XT, 256 );
+    build = omp_get_wtime() - dgsks_beg;
+    gsks_tree_permute( tree, 1, wt );
+    for ( i = 0; i < nx; i ++ ) {
+      tmp = 0.0;
+      for ( p = 0; p < kt; p ++ ) tmp += XT[ i * kt + p ] * XT[ i * kt + p ];
+      XT2[ i ] = tmp;
+    }
+
+    dgsks_beg = omp_get_wtime();
+    L = gsks_tree_near_lists( tree, tree, cutoff );
+    listing = omp_get_wtime() - dgsks_beg;
+
+    dgsks_beg = omp_get_wtime();
+    omp_dgsks_list( &near_kernel, kt, L->n_list, ut.data(), NULL, NULL,
+        XT, XT2, L->aptr, L->aidx, XT, XT2, L->bptr, L->bidx, wt, NULL, NULL );
+    sum = omp_get_wtime() - dgsks_beg;
+
+    error = 0.0;
+    for ( i = 0; i < nx; i += nx / 64 ) {
+      int    leaf = 0;
+      double uref = 0.0;
+      std::vector<int> src, near( nx, 0 );
+
+      while ( tree->end[ tree->nleaf - 1 + leaf ] <= i ) leaf ++;
+      for ( int l = 0; l < L->n_list; l ++ ) {
+        if ( L->pair[ 2 * l ] != leaf ) continue;
+        src.insert( src.end(), L->bidx + L->bptr[ l ], L->bidx + L->bptr[ l + 1 ] );
+      }
+      for ( j = 0; j < (int)src.size(); j ++ ) near[ src[ j ] ] = 1;
+      for ( j = 0; j < nx; j ++ ) {
+        double d2 = 0.0;
+        for ( p = 0; p < kt; p ++ ) {
+          d2 += ( XT[ i * kt + p ] - XT[ j * kt + p ] ) * ( XT[ i * kt + p ] - XT[ j * kt + p ] );
+        }
+        if ( sqrt( d2 ) <= cutoff && !near[ j ] ) missed ++;
+      }
+      dgsks_ref( &near_kernel, 1, src.size(), kt, &uref, &zero, XT, XT2, &i,
+          XT, XT2, src.data(), wt, src.data() );
+      error += ( uref - ut[ i ] ) * ( uref - ut[ i ] );
+    }
+    for ( i = 0; i < L->n_list; i ++ ) {
+      npair += (long)( L->aptr[ i + 1 ] - L->aptr[ i ] ) * ( L->bptr[ i + 1 ] - L->bptr[ i ] );
+    }
+
+    printf( "tree: %d leaves, %d lists ( %.1lf%% of the pairs ), build %6.4lf, lists %6.4lf, "
+        "sum %6.4lf secs, Absolute Error: %E, missed %ld\n",
+        tree->nleaf, L->n_list, 100.0 * npair / ( (double)nx * nx ), build, listing,
+        sum, sqrt( error ), missed );
+
+    gsks_lists_free( L );
+    gsks_tree_free( tree );
+    free( XT );
+    free( XT2 );
+    free( wt );
+  }
+
+  // Treecode: a wide kernel on nx points in the unit cube, sampled
+  // targets checked against the direct sum over all sources.
+  {
+    int    kt  = 3;
+    double *XT  = (double*)malloc( sizeof(double) * kt * nx );
+    double *XT2 = (double*)malloc( sizeof(double) * nx );
+    double *wt  = (double*)malloc( sizeof(double) * nx );
+    double theta[ 2 ] = { 0.5, 0.25 };
+    ks_t   far_kernel = kernel;
+    gsks_tree_t *tree;
+    std::vector<int> sidx( nx );
+    int    zero = 0;
+
+    for ( i = 0; i < nx * kt; i ++ ) XT[ i ] = (double)( rand() % 10000 ) / 10000.0;
+    for ( i = 0; i < nx; i ++ ) sidx[ i ] = i;
+    memcpy( wt, w, sizeof(double) * nx );
+    far_kernel.scal = -0.5 / ( 0.2 * 0.2 );
+
+    tree = gsks_tree_create( nx, kt, XT, 64 );
+    gsks_tree_permute( tree, 1, wt );
+    for ( i = 0; i < nx; i ++ ) {
+      tmp = 0.0;
+      for ( p = 0; p < kt; p ++ ) tmp += XT[ i * kt + p ] * XT[ i * kt + p ];
+      XT2[ i ] = tmp;
+    }
+
+    for ( int t = 0; t < 2; t ++ ) {
+      gsks_treecode_t *tc;
+      std::vector<double> ut( nx, 0.0 );
+      double setup, eval, unorm = 0.0;
+      int    n_near, n_far;
+
+      dgsks_beg = omp_get_wtime();
+      tc    = gsks_treecode_create( tree, tree, theta[ t ], 1 );
+      setup = omp_get_wtime() - dgsks_beg;
+      gsks_treecode_stat( tc, &n_near, &n_far );
+
+      dgsks_beg = omp_get_wtime();
+      gsks_treecode_eval( &far_kernel, tc, ut.data(), wt );
+      eval  = omp_get_wtime() - dgsks_beg;
+
+      error = 0.0;
+      for ( i = 0; i < nx; i += nx / 64 ) {
+        double uref = 0.0;
+        dgsks_ref( &far_kernel, 1, nx, kt, &uref, &zero, XT, XT2, &i,
+            XT, XT2, sidx.data(), wt, sidx.data() );
+        error += ( uref - ut[ i ] ) * ( uref - ut[ i ] );
+        unorm += uref * uref;
+      }
+
+      printf( "treecode: theta %4.2lf, %d near, %d far lists, setup %6.4lf, eval %6.4lf secs, "
+          "Relative Error: %E\n", theta[ t ], n_near, n_far, setup, eval,
+          sqrt( error / unorm ) );
+
+      gsks_treecode_free( tc );
+    }
+
+    // Skeletons instead of centroids, at the looser theta.
+    {
+      gsks_skel_t     *sk;
+      gsks_treecode_t *tc;
+      std::vector<double> ut( nx, 0.0 );
+      double setup, eval, unorm = 0.0;
+
+      dgsks_beg = omp_get_wtime();
+      sk    = gsks_skel_create( &far_kernel, tree, 1E-7, 64 );
+      setup = omp_get_wtime() - dgsks_beg;
+      tc    = gsks_treecode_create( tree, tree, theta[ 0 ], 0 );
+      gsks_treecode_set_skel( tc, sk );
+
+      dgsks_beg = omp_get_wtime();
+      gsks_treecode_eval( &far_kernel, tc, ut.data(), wt );
+      eval  = omp_get_wtime() - dgsks_beg;
+
+      error = 0.0;
+      for ( i = 0; i < nx; i += nx / 64 ) {
+        double uref = 0.0;
+        dgsks_ref( &far_kernel, 1, nx, kt, &uref, &zero, XT, XT2, &i,
+            XT, XT2, sidx.data(), wt, sidx.data() );
+        error += ( uref - ut[ i ] ) * ( uref - ut[ i ] );
+        unorm += uref * uref;
+      }
+
+      printf( "skeleton: theta %4.2lf, average rank %5.1lf, setup %6.4lf, eval %6.4lf secs, "
+          "Relative Error: %E\n", theta[ 0 ], (double)sk->sptr[ tree->nnode ] / tree->nnode,
+          setup, eval, sqrt( error / unorm ) );
+
+      gsks_treecode_free( tc );
+      gsks_skel_free( sk );
+    }
+
+    gsks_tree_free( tree );
+    free( XT );
+    free( XT2 );
+    free( wt );
+  }
+
+  // Kernel ridge regression: ( K + lambda I ) alpha = y with two right
+  // hand sides on 1024 points, K dense through all leaf pairs. The true
+  // residual is checked with the solver's own matvec.
+  {
+    int    ns = std::min( nx, 1024 ), kt = 3, nrhs = 2;
+    double *XT = (double*)malloc( sizeof(double) * kt * ns );
+    ks_t   krr_kernel = kernel;
+    gsks_tree_t   *tree;
+    gsks_lists_t  *L;
+    gsks_points_t *pts;
+    gsks_solver_t *sol;
+    std::vector<double> y( ns * nrhs ), alpha( ns * nrhs ), r( ns * nrhs );
+    std::vector<int> leaf;
+    const char *name[ 3 ] = { "none", "diag", "block" };
+    ks_precond_t precond[ 3 ] = { KS_PRECOND_NONE, KS_PRECOND_DIAG, KS_PRECOND_BLOCK_JACOBI };
+
+    for ( i = 0; i < ns * kt; i ++ ) XT[ i ] = (double)( rand() % 10000 ) / 10000.0;
+    for ( i = 0; i < ns * nrhs; i ++ ) y[ i ] = (double)( rand() % 1000 ) / 1000.0 - 0.5;
+    krr_kernel.scal = -0.5 / ( 0.1 * 0.1 );
+
+    tree = gsks_tree_create( ns, kt, XT, 128 );
+    L    = gsks_tree_near_lists( tree, tree, 1E+30 );
+    for ( i = 0; i < tree->nleaf; i ++ ) leaf.push_back( tree->beg[ tree->nleaf - 1 + i ] );
+    leaf.push_back( ns );
+
+    pts = gsks_points_create( ns, kt, XT, 0 );
+    sol = gsks_solver_create( &krr_kernel, pts, L->n_list, L->aptr, L->aidx,
+        L->bptr, L->bidx, 1E-1 );
+
+    for ( int pc = 0; pc < 3; pc ++ ) {
+      gsks_solver_set_precond( sol, precond[ pc ], tree->nleaf, leaf.data() );
+
+      for ( int method = 0; method < 2; method ++ ) {
+        double relres[ 2 ], true_res = 0.0, secs;
+        int    iter;
+
+        dgsks_beg = omp_get_wtime();
+        iter = gsks_solver_solve( sol, method ? KS_SOLVER_MINRES : KS_SOLVER_CG,
+            nrhs, y.data(), ns, alpha.data(), ns, 1E-6, 500, relres );
+        secs = omp_get_wtime() - dgsks_beg;
+
+        gsks_solver_matvec( sol, nrhs, alpha.data(), ns, r.data(), ns );
+        for ( j = 0; j < nrhs; j ++ ) {
+          double rr = 0.0, yy = 0.0;
+          for ( i = 0; i < ns; i ++ ) {
+            tmp = r[ j * ns + i ] - y[ j * ns + i ];
+            rr += tmp * tmp;
+            yy += y[ j * ns + i ] * y[ j * ns + i ];
+          }
+          true_res = std::max( true_res, sqrt( rr / yy ) );
+        }
+
+        printf( "solver: %-6s %-5s %3d iterations, %6.4lf secs, residual %E ( true %E )\n",
+            method ? "minres" : "cg", name[ pc ], iter, secs,
+            std::max( relres[ 0 ], relres[ 1 ] ), true_res );
+      }
+    }
+
+    gsks_solver_free( sol );
+    gsks_points_free( pts );
+    gsks_lists_free( L );
+    gsks_tree_free( tree );
+    free( XT );
+  }
+
   free( XA );
   free( XA2 );
 
+  return status;
 }
 
 
@@ -286,7 +667,5 @@ int main( int argc, char *argv[] )
   sscanf( argv[ 3 ], "%d", &k );
   sscanf( argv[ 4 ], "%d", &ntask );
 
-  test_dgsks_list( rangem, rangen, k, ntask );
-
-  return 0;
+  return test_dgsks_list( rangem, rangen, k, ntask );
 }
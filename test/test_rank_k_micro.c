@@ -3,6 +3,7 @@
 #include <malloc.h>
 #include <omp.h>
 #include <ks.h>
+#include "ks_perf.h"
 
 
 
@@ -175,6 +176,10 @@ void test_rank_k_micro()
   double *a, *b, *c;
   //aux_t aux;
   double rank_k_beg, rank_k_time;
+  ks_perf_t     perf;
+  ks_roofline_t roof;
+
+  ks_perf_open( &perf, 1 );
 
 
   posix_memalign( (void**)&a, (size_t)MIC_DKS_SIMD_ALIGN_SIZE, 
@@ -192,6 +197,7 @@ void test_rank_k_micro()
     b[ i ] = 1.0;
   }
 
+  ks_perf_start( &perf );
   rank_k_beg = omp_get_wtime();
 
     aux_t aux;
@@ -207,10 +213,20 @@ void test_rank_k_micro()
 	}
 
   rank_k_time = omp_get_wtime() - rank_k_beg;
+  ks_perf_stop( &perf );
+
+  // 100 calls of a 8 x 30 rank-k update.
+  ks_perf_roofline( &perf, 100.0 * 2.0 * 8 * 30 * k, rank_k_time, &roof );
   rank_k_time /= 100;
 
   printf( "mic rank_k: %lf sec, %lf Gflops\n", rank_k_time, 
 	  (double)( 0.002 * 0.030 * 0.008 * ( k + 1 ) ) / rank_k_time );
+  printf( "mic rank_k: ipc %.2lf, flops/cycle %.2lf ( %.1lf%% peak ), "
+      "L1D %lld, LLC %lld misses\n",
+      roof.ipc, roof.flops_per_cycle, roof.pct_peak,
+      ks_perf_value( &perf, KS_PERF_L1D_MISS ),
+      ks_perf_value( &perf, KS_PERF_LLC_MISS ) );
+  ks_perf_close( &perf );
 
   free( a );
   free( b );